@@ -0,0 +1,98 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+#define ARENA_INITIAL_CAPACITY 4096
+
+// Initialize an empty arena
+void arena_init(StringArena* arena) {
+    arena->data = NULL;
+    arena->size = 0;
+    arena->capacity = 0;
+}
+
+// Make room for at least `additional` more bytes. Returns 0 if the arena
+// cannot grow (out of memory, or past what a StrRef offset can address).
+int arena_reserve(StringArena* arena, size_t additional) {
+    size_t needed = arena->size + additional;
+    if (needed <= arena->capacity) {
+        return 1;
+    }
+    if (needed > UINT32_MAX) {
+        fprintf(stderr, "String arena is full (%zu bytes)\n", arena->size);
+        return 0;
+    }
+
+    size_t new_capacity = arena->capacity ? arena->capacity : ARENA_INITIAL_CAPACITY;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    if (new_capacity > UINT32_MAX) {
+        new_capacity = UINT32_MAX;
+    }
+
+    char* new_data = (char*)realloc(arena->data, new_capacity);
+    if (!new_data) {
+        fprintf(stderr, "Memory allocation failed while growing string arena\n");
+        return 0;
+    }
+    arena->data = new_data;
+    arena->capacity = new_capacity;
+    return 1;
+}
+
+// Copy a string into the arena. Empty strings take no space.
+StrRef arena_add(StringArena* arena, const char* value, size_t length) {
+    char* dest = arena_prepare(arena, length);
+    if (!dest) {
+        StrRef empty = {0, 0};
+        return empty;
+    }
+    memcpy(dest, value, length);
+    return arena_commit(arena, length);
+}
+
+// Return space for a string of up to max_length bytes (plus terminator) at the
+// end of the arena, for callers that decode straight into it. Finish with
+// arena_commit. Returns NULL if the arena cannot grow.
+char* arena_prepare(StringArena* arena, size_t max_length) {
+    if (!arena_reserve(arena, max_length + 1)) {
+        return NULL;
+    }
+    return arena->data + arena->size;
+}
+
+// Terminate and keep the `length` bytes written after arena_prepare
+StrRef arena_commit(StringArena* arena, size_t length) {
+    StrRef ref = {0, 0};
+    if (length == 0) {
+        return ref;
+    }
+    arena->data[arena->size + length] = '\0';
+    ref.offset = (uint32_t)arena->size;
+    ref.length = (uint32_t)length;
+    arena->size += length + 1;
+    return ref;
+}
+
+// Look up a string. The pointer is valid until the arena next grows.
+const char* arena_get(const StringArena* arena, StrRef ref) {
+    return ref.length ? arena->data + ref.offset : "";
+}
+
+// FNV-1a hash of a string, shared by the indexes over arena strings
+uint32_t arena_hash(const char* value, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)value[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Free the arena's memory
+void arena_free(StringArena* arena) {
+    free(arena->data);
+    arena_init(arena);
+}
@@ -0,0 +1,31 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Reference to a NUL-terminated string stored in a StringArena
+typedef struct {
+    uint32_t offset;    // Byte offset of the first character
+    uint32_t length;    // Length without the terminator (0 = empty string)
+} StrRef;
+
+// Growable block of NUL-terminated strings addressed by offset. Pointers into
+// the arena are invalidated when it grows, so hold StrRefs, not pointers.
+typedef struct {
+    char* data;
+    size_t size;        // Bytes in use
+    size_t capacity;    // Bytes allocated
+} StringArena;
+
+// Function declarations
+void arena_init(StringArena* arena);
+int arena_reserve(StringArena* arena, size_t additional);
+StrRef arena_add(StringArena* arena, const char* value, size_t length);
+char* arena_prepare(StringArena* arena, size_t max_length);
+StrRef arena_commit(StringArena* arena, size_t length);
+const char* arena_get(const StringArena* arena, StrRef ref);
+uint32_t arena_hash(const char* value, size_t length);
+void arena_free(StringArena* arena);
+
+#endif // ARENA_H
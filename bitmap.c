@@ -0,0 +1,557 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+
+// How two bitmaps are combined
+typedef enum {
+    BITMAP_AND,
+    BITMAP_OR,
+    BITMAP_ANDNOT
+} BitmapOp;
+
+// Initialize an empty bitmap
+void bitmap_init(Bitmap* bitmap) {
+    memset(bitmap, 0, sizeof(Bitmap));
+}
+
+// Position of the first container whose key is not below `key`
+static uint32_t bitmap_find(const Bitmap* bitmap, uint16_t key) {
+    // Values usually arrive in order, so try the last container first
+    if (bitmap->count > 0 && bitmap->containers[bitmap->count - 1].key < key) {
+        return bitmap->count;
+    }
+    uint32_t low = 0;
+    uint32_t high = bitmap->count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (bitmap->containers[middle].key < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Position of the first value of a sorted array not below `value`
+static uint32_t values_lower_bound(const uint16_t* values, uint32_t count, uint16_t value) {
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (values[middle] < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Whether a container holds a low half
+static int container_contains(const BitmapContainer* container, uint16_t low) {
+    if (container->words) {
+        return (int)(container->words[low / 64] >> (low % 64) & 1);
+    }
+    uint32_t position = values_lower_bound(container->values, container->cardinality, low);
+    return position < container->cardinality && container->values[position] == low;
+}
+
+// Free a container's storage
+static void container_free(BitmapContainer* container) {
+    free(container->values);
+    free(container->words);
+    container->values = NULL;
+    container->words = NULL;
+    container->capacity = 0;
+    container->cardinality = 0;
+}
+
+// Fill a container from a bitset of `cardinality` bits, as an array if that is smaller
+static int container_from_words(BitmapContainer* container, const uint64_t* words, uint32_t cardinality) {
+    container->cardinality = cardinality;
+    if (cardinality > BITMAP_ARRAY_MAX) {
+        container->words = (uint64_t*)malloc(sizeof(uint64_t) * BITMAP_WORDS);
+        if (!container->words) {
+            return 0;
+        }
+        memcpy(container->words, words, sizeof(uint64_t) * BITMAP_WORDS);
+        return 1;
+    }
+
+    container->values = (uint16_t*)malloc(sizeof(uint16_t) * (cardinality ? cardinality : 1));
+    if (!container->values) {
+        return 0;
+    }
+    container->capacity = cardinality;
+    uint32_t count = 0;
+    for (int i = 0; i < BITMAP_WORDS; i++) {
+        for (uint64_t word = words[i]; word; word &= word - 1) {
+            container->values[count++] = (uint16_t)(i * 64 + __builtin_ctzll(word));
+        }
+    }
+    return 1;
+}
+
+// Fill a container from a sorted array of `count` low halves, as a bitset if that is smaller
+static int container_from_values(BitmapContainer* container, const uint16_t* values, uint32_t count) {
+    container->cardinality = count;
+    if (count > BITMAP_ARRAY_MAX) {
+        container->words = (uint64_t*)calloc(BITMAP_WORDS, sizeof(uint64_t));
+        if (!container->words) {
+            return 0;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            container->words[values[i] / 64] |= (uint64_t)1 << (values[i] % 64);
+        }
+        return 1;
+    }
+
+    container->values = (uint16_t*)malloc(sizeof(uint16_t) * (count ? count : 1));
+    if (!container->values) {
+        return 0;
+    }
+    memcpy(container->values, values, sizeof(uint16_t) * count);
+    container->capacity = count;
+    return 1;
+}
+
+// Turn a full array container into a bitset
+static int container_to_bitset(BitmapContainer* container) {
+    uint64_t* words = (uint64_t*)calloc(BITMAP_WORDS, sizeof(uint64_t));
+    if (!words) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < container->cardinality; i++) {
+        words[container->values[i] / 64] |= (uint64_t)1 << (container->values[i] % 64);
+    }
+    free(container->values);
+    container->values = NULL;
+    container->capacity = 0;
+    container->words = words;
+    return 1;
+}
+
+// Add a low half to a container
+static int container_add(BitmapContainer* container, uint16_t low) {
+    if (!container->words) {
+        uint32_t position = values_lower_bound(container->values, container->cardinality, low);
+        if (position < container->cardinality && container->values[position] == low) {
+            return 1;
+        }
+        if (container->cardinality < BITMAP_ARRAY_MAX) {
+            if (container->cardinality == container->capacity) {
+                uint32_t capacity = container->capacity ? container->capacity * 2 : 4;
+                uint16_t* values = (uint16_t*)realloc(container->values, sizeof(uint16_t) * capacity);
+                if (!values) {
+                    return 0;
+                }
+                container->values = values;
+                container->capacity = capacity;
+            }
+            memmove(container->values + position + 1, container->values + position,
+                    sizeof(uint16_t) * (container->cardinality - position));
+            container->values[position] = low;
+            container->cardinality++;
+            return 1;
+        }
+        if (!container_to_bitset(container)) {
+            return 0;
+        }
+    }
+
+    uint64_t bit = (uint64_t)1 << (low % 64);
+    if (!(container->words[low / 64] & bit)) {
+        container->words[low / 64] |= bit;
+        container->cardinality++;
+    }
+    return 1;
+}
+
+// Add a value. Returns 0 if memory runs out (the bitmap is then unchanged).
+int bitmap_add(Bitmap* bitmap, uint32_t value) {
+    uint16_t key = (uint16_t)(value >> 16);
+    uint32_t position = bitmap_find(bitmap, key);
+    if (position == bitmap->count || bitmap->containers[position].key != key) {
+        if (bitmap->count == bitmap->capacity) {
+            uint32_t capacity = bitmap->capacity ? bitmap->capacity * 2 : 4;
+            BitmapContainer* containers = (BitmapContainer*)realloc(bitmap->containers,
+                                                                    sizeof(BitmapContainer) * capacity);
+            if (!containers) {
+                fprintf(stderr, "Memory allocation failed while growing a bitmap\n");
+                return 0;
+            }
+            bitmap->containers = containers;
+            bitmap->capacity = capacity;
+        }
+        memmove(bitmap->containers + position + 1, bitmap->containers + position,
+                sizeof(BitmapContainer) * (bitmap->count - position));
+        memset(&bitmap->containers[position], 0, sizeof(BitmapContainer));
+        bitmap->containers[position].key = key;
+        bitmap->count++;
+    }
+
+    if (!container_add(&bitmap->containers[position], (uint16_t)value)) {
+        fprintf(stderr, "Memory allocation failed while growing a bitmap\n");
+        return 0;
+    }
+    return 1;
+}
+
+// Remove a value, if present. A bitset container only turns back into an
+// array once it is half the array limit, so values added and removed around
+// the limit do not convert it every time.
+void bitmap_remove(Bitmap* bitmap, uint32_t value) {
+    uint16_t key = (uint16_t)(value >> 16);
+    uint16_t low = (uint16_t)value;
+    uint32_t position = bitmap_find(bitmap, key);
+    if (position == bitmap->count || bitmap->containers[position].key != key) {
+        return;
+    }
+
+    BitmapContainer* container = &bitmap->containers[position];
+    if (container->words) {
+        uint64_t bit = (uint64_t)1 << (low % 64);
+        if (!(container->words[low / 64] & bit)) {
+            return;
+        }
+        container->words[low / 64] &= ~bit;
+        container->cardinality--;
+        if (container->cardinality <= BITMAP_ARRAY_MAX / 2) {
+            BitmapContainer array;
+            memset(&array, 0, sizeof(BitmapContainer));
+            array.key = key;
+            if (container_from_words(&array, container->words, container->cardinality)) {
+                container_free(container);
+                *container = array;
+            }
+        }
+    } else {
+        uint32_t index = values_lower_bound(container->values, container->cardinality, low);
+        if (index == container->cardinality || container->values[index] != low) {
+            return;
+        }
+        memmove(container->values + index, container->values + index + 1,
+                sizeof(uint16_t) * (container->cardinality - index - 1));
+        container->cardinality--;
+    }
+
+    if (container->cardinality == 0) {
+        container_free(container);
+        memmove(bitmap->containers + position, bitmap->containers + position + 1,
+                sizeof(BitmapContainer) * (bitmap->count - position - 1));
+        bitmap->count--;
+    }
+}
+
+// Whether a value is in the bitmap
+int bitmap_contains(const Bitmap* bitmap, uint32_t value) {
+    uint16_t key = (uint16_t)(value >> 16);
+    uint32_t position = bitmap_find(bitmap, key);
+    return position < bitmap->count && bitmap->containers[position].key == key &&
+           container_contains(&bitmap->containers[position], (uint16_t)value);
+}
+
+// Number of values, from the counts kept per container
+uint32_t bitmap_cardinality(const Bitmap* bitmap) {
+    uint32_t cardinality = 0;
+    for (uint32_t i = 0; i < bitmap->count; i++) {
+        cardinality += bitmap->containers[i].cardinality;
+    }
+    return cardinality;
+}
+
+// Number of values below `value`
+uint32_t bitmap_rank(const Bitmap* bitmap, uint32_t value) {
+    uint16_t key = (uint16_t)(value >> 16);
+    uint16_t low = (uint16_t)value;
+    uint32_t rank = 0;
+    uint32_t i = 0;
+    for (; i < bitmap->count && bitmap->containers[i].key < key; i++) {
+        rank += bitmap->containers[i].cardinality;
+    }
+    if (i == bitmap->count || bitmap->containers[i].key != key) {
+        return rank;
+    }
+
+    const BitmapContainer* container = &bitmap->containers[i];
+    if (!container->words) {
+        return rank + values_lower_bound(container->values, container->cardinality, low);
+    }
+    for (int w = 0; w < low / 64; w++) {
+        rank += (uint32_t)__builtin_popcountll(container->words[w]);
+    }
+    uint64_t below = ((uint64_t)1 << (low % 64)) - 1;
+    return rank + (uint32_t)__builtin_popcountll(container->words[low / 64] & below);
+}
+
+// Find the smallest value not below `from`. Returns 0 if there is none.
+int bitmap_next(const Bitmap* bitmap, uint32_t from, uint32_t* value) {
+    uint16_t key = (uint16_t)(from >> 16);
+    uint32_t low = from & 0xFFFF;
+    for (uint32_t i = bitmap_find(bitmap, key); i < bitmap->count; i++, low = 0) {
+        const BitmapContainer* container = &bitmap->containers[i];
+        if (container->key != key) {
+            low = 0;
+        }
+        uint32_t base = (uint32_t)container->key << 16;
+        if (!container->words) {
+            uint32_t position = values_lower_bound(container->values, container->cardinality, (uint16_t)low);
+            if (position < container->cardinality) {
+                *value = base | container->values[position];
+                return 1;
+            }
+            continue;
+        }
+
+        uint32_t w = low / 64;
+        uint64_t word = container->words[w] & (~(uint64_t)0 << (low % 64));
+        while (!word && ++w < BITMAP_WORDS) {
+            word = container->words[w];
+        }
+        if (word) {
+            *value = base | (w * 64 + (uint32_t)__builtin_ctzll(word));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// OR the bitmap into a flat bitset of `word_count` words, bit n standing for
+// value n; values past its end are left out
+void bitmap_to_words(const Bitmap* bitmap, uint64_t* words, uint32_t word_count) {
+    for (uint32_t i = 0; i < bitmap->count; i++) {
+        const BitmapContainer* container = &bitmap->containers[i];
+        uint32_t base = (uint32_t)container->key * BITMAP_WORDS;
+        if (base >= word_count) {
+            break;
+        }
+        if (container->words) {
+            uint32_t count = word_count - base < BITMAP_WORDS ? word_count - base : BITMAP_WORDS;
+            for (uint32_t w = 0; w < count; w++) {
+                words[base + w] |= container->words[w];
+            }
+        } else {
+            for (uint32_t v = 0; v < container->cardinality; v++) {
+                uint32_t w = base + container->values[v] / 64;
+                if (w < word_count) {
+                    words[w] |= (uint64_t)1 << (container->values[v] % 64);
+                }
+            }
+        }
+    }
+}
+
+// Append a container (taking over its storage) to a bitmap being built in key order
+static int bitmap_push(Bitmap* bitmap, const BitmapContainer* container) {
+    if (bitmap->count == bitmap->capacity) {
+        uint32_t capacity = bitmap->capacity ? bitmap->capacity * 2 : 4;
+        BitmapContainer* containers = (BitmapContainer*)realloc(bitmap->containers,
+                                                                sizeof(BitmapContainer) * capacity);
+        if (!containers) {
+            return 0;
+        }
+        bitmap->containers = containers;
+        bitmap->capacity = capacity;
+    }
+    bitmap->containers[bitmap->count++] = *container;
+    return 1;
+}
+
+// Copy a container into fresh storage
+static int container_copy(const BitmapContainer* source, BitmapContainer* copy) {
+    memset(copy, 0, sizeof(BitmapContainer));
+    copy->key = source->key;
+    if (source->words) {
+        return container_from_words(copy, source->words, source->cardinality);
+    }
+    return container_from_values(copy, source->values, source->cardinality);
+}
+
+// Combine two containers with the same key. Two arrays are merged; an array
+// against a bitset that can only shrink it is filtered bit by bit; anything
+// else runs word at a time over a 65536-bit scratch bitset, with the result
+// counted by popcount.
+static int container_combine(const BitmapContainer* a, const BitmapContainer* b, BitmapOp op,
+                             BitmapContainer* result) {
+    memset(result, 0, sizeof(BitmapContainer));
+    result->key = a->key;
+
+    if (!a->words && !b->words) {
+        uint16_t merged[2 * BITMAP_ARRAY_MAX];
+        uint32_t count = 0;
+        uint32_t i = 0;
+        uint32_t j = 0;
+        while (i < a->cardinality && j < b->cardinality) {
+            uint16_t x = a->values[i];
+            uint16_t y = b->values[j];
+            if (x < y) {
+                if (op != BITMAP_AND) {
+                    merged[count++] = x;
+                }
+                i++;
+            } else if (y < x) {
+                if (op == BITMAP_OR) {
+                    merged[count++] = y;
+                }
+                j++;
+            } else {
+                if (op != BITMAP_ANDNOT) {
+                    merged[count++] = x;
+                }
+                i++;
+                j++;
+            }
+        }
+        if (op != BITMAP_AND) {
+            for (; i < a->cardinality; i++) {
+                merged[count++] = a->values[i];
+            }
+        }
+        if (op == BITMAP_OR) {
+            for (; j < b->cardinality; j++) {
+                merged[count++] = b->values[j];
+            }
+        }
+        return count == 0 || container_from_values(result, merged, count);
+    }
+
+    const BitmapContainer* array = !a->words ? a : (op == BITMAP_AND && !b->words ? b : NULL);
+    if (array && op != BITMAP_OR) {
+        const BitmapContainer* other = array == a ? b : a;
+        int keep = op == BITMAP_AND;
+        uint16_t kept[BITMAP_ARRAY_MAX];
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < array->cardinality; i++) {
+            uint16_t low = array->values[i];
+            kept[count] = low;
+            count += (uint32_t)((int)(other->words[low / 64] >> (low % 64) & 1) == keep);
+        }
+        return count == 0 || container_from_values(result, kept, count);
+    }
+
+    uint64_t words[BITMAP_WORDS];
+    if (a->words) {
+        memcpy(words, a->words, sizeof(words));
+    } else {
+        memset(words, 0, sizeof(words));
+        for (uint32_t i = 0; i < a->cardinality; i++) {
+            words[a->values[i] / 64] |= (uint64_t)1 << (a->values[i] % 64);
+        }
+    }
+
+    if (b->words) {
+        for (int i = 0; i < BITMAP_WORDS; i++) {
+            if (op == BITMAP_AND) {
+                words[i] &= b->words[i];
+            } else if (op == BITMAP_OR) {
+                words[i] |= b->words[i];
+            } else {
+                words[i] &= ~b->words[i];
+            }
+        }
+    } else if (op == BITMAP_OR) {
+        for (uint32_t i = 0; i < b->cardinality; i++) {
+            words[b->values[i] / 64] |= (uint64_t)1 << (b->values[i] % 64);
+        }
+    } else {
+        for (uint32_t i = 0; i < b->cardinality; i++) {
+            words[b->values[i] / 64] &= ~((uint64_t)1 << (b->values[i] % 64));
+        }
+    }
+
+    uint32_t cardinality = 0;
+    for (int i = 0; i < BITMAP_WORDS; i++) {
+        cardinality += (uint32_t)__builtin_popcountll(words[i]);
+    }
+    return cardinality == 0 || container_from_words(result, words, cardinality);
+}
+
+// Combine two bitmaps into `result`, which must be neither of them. Only
+// containers present in both (or, for OR and ANDNOT, in one) are visited.
+static int bitmap_combine(const Bitmap* a, const Bitmap* b, BitmapOp op, Bitmap* result) {
+    bitmap_clear(result);
+    uint32_t i = 0;
+    uint32_t j = 0;
+    int ok = 1;
+    while (ok && (i < a->count || j < b->count)) {
+        const BitmapContainer* x = i < a->count ? &a->containers[i] : NULL;
+        const BitmapContainer* y = j < b->count ? &b->containers[j] : NULL;
+        BitmapContainer container;
+        container.cardinality = 0;
+        if (x && (!y || x->key < y->key)) {
+            if (op != BITMAP_AND) {
+                ok = container_copy(x, &container);
+            }
+            i++;
+        } else if (!x || y->key < x->key) {
+            if (op == BITMAP_OR) {
+                ok = container_copy(y, &container);
+            }
+            j++;
+        } else {
+            ok = container_combine(x, y, op, &container);
+            i++;
+            j++;
+        }
+
+        if (ok && container.cardinality > 0 && !bitmap_push(result, &container)) {
+            container_free(&container);
+            ok = 0;
+        }
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Memory allocation failed while combining bitmaps\n");
+        bitmap_clear(result);
+    }
+    return ok;
+}
+
+// Make `result` a copy of `source`
+int bitmap_copy(const Bitmap* source, Bitmap* result) {
+    Bitmap empty;
+    bitmap_init(&empty);
+    return bitmap_combine(source, &empty, BITMAP_OR, result);
+}
+
+// Values in both a and b
+int bitmap_and(const Bitmap* a, const Bitmap* b, Bitmap* result) {
+    return bitmap_combine(a, b, BITMAP_AND, result);
+}
+
+// Values in a or b
+int bitmap_or(const Bitmap* a, const Bitmap* b, Bitmap* result) {
+    return bitmap_combine(a, b, BITMAP_OR, result);
+}
+
+// Values in a but not b (NOT b, taken within a)
+int bitmap_andnot(const Bitmap* a, const Bitmap* b, Bitmap* result) {
+    return bitmap_combine(a, b, BITMAP_ANDNOT, result);
+}
+
+// Remove every value, keeping the container table
+void bitmap_clear(Bitmap* bitmap) {
+    for (uint32_t i = 0; i < bitmap->count; i++) {
+        container_free(&bitmap->containers[i]);
+    }
+    bitmap->count = 0;
+}
+
+// Bytes allocated for the containers
+size_t bitmap_memory(const Bitmap* bitmap) {
+    size_t bytes = sizeof(BitmapContainer) * (size_t)bitmap->capacity;
+    for (uint32_t i = 0; i < bitmap->count; i++) {
+        const BitmapContainer* container = &bitmap->containers[i];
+        bytes += container->words ? sizeof(uint64_t) * BITMAP_WORDS : sizeof(uint16_t) * container->capacity;
+    }
+    return bytes;
+}
+
+// Free the bitmap
+void bitmap_free(Bitmap* bitmap) {
+    bitmap_clear(bitmap);
+    free(bitmap->containers);
+    bitmap_init(bitmap);
+}
@@ -0,0 +1,45 @@
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BITMAP_ARRAY_MAX 4096   // Values an array container holds before it becomes a bitset
+#define BITMAP_WORDS 1024       // 64-bit words in a bitset container (65536 bits)
+
+// The values of a bitmap sharing their high 16 bits. A sparse container keeps
+// the low halves as a sorted array; a dense one as a 65536-bit bitset.
+typedef struct {
+    uint16_t key;           // High 16 bits of every value in the container
+    uint32_t cardinality;   // Values held
+    uint32_t capacity;      // Room in values (array containers)
+    uint16_t* values;       // Sorted low halves, when words is NULL
+    uint64_t* words;        // BITMAP_WORDS words, or NULL for an array container
+} BitmapContainer;
+
+// Compressed set of 32-bit values (roaring-style): containers sorted by key,
+// each choosing the smaller of the two layouts
+typedef struct {
+    BitmapContainer* containers;
+    uint32_t count;
+    uint32_t capacity;
+} Bitmap;
+
+// Function declarations
+void bitmap_init(Bitmap* bitmap);
+int bitmap_add(Bitmap* bitmap, uint32_t value);
+void bitmap_remove(Bitmap* bitmap, uint32_t value);
+int bitmap_contains(const Bitmap* bitmap, uint32_t value);
+uint32_t bitmap_cardinality(const Bitmap* bitmap);
+uint32_t bitmap_rank(const Bitmap* bitmap, uint32_t value);
+int bitmap_next(const Bitmap* bitmap, uint32_t from, uint32_t* value);
+void bitmap_to_words(const Bitmap* bitmap, uint64_t* words, uint32_t word_count);
+int bitmap_copy(const Bitmap* source, Bitmap* result);
+int bitmap_and(const Bitmap* a, const Bitmap* b, Bitmap* result);
+int bitmap_or(const Bitmap* a, const Bitmap* b, Bitmap* result);
+int bitmap_andnot(const Bitmap* a, const Bitmap* b, Bitmap* result);
+void bitmap_clear(Bitmap* bitmap);
+size_t bitmap_memory(const Bitmap* bitmap);
+void bitmap_free(Bitmap* bitmap);
+
+#endif // BITMAP_H
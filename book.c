@@ -1,4 +1,7 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include "book.h"
 
 // Enum to string functions
@@ -22,16 +25,81 @@ const char* get_condition_string(Condition condition) {
     }
 }
 
+// Whether a name typed by the user is a label, ignoring case and hyphens
+static int name_matches(const char* name, const char* label) {
+    for (;;) {
+        while (*name == '-') {
+            name++;
+        }
+        while (*label == '-') {
+            label++;
+        }
+        if (tolower((unsigned char)*name) != tolower((unsigned char)*label)) {
+            return 0;
+        }
+        if (*name == '\0') {
+            return 1;
+        }
+        name++;
+        label++;
+    }
+}
+
+// String to enum functions. Return -1 for a name that is not a value.
+
+int parse_cover_type(const char* name) {
+    for (int i = 0; i < COVER_TYPE_COUNT; i++) {
+        if (name_matches(name, get_cover_type_string((CoverType)i))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int parse_condition(const char* name) {
+    for (int i = 0; i < CONDITION_COUNT; i++) {
+        if (name_matches(name, get_condition_string((Condition)i))) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Pull a plausible publication year out of a free-form date string
+// such as "March 1999" or "1999-03-01". Returns 0 if none is found.
+int extract_year(const char* date_str) {
+    size_t date_len = strlen(date_str);
+    
+    // Look for the first 4 digit run that makes sense as a year (1400-2100)
+    for (int i = 0; i <= (int)date_len - 4; i++) {
+        if (isdigit((unsigned char)date_str[i]) && isdigit((unsigned char)date_str[i+1]) && 
+            isdigit((unsigned char)date_str[i+2]) && isdigit((unsigned char)date_str[i+3])) {
+            char year_str[5] = {0};
+            strncpy(year_str, date_str + i, 4);
+            int year = atoi(year_str);
+            if (year >= 1400 && year <= 2100) {
+                return year;
+            }
+        }
+    }
+    return 0;
+}
+
 // Print book details
-void print_book(const Book* book) {
+void print_book(const Book* book, const BookStrings* strings) {
+    const char* title = strings->title;
+    const char* author = strings->author;
+    const char* isbn = strings->isbn;
+    const char* genre = strings->genre;
+    
     // For title and author, show "<empty>" if the field is empty
     printf("%s by %s\n", 
-           book->title[0] != '\0' ? book->title : "<empty>", 
-           book->author[0] != '\0' ? book->author : "<empty>");
+           title[0] != '\0' ? title : "<empty>", 
+           author[0] != '\0' ? author : "<empty>");
     
     // For ISBN, only show if not empty
-    if (book->isbn[0] != '\0') {
-        printf("  ISBN: %s\n", book->isbn);
+    if (isbn[0] != '\0') {
+        printf("  ISBN: %s\n", isbn);
         if (book->metadata_retrieved) {
             printf("  Metadata: Already retrieved\n");
         }
@@ -40,7 +108,7 @@ void print_book(const Book* book) {
     }
     
     // For genre, show "<empty>" if the field is empty
-    printf("  Genre: %s\n", book->genre[0] != '\0' ? book->genre : "<empty>");
+    printf("  Genre: %s\n", genre[0] != '\0' ? genre : "<empty>");
     printf("  Cover: %s\n", get_cover_type_string(book->cover_type));
     printf("  Condition: %s\n", get_condition_string(book->condition));
     
@@ -56,4 +124,49 @@ void print_book(const Book* book) {
     } else {
         printf("  Published: <empty>\n");
     }
-}
\ No newline at end of file
+}
+
+// Initialize an empty record
+void book_record_init(BookRecord* record) {
+    memset(record, 0, sizeof(BookRecord));
+}
+
+// Replace one of a record's strings with a copy of `length` bytes of value
+void book_record_set(char** field, const char* value, size_t length) {
+    char* copy = (char*)malloc(length + 1);
+    if (!copy) {
+        fprintf(stderr, "Memory allocation failed while copying book field\n");
+        return;
+    }
+    memcpy(copy, value, length);
+    copy[length] = '\0';
+    free(*field);
+    *field = copy;
+}
+
+// Make dest an independent copy of src. dest must be initialized.
+void book_record_copy(BookRecord* dest, const BookRecord* src) {
+    book_record_free(dest);
+    *dest = *src;
+    dest->title = NULL;
+    dest->author = NULL;
+    dest->isbn = NULL;
+    dest->genre = NULL;
+    
+    const char* values[4] = {src->title, src->author, src->isbn, src->genre};
+    char** fields[4] = {&dest->title, &dest->author, &dest->isbn, &dest->genre};
+    for (int i = 0; i < 4; i++) {
+        if (values[i]) {
+            book_record_set(fields[i], values[i], strlen(values[i]));
+        }
+    }
+}
+
+// Free a record's strings and reset it
+void book_record_free(BookRecord* record) {
+    free(record->title);
+    free(record->author);
+    free(record->isbn);
+    free(record->genre);
+    book_record_init(record);
+}
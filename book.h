@@ -1,12 +1,17 @@
 #ifndef BOOK_H
 #define BOOK_H
 
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
 // Enums for book attributes
 typedef enum {
     HARDCOVER,
     SOFTCOVER,
     EBOOK
 } CoverType;
+#define COVER_TYPE_COUNT 3
 
 typedef enum {
     FICTION,
@@ -24,13 +29,16 @@ typedef enum {
     FAIR,
     POOR
 } Condition;
+#define CONDITION_COUNT 4
 
-// Book structure
+// Book structure. The strings live in the owning Library's string arena, with
+// authors and genres interned; read them with the book_title()/book_author()/...
+// accessors in library.h.
 typedef struct {
-    char title[100];
-    char author[100];
-    char isbn[20];      // Standard ISBN is 13 digits, plus hyphens
-    char genre[50];     // Genre as a string instead of enum
+    StrRef title;
+    StrRef isbn;        // Standard ISBN is 13 digits, plus hyphens
+    uint32_t author_id; // ID in the library's author dictionary
+    uint32_t genre_id;  // ID in the library's genre dictionary
     CoverType cover_type;
     Condition condition;
     int word_count;
@@ -38,9 +46,38 @@ typedef struct {
     int metadata_retrieved;  // Boolean flag to track if metadata was already fetched
 } Book;
 
+// A book outside any library: API and dump results, cache entries, journal
+// records and user input. The record owns its strings (NULL = empty).
+typedef struct {
+    char* title;
+    char* author;
+    char* isbn;
+    char* genre;
+    CoverType cover_type;
+    Condition condition;
+    int word_count;
+    int year_published;
+    int metadata_retrieved;
+} BookRecord;
+
+// The strings of a library book, looked up for printing and encoding
+typedef struct {
+    const char* title;
+    const char* author;
+    const char* isbn;
+    const char* genre;
+} BookStrings;
+
 // Function declarations
-void print_book(const Book* book);
+void print_book(const Book* book, const BookStrings* strings);
+void book_record_init(BookRecord* record);
+void book_record_set(char** field, const char* value, size_t length);
+void book_record_copy(BookRecord* dest, const BookRecord* src);
+void book_record_free(BookRecord* record);
 const char* get_cover_type_string(CoverType cover_type);
 const char* get_condition_string(Condition condition);
+int parse_cover_type(const char* name);
+int parse_condition(const char* name);
+int extract_year(const char* date_str);
 
 #endif // BOOK_H
\ No newline at end of file
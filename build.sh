@@ -22,21 +22,78 @@ else
 fi
 
 # Compile all source files separately
+echo "Compiling arena.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c arena.c -o build/arena.o
+
+echo "Compiling bitmap.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c bitmap.c -o build/bitmap.o
+
 echo "Compiling book.c..."
 clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c book.c -o build/book.o
 
 echo "Compiling cJSON.c..."
 clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c cJSON.c -o build/cJSON.o
 
+echo "Compiling cache.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c cache.c -o build/cache.o
+
+echo "Compiling columns.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c columns.c -o build/columns.o
+
+echo "Compiling crc32.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c crc32.c -o build/crc32.o
+
+echo "Compiling csv.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c csv.c -o build/csv.o
+
+echo "Compiling dump.c..."
+clang -g -Wall -Wextra -std=c99 -pthread $CURL_CFLAGS -c dump.c -o build/dump.o
+
+echo "Compiling fetch.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c fetch.c -o build/fetch.o
+
+echo "Compiling fuzzy.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c fuzzy.c -o build/fuzzy.o
+
+echo "Compiling intern.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c intern.c -o build/intern.o
+
+echo "Compiling isbn.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c isbn.c -o build/isbn.o
+
+echo "Compiling journal.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c journal.c -o build/journal.o
+
 echo "Compiling library.c..."
-clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c library.c -o build/library.o
+clang -g -Wall -Wextra -std=c99 -pthread $CURL_CFLAGS -c library.c -o build/library.o
+
+echo "Compiling query.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c query.c -o build/query.o
+
+echo "Compiling range_index.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c range_index.c -o build/range_index.o
+
+echo "Compiling snapshot.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c snapshot.c -o build/snapshot.o
+
+echo "Compiling stats.c..."
+clang -g -Wall -Wextra -std=c99 -pthread $CURL_CFLAGS -c stats.c -o build/stats.o
+
+echo "Compiling text_index.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c text_index.c -o build/text_index.o
+
+echo "Compiling title_index.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c title_index.c -o build/title_index.o
+
+echo "Compiling totals.c..."
+clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c totals.c -o build/totals.o
 
 echo "Compiling main.c..."
 clang -g -Wall -Wextra -std=c99 $CURL_CFLAGS -c main.c -o build/main.o
 
 # Link all object files together
 echo "Linking with libcurl..."
-clang build/book.o build/cJSON.o build/library.o build/main.o -o bookshelf $CURL_LIBS
+clang build/arena.o build/bitmap.o build/book.o build/cJSON.o build/cache.o build/columns.o build/crc32.o build/csv.o build/dump.o build/fetch.o build/fuzzy.o build/intern.o build/isbn.o build/journal.o build/library.o build/query.o build/range_index.o build/snapshot.o build/stats.o build/text_index.o build/title_index.o build/totals.o build/main.o -o bookshelf $CURL_LIBS -lm -pthread
 
 # Make the output executable
 chmod +x bookshelf
@@ -0,0 +1,303 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "cache.h"
+
+#define CACHE_INITIAL_SLOTS 64
+
+// Reduce an ISBN to its significant characters so "0-7432-7356-7" and "0743273567" share an entry
+void cache_normalize_isbn(const char* isbn, char* out, size_t out_size) {
+    size_t pos = 0;
+    for (const char* p = isbn; *p && pos < out_size - 1; p++) {
+        if (isdigit((unsigned char)*p)) {
+            out[pos++] = *p;
+        } else if (*p == 'x' || *p == 'X') {
+            out[pos++] = 'X';
+        }
+    }
+    out[pos] = '\0';
+}
+
+// FNV-1a hash of a normalized ISBN
+static unsigned int cache_hash(const char* key) {
+    unsigned int hash = 2166136261u;
+    for (const char* p = key; *p; p++) {
+        hash ^= (unsigned char)*p;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Initialize an empty cache
+void cache_init(MetadataCache* cache, long ttl) {
+    memset(cache, 0, sizeof(MetadataCache));
+    cache->ttl = ttl;
+}
+
+// Find the hash slot holding `key`, or the empty slot where it would go
+static int cache_find_slot(const MetadataCache* cache, const char* key) {
+    unsigned int mask = (unsigned int)cache->slot_count - 1;
+    unsigned int slot = cache_hash(key) & mask;
+
+    while (cache->slots[slot] != -1 && strcmp(cache->entries[cache->slots[slot]].isbn, key) != 0) {
+        slot = (slot + 1) & mask;
+    }
+    return (int)slot;
+}
+
+// Rebuild the hash table with room for at least twice the current entries
+static int cache_grow_slots(MetadataCache* cache) {
+    int new_slot_count = cache->slot_count ? cache->slot_count * 2 : CACHE_INITIAL_SLOTS;
+    int* new_slots = (int*)malloc(sizeof(int) * new_slot_count);
+    if (!new_slots) {
+        fprintf(stderr, "Memory allocation failed while growing metadata cache\n");
+        return 0;
+    }
+
+    free(cache->slots);
+    cache->slots = new_slots;
+    cache->slot_count = new_slot_count;
+    for (int i = 0; i < new_slot_count; i++) {
+        cache->slots[i] = -1;
+    }
+    for (int i = 0; i < cache->count; i++) {
+        cache->slots[cache_find_slot(cache, cache->entries[i].isbn)] = i;
+    }
+    return 1;
+}
+
+// Return the entry for a normalized key, creating an empty one if needed
+static CacheEntry* cache_get_or_create(MetadataCache* cache, const char* key) {
+    // Keep the table at most 70% full
+    if ((cache->count + 1) * 10 > cache->slot_count * 7 && !cache_grow_slots(cache)) {
+        return NULL;
+    }
+
+    int slot = cache_find_slot(cache, key);
+    if (cache->slots[slot] != -1) {
+        return &cache->entries[cache->slots[slot]];
+    }
+
+    if (cache->count >= cache->capacity) {
+        int new_capacity = cache->capacity ? cache->capacity * 2 : CACHE_INITIAL_SLOTS;
+        CacheEntry* new_entries = (CacheEntry*)realloc(cache->entries, sizeof(CacheEntry) * new_capacity);
+        if (!new_entries) {
+            fprintf(stderr, "Memory allocation failed while growing metadata cache\n");
+            return NULL;
+        }
+        cache->entries = new_entries;
+        cache->capacity = new_capacity;
+    }
+
+    CacheEntry* entry = &cache->entries[cache->count];
+    memset(entry, 0, sizeof(CacheEntry));
+    strncpy(entry->isbn, key, sizeof(entry->isbn) - 1);
+    entry->state = CACHE_PENDING;
+    cache->slots[slot] = cache->count++;
+    return entry;
+}
+
+// Copy one tab-separated field into a fixed buffer, advancing *cursor past it
+static void cache_read_field(char** cursor, char* out, size_t out_size) {
+    char* start = *cursor;
+    char* end = strchr(start, '\t');
+    size_t len = end ? (size_t)(end - start) : strlen(start);
+
+    if (out) {
+        size_t copy = len < out_size - 1 ? len : out_size - 1;
+        memcpy(out, start, copy);
+        out[copy] = '\0';
+    }
+    *cursor = end ? end + 1 : start + len;
+}
+
+// Copy one tab-separated field into a record string, advancing *cursor past it
+static void cache_read_string(char** cursor, char** out) {
+    char* start = *cursor;
+    char* end = strchr(start, '\t');
+    size_t len = end ? (size_t)(end - start) : strlen(start);
+
+    if (len > 0) {
+        book_record_set(out, start, len);
+    }
+    *cursor = end ? end + 1 : start + len;
+}
+
+// Load cached entries from a tab-separated file. A missing file is an empty cache.
+int cache_load(MetadataCache* cache, const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        return 0;
+    }
+
+    char* line = NULL;
+    size_t line_size = 0;
+    char field[32];
+    while (getline(&line, &line_size, file) != -1) {
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '\0') {
+            continue;
+        }
+
+        char* cursor = line;
+        char key[20];
+        cache_read_field(&cursor, key, sizeof(key));
+
+        CacheEntry* entry = cache_get_or_create(cache, key);
+        if (!entry) {
+            break;
+        }
+
+        cache_read_field(&cursor, field, sizeof(field));
+        entry->fetched_at = (time_t)atol(field);
+        cache_read_field(&cursor, field, sizeof(field));
+        entry->state = atoi(field) == CACHE_FOUND ? CACHE_FOUND : CACHE_NOT_FOUND;
+
+        BookRecord* metadata = &entry->metadata;
+        book_record_free(metadata);
+        cache_read_string(&cursor, &metadata->title);
+        cache_read_string(&cursor, &metadata->author);
+        cache_read_string(&cursor, &metadata->genre);
+        cache_read_field(&cursor, field, sizeof(field));
+        metadata->word_count = atoi(field);
+        cache_read_field(&cursor, field, sizeof(field));
+        metadata->year_published = atoi(field);
+    }
+
+    free(line);
+    fclose(file);
+    cache->dirty = 0;
+    return 1;
+}
+
+// Write a string (NULL = empty) with tabs and newlines flattened to spaces
+static void cache_write_field(FILE* file, const char* value) {
+    for (const char* p = value ? value : ""; *p; p++) {
+        fputc(*p == '\t' || *p == '\n' || *p == '\r' ? ' ' : *p, file);
+    }
+    fputc('\t', file);
+}
+
+// Write all answered entries back to disk via a temporary file
+int cache_save(MetadataCache* cache, const char* filename) {
+    if (!cache->dirty) {
+        return 1;
+    }
+
+    char temp_name[512];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+
+    FILE* file = fopen(temp_name, "w");
+    if (!file) {
+        perror("Error opening cache file for writing");
+        return 0;
+    }
+
+    for (int i = 0; i < cache->count; i++) {
+        const CacheEntry* entry = &cache->entries[i];
+        if (entry->state == CACHE_PENDING) {
+            continue;
+        }
+
+        fprintf(file, "%s\t%ld\t%d\t", entry->isbn, (long)entry->fetched_at, (int)entry->state);
+        cache_write_field(file, entry->metadata.title);
+        cache_write_field(file, entry->metadata.author);
+        cache_write_field(file, entry->metadata.genre);
+        fprintf(file, "%d\t%d\n", entry->metadata.word_count, entry->metadata.year_published);
+    }
+
+    if (fclose(file) != 0 || rename(temp_name, filename) != 0) {
+        perror("Error writing cache file");
+        remove(temp_name);
+        return 0;
+    }
+
+    cache->dirty = 0;
+    return 1;
+}
+
+// Look up an ISBN. Fresh answers count as hits; entries in flight (already requested
+// in this run) are returned without counting; missing or stale entries count as misses.
+const CacheEntry* cache_lookup(MetadataCache* cache, const char* isbn) {
+    char key[20];
+    cache_normalize_isbn(isbn, key, sizeof(key));
+
+    if (cache->slot_count > 0) {
+        int slot = cache_find_slot(cache, key);
+        if (cache->slots[slot] != -1) {
+            const CacheEntry* entry = &cache->entries[cache->slots[slot]];
+            if (entry->in_flight) {
+                return entry;
+            }
+            if (entry->state != CACHE_PENDING) {
+                if (entry->fetched_this_run || time(NULL) - entry->fetched_at <= cache->ttl) {
+                    cache->hits++;
+                    return entry;
+                }
+                cache->expired++;
+            }
+        }
+    }
+
+    cache->misses++;
+    return NULL;
+}
+
+// Record that a request for this ISBN is in flight so duplicates can wait for it.
+// Any earlier answer stays (and is saved) until cache_store replaces it.
+int cache_mark_pending(MetadataCache* cache, const char* isbn) {
+    char key[20];
+    cache_normalize_isbn(isbn, key, sizeof(key));
+
+    CacheEntry* entry = cache_get_or_create(cache, key);
+    if (!entry) {
+        return 0;
+    }
+    entry->in_flight = 1;
+    return 1;
+}
+
+// Store an API answer. Pass NULL metadata when the API had no data for the ISBN.
+void cache_store(MetadataCache* cache, const char* isbn, const BookRecord* metadata) {
+    char key[20];
+    cache_normalize_isbn(isbn, key, sizeof(key));
+
+    CacheEntry* entry = cache_get_or_create(cache, key);
+    if (!entry) {
+        return;
+    }
+
+    book_record_free(&entry->metadata);
+    if (metadata) {
+        book_record_copy(&entry->metadata, metadata);
+        entry->state = CACHE_FOUND;
+    } else {
+        entry->state = CACHE_NOT_FOUND;
+    }
+    entry->fetched_at = time(NULL);
+    entry->fetched_this_run = 1;
+    entry->in_flight = 0;
+    cache->dirty = 1;
+}
+
+// Print hit/miss counters for this run
+void cache_print_stats(const MetadataCache* cache) {
+    int lookups = cache->hits + cache->misses;
+    printf("Cache: %d hits, %d misses (%d expired), %.0f%% hit rate, %d entries\n",
+           cache->hits, cache->misses, cache->expired,
+           lookups > 0 ? 100.0 * cache->hits / lookups : 0.0, cache->count);
+}
+
+// Free all cache memory
+void cache_free(MetadataCache* cache) {
+    for (int i = 0; i < cache->count; i++) {
+        book_record_free(&cache->entries[i].metadata);
+    }
+    free(cache->entries);
+    free(cache->slots);
+    memset(cache, 0, sizeof(MetadataCache));
+}
@@ -0,0 +1,53 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <time.h>
+#include "book.h"
+
+#define DEFAULT_CACHE_FILE "bookshelf_cache.tsv"
+#define DEFAULT_CACHE_TTL (30L * 24 * 60 * 60)  // 30 days, in seconds
+
+// State of a cached ISBN
+typedef enum {
+    CACHE_PENDING,     // No answer yet (never saved)
+    CACHE_FOUND,       // API returned metadata for this ISBN
+    CACHE_NOT_FOUND    // API answered but had no data for this ISBN
+} CacheState;
+
+// One cached API answer, keyed by normalized ISBN
+typedef struct {
+    char isbn[20];        // Normalized ISBN (digits and X only)
+    time_t fetched_at;    // When the answer was fetched
+    CacheState state;
+    int fetched_this_run; // Answered during this run, so fresh regardless of TTL (never saved)
+    int in_flight;        // Requested during this run and not answered yet (never saved); an
+                          // expired entry keeps its old answer until the new one arrives
+    BookRecord metadata;  // Parsed fields, as parse_book_json fills them
+} CacheEntry;
+
+// In-memory view of the on-disk cache with an open-addressing index
+typedef struct {
+    CacheEntry* entries;  // Dynamically allocated array of entries
+    int count;            // Number of entries in use
+    int capacity;         // Allocated size of entries
+    int* slots;           // Hash table of entry indices (-1 = empty)
+    int slot_count;       // Size of the hash table (power of two)
+    long ttl;             // Seconds before an entry is considered stale
+    int dirty;            // Set when entries need to be written back
+    int hits;             // Lookups answered from the cache
+    int misses;           // Lookups that had to go to the network
+    int expired;          // Misses caused by stale entries
+} MetadataCache;
+
+// Function declarations
+void cache_normalize_isbn(const char* isbn, char* out, size_t out_size);
+void cache_init(MetadataCache* cache, long ttl);
+int cache_load(MetadataCache* cache, const char* filename);
+int cache_save(MetadataCache* cache, const char* filename);
+const CacheEntry* cache_lookup(MetadataCache* cache, const char* isbn);
+int cache_mark_pending(MetadataCache* cache, const char* isbn);
+void cache_store(MetadataCache* cache, const char* isbn, const BookRecord* metadata);
+void cache_print_stats(const MetadataCache* cache);
+void cache_free(MetadataCache* cache);
+
+#endif // CACHE_H
@@ -0,0 +1,167 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "columns.h"
+
+// Initialize an empty column set
+void columns_init(BookColumns* columns) {
+    memset(columns, 0, sizeof(BookColumns));
+}
+
+// Resize one column to `capacity` elements
+static int columns_grow(void** column, size_t element_size, int capacity) {
+    void* grown = realloc(*column, element_size * (size_t)capacity);
+    if (!grown) {
+        return 0;
+    }
+    *column = grown;
+    return 1;
+}
+
+// Make room for at least `capacity` rows in every column
+int columns_reserve(BookColumns* columns, int capacity) {
+    if (capacity <= columns->capacity) {
+        return 1;
+    }
+
+    // Whole bitmap words, so scans never need a partial word at the end
+    capacity = (capacity + 63) & ~63;
+    int old_words = columns->capacity / 64;
+    if (!columns_grow((void**)&columns->valid, sizeof(uint64_t), capacity / 64) ||
+        !columns_grow((void**)&columns->titles, sizeof(StrRef), capacity) ||
+        !columns_grow((void**)&columns->isbns, sizeof(StrRef), capacity) ||
+        !columns_grow((void**)&columns->author_ids, sizeof(uint32_t), capacity) ||
+        !columns_grow((void**)&columns->genre_ids, sizeof(uint32_t), capacity) ||
+        !columns_grow((void**)&columns->word_counts, sizeof(int32_t), capacity) ||
+        !columns_grow((void**)&columns->years, sizeof(int32_t), capacity) ||
+        !columns_grow((void**)&columns->cover_types, sizeof(uint8_t), capacity) ||
+        !columns_grow((void**)&columns->conditions, sizeof(uint8_t), capacity) ||
+        !columns_grow((void**)&columns->retrieved, sizeof(uint8_t), capacity)) {
+        fprintf(stderr, "Memory allocation failed while growing book columns\n");
+        return 0;
+    }
+
+    memset(columns->valid + old_words, 0, sizeof(uint64_t) * (size_t)(capacity / 64 - old_words));
+    columns->capacity = capacity;
+    return 1;
+}
+
+// Copy one book into a row. Writing the row just past the end appends it.
+int columns_set(BookColumns* columns, int row, const Book* book) {
+    if (row >= columns->capacity && !columns_reserve(columns, columns->capacity ? columns->capacity * 2 : 64)) {
+        return 0;
+    }
+
+    columns->titles[row] = book->title;
+    columns->isbns[row] = book->isbn;
+    columns->author_ids[row] = book->author_id;
+    columns->genre_ids[row] = book->genre_id;
+    columns->word_counts[row] = book->word_count;
+    columns->years[row] = book->year_published;
+    columns->cover_types[row] = (uint8_t)book->cover_type;
+    columns->conditions[row] = (uint8_t)book->condition;
+    columns->retrieved[row] = (uint8_t)(book->metadata_retrieved != 0);
+    columns->valid[row / 64] |= (uint64_t)1 << (row % 64);
+    if (row >= columns->count) {
+        columns->count = row + 1;
+    }
+    return 1;
+}
+
+// Mark a row as holding no book
+void columns_clear(BookColumns* columns, int row) {
+    columns->valid[row / 64] &= ~((uint64_t)1 << (row % 64));
+}
+
+// Drop the last row
+void columns_remove_last(BookColumns* columns) {
+    if (columns->count > 0) {
+        columns->count--;
+        columns->valid[columns->count / 64] &= ~((uint64_t)1 << (columns->count % 64));
+    }
+}
+
+// Drop every row, keeping the allocation
+void columns_reset(BookColumns* columns) {
+    if (columns->capacity > 0) {
+        memset(columns->valid, 0, sizeof(uint64_t) * (size_t)(columns->capacity / 64));
+    }
+    columns->count = 0;
+}
+
+// Whether one row meets every condition
+static int columns_row_matches(const BookColumns* columns, int row, int conditions) {
+    if (!(columns->valid[row / 64] >> (row % 64) & 1)) {
+        return 0;
+    }
+    if ((conditions & SCAN_HAS_ISBN) && columns->isbns[row].length == 0) {
+        return 0;
+    }
+    if ((conditions & SCAN_NEEDS_METADATA) && columns->retrieved[row]) {
+        return 0;
+    }
+    return 1;
+}
+
+// Find the first row at or after `start` that holds a book meeting every
+// condition. The rest of the block `start` falls in is checked row by row, so
+// stepping through dense matches costs one row per call; after that, rows are
+// tested 64 at a time into a bitmask that is ANDed with the validity bitmap.
+// Returns -1 if there is none.
+int columns_next(const BookColumns* columns, int start, int conditions) {
+    int base = (start + 63) & ~63;
+    int first_end = base < columns->count ? base : columns->count;
+    for (int row = start; row < first_end; row++) {
+        if (columns_row_matches(columns, row, conditions)) {
+            return row;
+        }
+    }
+
+    for (; base < columns->count; base += 64) {
+        int rows = columns->count - base < 64 ? columns->count - base : 64;
+        uint64_t mask = columns->valid[base / 64];
+
+        if (conditions & SCAN_HAS_ISBN) {
+            const StrRef* isbns = columns->isbns + base;
+            uint64_t bits = 0;
+            for (int i = 0; i < rows; i++) {
+                bits |= (uint64_t)(isbns[i].length != 0) << i;
+            }
+            mask &= bits;
+        }
+        if (conditions & SCAN_NEEDS_METADATA) {
+            const uint8_t* retrieved = columns->retrieved + base;
+            uint64_t bits = 0;
+            for (int i = 0; i < rows; i++) {
+                bits |= (uint64_t)(retrieved[i] == 0) << i;
+            }
+            mask &= bits;
+        }
+
+        if (mask) {
+            return base + __builtin_ctzll(mask);
+        }
+    }
+    return -1;
+}
+
+// Bytes allocated for the columns
+size_t columns_memory(const BookColumns* columns) {
+    size_t per_row = sizeof(StrRef) * 2 + sizeof(uint32_t) * 2 + sizeof(int32_t) * 2 + sizeof(uint8_t) * 3;
+    return per_row * (size_t)columns->capacity + sizeof(uint64_t) * (size_t)(columns->capacity / 64);
+}
+
+// Free every column
+void columns_free(BookColumns* columns) {
+    free(columns->valid);
+    free(columns->titles);
+    free(columns->isbns);
+    free(columns->author_ids);
+    free(columns->genre_ids);
+    free(columns->word_counts);
+    free(columns->years);
+    free(columns->cover_types);
+    free(columns->conditions);
+    free(columns->retrieved);
+    columns_init(columns);
+}
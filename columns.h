@@ -0,0 +1,39 @@
+#ifndef COLUMNS_H
+#define COLUMNS_H
+
+#include <stdint.h>
+#include "book.h"
+
+// Conditions for columns_next (combine with |)
+#define SCAN_HAS_ISBN 1          // Book has an ISBN
+#define SCAN_NEEDS_METADATA 2    // metadata_retrieved is not set
+
+// Column-per-field copy of a library's books (struct of arrays), so scans
+// read only the fields they test. Row i mirrors the book in library slot i.
+typedef struct {
+    int count;                // Rows in use
+    int capacity;             // Rows allocated in every column
+    uint64_t* valid;          // Bit per row, set when the row holds a book
+    StrRef* titles;
+    StrRef* isbns;
+    uint32_t* author_ids;
+    uint32_t* genre_ids;
+    int32_t* word_counts;
+    int32_t* years;
+    uint8_t* cover_types;
+    uint8_t* conditions;
+    uint8_t* retrieved;
+} BookColumns;
+
+// Function declarations
+void columns_init(BookColumns* columns);
+int columns_reserve(BookColumns* columns, int capacity);
+void columns_reset(BookColumns* columns);
+int columns_set(BookColumns* columns, int row, const Book* book);
+void columns_clear(BookColumns* columns, int row);
+void columns_remove_last(BookColumns* columns);
+int columns_next(const BookColumns* columns, int start, int conditions);
+size_t columns_memory(const BookColumns* columns);
+void columns_free(BookColumns* columns);
+
+#endif // COLUMNS_H
@@ -0,0 +1,48 @@
+#include "crc32.h"
+
+static uint32_t crc32_table[8][256];
+static int crc32_ready = 0;
+
+// Build the lookup tables for the reflected polynomial. Table k advances a
+// byte through k further zero bytes, which lets the main loop consume eight
+// bytes per step (slicing-by-8).
+static void crc32_init_table(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int bit = 0; bit < 8; bit++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        crc32_table[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int k = 1; k < 8; k++) {
+            uint32_t prev = crc32_table[k - 1][i];
+            crc32_table[k][i] = crc32_table[0][prev & 0xFF] ^ (prev >> 8);
+        }
+    }
+    crc32_ready = 1;
+}
+
+// Extend a CRC-32 over more bytes
+uint32_t crc32_update(uint32_t crc, const void* data, size_t size) {
+    if (!crc32_ready) {
+        crc32_init_table();
+    }
+
+    const unsigned char* p = (const unsigned char*)data;
+    crc = ~crc;
+    while (size >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = crc32_table[7][lo & 0xFF] ^ crc32_table[6][(lo >> 8) & 0xFF] ^
+              crc32_table[5][(lo >> 16) & 0xFF] ^ crc32_table[4][lo >> 24] ^
+              crc32_table[3][hi & 0xFF] ^ crc32_table[2][(hi >> 8) & 0xFF] ^
+              crc32_table[1][(hi >> 16) & 0xFF] ^ crc32_table[0][hi >> 24];
+        p += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = crc32_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
@@ -0,0 +1,408 @@
+#define _POSIX_C_SOURCE 200809L  // mmap and posix_madvise under -std=c99
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "csv.h"
+#include "crc32.h"
+
+// SSE2 is part of the x86-64 baseline; AVX2 is compiled per function and only
+// used when the CPU reports it
+#if defined(__x86_64__) && defined(__GNUC__)
+#define CSV_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+// Classifies CSV_BLOCK_SIZE bytes into a mask of structural characters
+typedef uint64_t (*CsvMaskFn)(const char* block);
+
+// Map a file read-only. Falls back to reading it into memory when it cannot be
+// mapped (pipes, some network filesystems). Returns 0 if the file cannot be opened.
+int csv_file_open(CsvFile* file, const char* filename) {
+    memset(file, 0, sizeof(CsvFile));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 0;
+    }
+
+    file->size = (size_t)st.st_size;
+    if (file->size == 0) {
+        // mmap rejects empty mappings; an empty file is just no records
+        file->data = "";
+        close(fd);
+        return 1;
+    }
+
+    void* data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+        posix_madvise(data, file->size, POSIX_MADV_SEQUENTIAL);
+        file->data = (const char*)data;
+        file->mapped = 1;
+        close(fd);
+        return 1;
+    }
+
+    char* buffer = (char*)malloc(file->size);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation failed while reading %s\n", filename);
+        close(fd);
+        return 0;
+    }
+
+    size_t total = 0;
+    while (total < file->size) {
+        ssize_t got = read(fd, buffer + total, file->size - total);
+        if (got <= 0) {
+            break;
+        }
+        total += (size_t)got;
+    }
+    close(fd);
+
+    if (total == 0) {
+        // Nothing could be read; an empty size means no buffer to free later
+        free(buffer);
+        file->data = "";
+        file->size = 0;
+        return 1;
+    }
+
+    file->data = buffer;
+    file->size = total;
+    return 1;
+}
+
+// Release the mapping or buffer
+void csv_file_close(CsvFile* file) {
+    if (file->mapped) {
+        munmap((void*)file->data, file->size);
+    } else if (file->size > 0) {
+        free((void*)file->data);
+    }
+    memset(file, 0, sizeof(CsvFile));
+}
+
+// CRC-32 of a file's contents, with the low 32 bits of its size above it.
+// It names the library file a journal extends. Returns 0 if the file is missing.
+uint64_t csv_file_checksum(const char* filename) {
+    CsvFile file;
+    if (!csv_file_open(&file, filename)) {
+        return 0;
+    }
+    uint64_t checksum = (uint64_t)(uint32_t)file.size << 32 | crc32_update(0, file.data, file.size);
+    csv_file_close(&file);
+    return checksum;
+}
+
+// Byte-at-a-time classifier, used on CPUs without SIMD support
+static uint64_t csv_mask_scalar(const char* block) {
+    uint64_t mask = 0;
+    for (int i = 0; i < CSV_BLOCK_SIZE; i++) {
+        char c = block[i];
+        if (c == ',' || c == '"' || c == '\n' || c == '\r') {
+            mask |= (uint64_t)1 << i;
+        }
+    }
+    return mask;
+}
+
+#ifdef CSV_HAVE_X86_SIMD
+// 16 bytes per compare
+static uint64_t csv_mask_sse2(const char* block) {
+    const __m128i comma = _mm_set1_epi8(',');
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    uint64_t mask = 0;
+
+    for (int i = 0; i < CSV_BLOCK_SIZE; i += 16) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(block + i));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, comma), _mm_cmpeq_epi8(bytes, quote)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(bytes, lf), _mm_cmpeq_epi8(bytes, cr)));
+        mask |= (uint64_t)(unsigned int)_mm_movemask_epi8(hits) << i;
+    }
+    return mask;
+}
+
+// 32 bytes per compare
+__attribute__((target("avx2")))
+static uint64_t csv_mask_avx2(const char* block) {
+    const __m256i comma = _mm256_set1_epi8(',');
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    uint64_t mask = 0;
+
+    for (int i = 0; i < CSV_BLOCK_SIZE; i += 32) {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(block + i));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, comma), _mm256_cmpeq_epi8(bytes, quote)),
+                                       _mm256_or_si256(_mm256_cmpeq_epi8(bytes, lf), _mm256_cmpeq_epi8(bytes, cr)));
+        mask |= (uint64_t)(unsigned int)_mm256_movemask_epi8(hits) << i;
+    }
+    return mask;
+}
+#endif
+
+static CsvMaskFn csv_classify = NULL;
+
+// Pick the widest classifier the CPU supports
+static void csv_select_kernel(void) {
+    if (csv_classify) {
+        return;
+    }
+    csv_classify = csv_mask_scalar;
+#ifdef CSV_HAVE_X86_SIMD
+    __builtin_cpu_init();
+    csv_classify = __builtin_cpu_supports("avx2") ? csv_mask_avx2 : csv_mask_sse2;
+#endif
+}
+
+// Start reading records from a byte range
+void csv_reader_init(CsvReader* reader, const char* data, size_t size) {
+    csv_select_kernel();
+    reader->cursor = data;
+    reader->end = data + size;
+    reader->base = data;
+    reader->block = NULL;
+    reader->mask = 0;
+    reader->line = 1;
+    reader->record_line = 1;
+    reader->unterminated = 0;
+}
+
+// Index of the lowest set bit
+static int csv_lowest_bit(uint64_t mask) {
+#ifdef __GNUC__
+    return __builtin_ctzll(mask);
+#else
+    int bit = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+// Classify the block starting at `block`. The final partial block is padded
+// with a non-structural byte so the classifiers never read past the range.
+static void csv_load_block(CsvReader* reader, const char* block) {
+    reader->block = block;
+    if (reader->end - block >= CSV_BLOCK_SIZE) {
+        reader->mask = csv_classify(block);
+        return;
+    }
+
+    char padded[CSV_BLOCK_SIZE];
+    size_t available = (size_t)(reader->end - block);
+    memset(padded, 'a', sizeof(padded));
+    memcpy(padded, block, available);
+    reader->mask = csv_classify(padded);
+}
+
+// Find the first structural character at or after p (or the end of the range)
+static const char* csv_next_structural(CsvReader* reader, const char* p) {
+    if (p >= reader->end) {
+        return reader->end;
+    }
+
+    if (!reader->block || p < reader->block || p >= reader->block + CSV_BLOCK_SIZE) {
+        size_t offset = (size_t)(p - reader->base);
+        csv_load_block(reader, reader->base + offset - offset % CSV_BLOCK_SIZE);
+    }
+
+    uint64_t pending = reader->mask & (~(uint64_t)0 << (p - reader->block));
+    while (pending == 0) {
+        const char* next = reader->block + CSV_BLOCK_SIZE;
+        if (next >= reader->end) {
+            return reader->end;
+        }
+        csv_load_block(reader, next);
+        pending = reader->mask;
+    }
+    return reader->block + csv_lowest_bit(pending);
+}
+
+// Read the next record. Fields beyond max_fields are counted but not stored.
+// Blank lines are skipped. Returns 0 when there are no more records.
+int csv_next_record(CsvReader* reader, CsvField* fields, int max_fields, int* field_count) {
+    const char* p = reader->cursor;
+    const char* end = reader->end;
+
+    while (p < end && (*p == '\n' || *p == '\r')) {
+        if (*p == '\n') {
+            reader->line++;
+        }
+        p++;
+    }
+    if (p >= end) {
+        reader->cursor = p;
+        *field_count = 0;
+        return 0;
+    }
+
+    reader->record_line = reader->line;
+    int count = 0;
+
+    for (;;) {
+        CsvField field;
+        field.escaped = 0;
+
+        if (p < end && *p == '"') {
+            // Quoted field: runs to the first quote that is not doubled
+            field.start = ++p;
+            for (;;) {
+                p = csv_next_structural(reader, p);
+                if (p >= end) {
+                    reader->unterminated = 1;
+                    field.length = (size_t)(p - field.start);
+                    break;
+                }
+                if (*p == ',' || *p == '\r') {
+                    p++;
+                } else if (*p == '\n') {
+                    reader->line++;
+                    p++;
+                } else if (p + 1 < end && p[1] == '"') {
+                    field.escaped = 1;
+                    p += 2;
+                } else {
+                    field.length = (size_t)(p - field.start);
+                    p++;
+                    break;
+                }
+            }
+
+            // Be lenient about text between the closing quote and the delimiter
+            if (p < end && *p != ',' && *p != '\n' && *p != '\r') {
+                const char* q = p;
+                while (q < end && *q != ',' && *q != '\n' && *q != '\r') {
+                    q++;
+                }
+                field.length = (size_t)(q - field.start);
+                p = q;
+            }
+        } else {
+            // Unquoted field: a stray quote is kept as a literal character
+            field.start = p;
+            for (;;) {
+                p = csv_next_structural(reader, p);
+                if (p < end && *p == '"') {
+                    p++;
+                    continue;
+                }
+                break;
+            }
+            field.length = (size_t)(p - field.start);
+        }
+
+        if (count < max_fields) {
+            fields[count] = field;
+        }
+        count++;
+
+        if (p < end && *p == ',') {
+            p++;
+            continue;
+        }
+        if (p < end && *p == '\r') {
+            p++;
+        }
+        if (p < end && *p == '\n') {
+            reader->line++;
+            p++;
+        }
+        break;
+    }
+
+    reader->cursor = p;
+    *field_count = count;
+    return 1;
+}
+
+// Count quote characters and line feeds in a range. The quote count's parity
+// tells whether a range that starts outside quotes ends inside a quoted field.
+void csv_count_quotes_and_lines(const char* data, size_t size, size_t* quotes, long* lines) {
+    size_t quote_count = 0;
+    long line_count = 0;
+
+    for (size_t i = 0; i < size; i++) {
+        quote_count += data[i] == '"';
+        line_count += data[i] == '\n';
+    }
+    *quotes = quote_count;
+    *lines = line_count;
+}
+
+// Return the start of the first record after p, given whether p is inside a
+// quoted field. Adds the line feeds skipped over to *lines. Returns end if no
+// record starts before it.
+const char* csv_resync(const char* p, const char* end, int in_quotes, long* lines) {
+    while (p < end) {
+        char c = *p++;
+        if (c == '"') {
+            in_quotes = !in_quotes;
+        } else if (c == '\n') {
+            (*lines)++;
+            if (!in_quotes) {
+                return p;
+            }
+        }
+    }
+    return end;
+}
+
+// Copy a field into a NUL terminated buffer, collapsing doubled quotes and
+// truncating to fit. Returns the number of bytes written.
+size_t csv_field_copy(const CsvField* field, char* out, size_t out_size) {
+    size_t limit = out_size - 1;
+
+    if (!field->escaped) {
+        size_t copy = field->length < limit ? field->length : limit;
+        memcpy(out, field->start, copy);
+        out[copy] = '\0';
+        return copy;
+    }
+
+    size_t pos = 0;
+    for (size_t i = 0; i < field->length && pos < limit; i++) {
+        out[pos++] = field->start[i];
+        if (field->start[i] == '"' && i + 1 < field->length && field->start[i + 1] == '"') {
+            i++;
+        }
+    }
+    out[pos] = '\0';
+    return pos;
+}
+
+// Parse a field as a decimal integer the way atoi would, without copying it
+int csv_field_int(const CsvField* field) {
+    const char* p = field->start;
+    const char* end = p + field->length;
+    int negative = 0;
+    int value = 0;
+
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        p++;
+    }
+    return negative ? -value : value;
+}
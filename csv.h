@@ -0,0 +1,55 @@
+#ifndef CSV_H
+#define CSV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CSV_MAX_FIELDS 16
+#define CSV_BLOCK_SIZE 64  // Bytes classified per structural mask
+
+// Read-only view of a whole file. Memory-mapped when possible, so records are
+// tokenized in place without copying lines out of the file.
+typedef struct {
+    const char* data;   // File contents (not NUL terminated)
+    size_t size;        // Size in bytes
+    int mapped;         // 1 if data is an mmap, 0 if it is a heap buffer (or empty)
+} CsvFile;
+
+// One field as a span of the underlying bytes. Surrounding quotes are already
+// stripped; doubled quotes inside are collapsed when the field is copied.
+typedef struct {
+    const char* start;
+    size_t length;
+    int escaped;        // Span contains "" pairs
+} CsvField;
+
+// RFC 4180 record reader over a byte range. Quoted fields may contain
+// delimiters, doubled quotes and line breaks; CRLF and LF both end a record.
+// The input is classified a block at a time into a bitmask of structural
+// characters (, " CR LF), so the state machine jumps from one to the next
+// instead of testing every byte.
+typedef struct {
+    const char* cursor; // Next byte to read
+    const char* end;    // One past the last byte
+    const char* base;   // Start of the range; blocks are aligned to it
+    const char* block;  // Block the mask describes (NULL before the first)
+    uint64_t mask;      // Bit i set if block[i] is structural
+    long line;          // Line number of the cursor (1-based)
+    long record_line;   // Line number where the last returned record started
+    int unterminated;   // Set when the input ended inside a quoted field
+} CsvReader;
+
+// Function declarations
+int csv_file_open(CsvFile* file, const char* filename);
+void csv_file_close(CsvFile* file);
+uint64_t csv_file_checksum(const char* filename);
+void csv_reader_init(CsvReader* reader, const char* data, size_t size);
+int csv_next_record(CsvReader* reader, CsvField* fields, int max_fields, int* field_count);
+size_t csv_field_copy(const CsvField* field, char* out, size_t out_size);
+int csv_field_int(const CsvField* field);
+
+// Helpers for splitting a file into ranges that start on record boundaries
+void csv_count_quotes_and_lines(const char* data, size_t size, size_t* quotes, long* lines);
+const char* csv_resync(const char* p, const char* end, int in_quotes, long* lines);
+
+#endif // CSV_H
@@ -0,0 +1,537 @@
+#define _POSIX_C_SOURCE 200809L  // sysconf and pthreads under -std=c99
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "dump.h"
+#include "cJSON.h"
+
+// Hash table from ISBN-13 (as an integer) to the books that carry it
+typedef struct {
+    unsigned long long* keys;  // 0 = empty slot
+    int* heads;                // First book index for the key
+    int* claimed;              // Set once a dump record has matched the key
+    int slot_count;            // Power of two
+    int* next_book;            // Next book index with the same key (-1 = end)
+} DumpIndex;
+
+// A dump record that matched one of our ISBNs
+typedef struct {
+    int slot;                  // Index slot of the matched key
+    BookRecord metadata;       // Fields extracted from the record (owned by the match)
+} DumpMatch;
+
+// State shared by the reader and the parser threads
+typedef struct {
+    DumpIndex index;
+
+    // Bounded queue of blocks waiting to be parsed
+    char** blocks;
+    size_t* block_sizes;
+    int queue_head;
+    int queue_count;
+    int queue_capacity;
+    int reading_done;
+    pthread_mutex_t queue_lock;
+    pthread_cond_t queue_not_empty;
+    pthread_cond_t queue_not_full;
+
+    // Matches found so far
+    DumpMatch* matches;
+    int match_count;
+    int match_capacity;
+    long long lines;
+    pthread_mutex_t result_lock;
+
+    // cJSON keeps its error pointer in a global, so parses are serialized.
+    // Only records that match one of our ISBNs are parsed, so this is rarely contended.
+    pthread_mutex_t json_lock;
+} DumpImport;
+
+// Fill in default import options
+void dump_options_init(DumpOptions* options) {
+    options->threads = 0;
+}
+
+// Find the slot for a key, or -1 if it is not in the index
+static int dump_index_find(const DumpIndex* index, unsigned long long key) {
+    unsigned int mask = (unsigned int)index->slot_count - 1;
+    unsigned int slot = isbn_hash(key) & mask;
+
+    while (index->keys[slot] != 0) {
+        if (index->keys[slot] == key) {
+            return (int)slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return -1;
+}
+
+// Index every book that has an ISBN but no metadata yet. Returns the number indexed.
+static int dump_index_build(DumpIndex* index, const Library* library) {
+    int slot_count = 16;
+    while (slot_count < library->count * 2) {
+        slot_count *= 2;
+    }
+
+    index->slot_count = slot_count;
+    index->keys = (unsigned long long*)calloc(slot_count, sizeof(unsigned long long));
+    index->heads = (int*)malloc(sizeof(int) * slot_count);
+    index->claimed = (int*)calloc(slot_count, sizeof(int));
+    index->next_book = (int*)malloc(sizeof(int) * (library->count > 0 ? library->count : 1));
+    if (!index->keys || !index->heads || !index->claimed || !index->next_book) {
+        fprintf(stderr, "Memory allocation failed while indexing ISBNs\n");
+        return -1;
+    }
+
+    int indexed = 0;
+    unsigned int mask = (unsigned int)slot_count - 1;
+    memset(index->next_book, 0xff, sizeof(int) * (library->count > 0 ? library->count : 1)); // All -1
+    for (int i = library_next_book(library, 0, SCAN_HAS_ISBN | SCAN_NEEDS_METADATA); i >= 0;
+         i = library_next_book(library, i + 1, SCAN_HAS_ISBN | SCAN_NEEDS_METADATA)) {
+        const Book* book = library_book(library, i);
+
+        unsigned long long key = isbn_key_unchecked(book_isbn(library, book), book->isbn.length);
+        if (key == 0) {
+            continue;
+        }
+
+        unsigned int slot = isbn_hash(key) & mask;
+        while (index->keys[slot] != 0 && index->keys[slot] != key) {
+            slot = (slot + 1) & mask;
+        }
+        if (index->keys[slot] == 0) {
+            index->keys[slot] = key;
+            index->heads[slot] = -1;
+        }
+
+        // Prepend to the chain of books sharing this ISBN
+        index->next_book[i] = index->heads[slot];
+        index->heads[slot] = i;
+        indexed++;
+    }
+    return indexed;
+}
+
+// Release the index
+static void dump_index_free(DumpIndex* index) {
+    free(index->keys);
+    free(index->heads);
+    free(index->claimed);
+    free(index->next_book);
+}
+
+// Fill a book from an edition record. Editions only reference authors by key,
+// so the author comes from the free-text "by_statement" when there is one.
+static int parse_edition_json(const cJSON* edition, BookRecord* book) {
+    int success = 0;
+
+    cJSON* title = cJSON_GetObjectItem(edition, "title");
+    if (title && title->valuestring) {
+        book_record_set(&book->title, title->valuestring, strlen(title->valuestring));
+        success = 1;
+    }
+
+    cJSON* by_statement = cJSON_GetObjectItem(edition, "by_statement");
+    if (by_statement && by_statement->valuestring) {
+        const char* author = by_statement->valuestring;
+        if (strncmp(author, "by ", 3) == 0) {
+            author += 3;
+        }
+        // Drop trailing punctuation the statement usually ends with
+        size_t len = strlen(author);
+        while (len > 0 && (author[len - 1] == '.' || author[len - 1] == ' ')) {
+            len--;
+        }
+        if (len > 0) {
+            book_record_set(&book->author, author, len);
+        }
+    }
+
+    cJSON* publish_date = cJSON_GetObjectItem(edition, "publish_date");
+    if (publish_date && publish_date->valuestring) {
+        book->year_published = extract_year(publish_date->valuestring);
+    }
+
+    // Subjects are plain strings in the dump
+    cJSON* subjects = cJSON_GetObjectItem(edition, "subjects");
+    if (subjects && subjects->type == cJSON_Array && cJSON_GetArraySize(subjects) > 0) {
+        cJSON* first_subject = cJSON_GetArrayItem(subjects, 0);
+        if (first_subject && first_subject->valuestring && first_subject->valuestring[0] != '\0') {
+            book_record_set(&book->genre, first_subject->valuestring, strlen(first_subject->valuestring));
+            book->genre[0] = toupper((unsigned char)book->genre[0]);
+        }
+    }
+
+    // Estimate word count based on pages (rough estimate: 250 words per page)
+    cJSON* num_pages = cJSON_GetObjectItem(edition, "number_of_pages");
+    if (num_pages && num_pages->type == cJSON_Number) {
+        book->word_count = num_pages->valueint * 250;
+    }
+
+    return success;
+}
+
+// Collect index slots for every ISBN listed in the record's isbn_10/isbn_13 arrays
+static int dump_find_isbn_slots(const DumpImport* import, const char* line, int* slots, int max_slots) {
+    int found = 0;
+    const char* p = line;
+
+    while ((p = strstr(p, "\"isbn_1")) != NULL) {
+        p += 7;
+        if ((*p != '0' && *p != '3') || p[1] != '"') {
+            continue;
+        }
+
+        const char* end = strchr(p, ']');
+        const char* q = strchr(p, '[');
+        if (!q || !end || q > end) {
+            continue;
+        }
+
+        // Walk the quoted strings inside the array
+        while ((q = strchr(q, '"')) != NULL && q < end) {
+            const char* close = strchr(q + 1, '"');
+            if (!close || close > end) {
+                break;
+            }
+
+            int slot = dump_index_find(&import->index, isbn_key_unchecked(q + 1, (size_t)(close - q - 1)));
+            if (slot >= 0 && found < max_slots) {
+                int duplicate = 0;
+                for (int i = 0; i < found; i++) {
+                    duplicate |= slots[i] == slot;
+                }
+                if (!duplicate) {
+                    slots[found++] = slot;
+                }
+            }
+            q = close + 1;
+        }
+        p = end;
+    }
+    return found;
+}
+
+// Parse a matching record and store it for each slot that has not been claimed yet
+static void dump_record_match(DumpImport* import, const char* line, const int* slots, int slot_count) {
+    // TSV dumps carry the record as the fifth column; JSONL dumps are the record
+    const char* json = line;
+    if (*json != '{') {
+        for (int tabs = 0; tabs < 4 && json; tabs++) {
+            json = strchr(json, '\t');
+            json = json ? json + 1 : NULL;
+        }
+        if (!json) {
+            return;
+        }
+    }
+
+    BookRecord metadata;
+    book_record_init(&metadata);
+
+    pthread_mutex_lock(&import->json_lock);
+    cJSON* root = cJSON_Parse(json);
+    int parsed = root && parse_edition_json(root, &metadata);
+    if (root) {
+        cJSON_Delete(root);
+    }
+    pthread_mutex_unlock(&import->json_lock);
+
+    if (!parsed) {
+        book_record_free(&metadata);
+        return;
+    }
+
+    // The first match takes the record; any further ISBNs of the edition get copies
+    int owned = 0;
+    pthread_mutex_lock(&import->result_lock);
+    for (int i = 0; i < slot_count; i++) {
+        if (import->index.claimed[slots[i]]) {
+            continue;
+        }
+
+        if (import->match_count >= import->match_capacity) {
+            int new_capacity = import->match_capacity ? import->match_capacity * 2 : 64;
+            DumpMatch* new_matches = (DumpMatch*)realloc(import->matches, sizeof(DumpMatch) * new_capacity);
+            if (!new_matches) {
+                fprintf(stderr, "Memory allocation failed while recording dump matches\n");
+                break;
+            }
+            import->matches = new_matches;
+            import->match_capacity = new_capacity;
+        }
+
+        import->index.claimed[slots[i]] = 1;
+        import->matches[import->match_count].slot = slots[i];
+        DumpMatch* match = &import->matches[import->match_count++];
+        if (owned) {
+            book_record_init(&match->metadata);
+            book_record_copy(&match->metadata, &metadata);
+        } else {
+            match->metadata = metadata;
+            owned = 1;
+        }
+    }
+    pthread_mutex_unlock(&import->result_lock);
+
+    if (!owned) {
+        book_record_free(&metadata);
+    }
+}
+
+// Scan every complete line in a block
+static long long dump_process_block(DumpImport* import, char* block, size_t size) {
+    long long lines = 0;
+    char* line = block;
+    char* end = block + size;
+
+    while (line < end) {
+        char* newline = memchr(line, '\n', (size_t)(end - line));
+        char* line_end = newline ? newline : end;
+        *line_end = '\0';
+        if (line_end > line && line_end[-1] == '\r') {
+            line_end[-1] = '\0';
+        }
+
+        int slots[8];
+        int slot_count = dump_find_isbn_slots(import, line, slots, 8);
+        if (slot_count > 0) {
+            dump_record_match(import, line, slots, slot_count);
+        }
+
+        lines++;
+        line = line_end + 1;
+    }
+    return lines;
+}
+
+// Parser thread: take blocks off the queue until the reader is done
+static void* dump_worker(void* arg) {
+    DumpImport* import = (DumpImport*)arg;
+    long long lines = 0;
+
+    for (;;) {
+        pthread_mutex_lock(&import->queue_lock);
+        while (import->queue_count == 0 && !import->reading_done) {
+            pthread_cond_wait(&import->queue_not_empty, &import->queue_lock);
+        }
+        if (import->queue_count == 0) {
+            pthread_mutex_unlock(&import->queue_lock);
+            break;
+        }
+
+        char* block = import->blocks[import->queue_head];
+        size_t size = import->block_sizes[import->queue_head];
+        import->queue_head = (import->queue_head + 1) % import->queue_capacity;
+        import->queue_count--;
+        pthread_cond_signal(&import->queue_not_full);
+        pthread_mutex_unlock(&import->queue_lock);
+
+        lines += dump_process_block(import, block, size);
+        free(block);
+    }
+
+    pthread_mutex_lock(&import->result_lock);
+    import->lines += lines;
+    pthread_mutex_unlock(&import->result_lock);
+    return NULL;
+}
+
+// Hand a block to the parser threads, waiting while the queue is full
+static void dump_enqueue(DumpImport* import, char* block, size_t size) {
+    pthread_mutex_lock(&import->queue_lock);
+    while (import->queue_count == import->queue_capacity) {
+        pthread_cond_wait(&import->queue_not_full, &import->queue_lock);
+    }
+    int tail = (import->queue_head + import->queue_count) % import->queue_capacity;
+    import->blocks[tail] = block;
+    import->block_sizes[tail] = size;
+    import->queue_count++;
+    pthread_cond_signal(&import->queue_not_empty);
+    pthread_mutex_unlock(&import->queue_lock);
+}
+
+// Read the dump in blocks that end on a line boundary. Memory stays bounded by
+// the queue depth; only a line longer than a block forces a bigger buffer.
+static long long dump_read_blocks(DumpImport* import, FILE* file) {
+    long long bytes = 0;
+    char* carry = NULL;
+    size_t carry_size = 0;
+
+    for (;;) {
+        size_t capacity = carry_size + DUMP_BLOCK_SIZE;
+        char* block = (char*)malloc(capacity + 1);
+        if (!block) {
+            fprintf(stderr, "Memory allocation failed while reading dump\n");
+            break;
+        }
+
+        if (carry_size > 0) {
+            memcpy(block, carry, carry_size);
+        }
+        free(carry);
+        carry = NULL;
+
+        size_t got = fread(block + carry_size, 1, DUMP_BLOCK_SIZE, file);
+        bytes += (long long)got;
+        size_t size = carry_size + got;
+        carry_size = 0;
+
+        if (got == 0) {
+            // End of input: whatever is left is the final line
+            if (size > 0) {
+                dump_enqueue(import, block, size);
+            } else {
+                free(block);
+            }
+            break;
+        }
+
+        // Keep the partial last line for the next block
+        char* last_newline = NULL;
+        for (size_t i = size; i > 0; i--) {
+            if (block[i - 1] == '\n') {
+                last_newline = block + i - 1;
+                break;
+            }
+        }
+
+        if (!last_newline) {
+            carry = block;
+            carry_size = size;
+            continue;
+        }
+
+        size_t complete = (size_t)(last_newline - block) + 1;
+        carry_size = size - complete;
+        if (carry_size > 0) {
+            carry = (char*)malloc(carry_size);
+            if (!carry) {
+                fprintf(stderr, "Memory allocation failed while reading dump\n");
+                free(block);
+                break;
+            }
+            memcpy(carry, block + complete, carry_size);
+        }
+        dump_enqueue(import, block, complete);
+    }
+
+    free(carry);
+    return bytes;
+}
+
+// Stream an Open Library editions dump (TSV or JSONL, "-" for stdin) and fill in
+// metadata for books that have an ISBN but no metadata yet. Returns the number of
+// books updated, or -1 on error.
+int import_library_from_dump(Library* library, const char* filename,
+                             const DumpOptions* options, DumpStats* stats) {
+    memset(stats, 0, sizeof(DumpStats));
+
+    DumpImport import;
+    memset(&import, 0, sizeof(import));
+
+    stats->candidates = dump_index_build(&import.index, library);
+    if (stats->candidates < 0) {
+        dump_index_free(&import.index);
+        return -1;
+    }
+    if (stats->candidates == 0) {
+        printf("No books are waiting for metadata.\n");
+        dump_index_free(&import.index);
+        return 0;
+    }
+
+    FILE* file = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "rb");
+    if (!file) {
+        perror("Error opening dump file");
+        dump_index_free(&import.index);
+        return -1;
+    }
+
+    int threads = options && options->threads > 0 ? options->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads < 1) {
+        threads = 1;
+    }
+    if (threads > MAX_DUMP_THREADS) {
+        threads = MAX_DUMP_THREADS;
+    }
+
+    import.queue_capacity = threads * DUMP_QUEUE_DEPTH;
+    import.blocks = (char**)malloc(sizeof(char*) * import.queue_capacity);
+    import.block_sizes = (size_t*)malloc(sizeof(size_t) * import.queue_capacity);
+    pthread_t* workers = (pthread_t*)malloc(sizeof(pthread_t) * threads);
+    if (!import.blocks || !import.block_sizes || !workers) {
+        fprintf(stderr, "Memory allocation failed while starting dump import\n");
+        free(import.blocks);
+        free(import.block_sizes);
+        free(workers);
+        if (file != stdin) {
+            fclose(file);
+        }
+        dump_index_free(&import.index);
+        return -1;
+    }
+
+    pthread_mutex_init(&import.queue_lock, NULL);
+    pthread_cond_init(&import.queue_not_empty, NULL);
+    pthread_cond_init(&import.queue_not_full, NULL);
+    pthread_mutex_init(&import.result_lock, NULL);
+    pthread_mutex_init(&import.json_lock, NULL);
+
+    printf("Scanning dump for %d ISBNs with %d parser threads...\n", stats->candidates, threads);
+
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        if (pthread_create(&workers[i], NULL, dump_worker, &import) != 0) {
+            break;
+        }
+        started++;
+    }
+
+    if (started > 0) {
+        stats->bytes = dump_read_blocks(&import, file);
+    } else {
+        fprintf(stderr, "Failed to start dump parser threads\n");
+    }
+
+    pthread_mutex_lock(&import.queue_lock);
+    import.reading_done = 1;
+    pthread_cond_broadcast(&import.queue_not_empty);
+    pthread_mutex_unlock(&import.queue_lock);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    if (file != stdin) {
+        fclose(file);
+    }
+
+    // Apply matches on this thread so the library is never touched concurrently
+    for (int i = 0; i < import.match_count; i++) {
+        DumpMatch* match = &import.matches[i];
+        for (int b = import.index.heads[match->slot]; b != -1; b = import.index.next_book[b]) {
+            update_book_metadata(library, b, &match->metadata);
+            stats->matched++;
+        }
+        book_record_free(&match->metadata);
+    }
+    stats->lines = import.lines;
+
+    pthread_mutex_destroy(&import.queue_lock);
+    pthread_cond_destroy(&import.queue_not_empty);
+    pthread_cond_destroy(&import.queue_not_full);
+    pthread_mutex_destroy(&import.result_lock);
+    pthread_mutex_destroy(&import.json_lock);
+    free(import.blocks);
+    free(import.block_sizes);
+    free(import.matches);
+    free(workers);
+    dump_index_free(&import.index);
+
+    return stats->matched;
+}
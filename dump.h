@@ -0,0 +1,28 @@
+#ifndef DUMP_H
+#define DUMP_H
+
+#include "library.h"
+
+#define DUMP_BLOCK_SIZE (4 * 1024 * 1024)  // Bytes read per block handed to a worker
+#define DUMP_QUEUE_DEPTH 2                  // Blocks buffered per worker thread
+#define MAX_DUMP_THREADS 64
+
+// Options for importing an Open Library editions dump
+typedef struct {
+    int threads;       // Parser threads (0 = one per online core)
+} DumpOptions;
+
+// Counters reported after an import
+typedef struct {
+    long long bytes;   // Bytes read from the dump
+    long long lines;   // Records scanned
+    int candidates;    // Books with an ISBN and no metadata
+    int matched;       // Books filled from the dump
+} DumpStats;
+
+// Function declarations
+void dump_options_init(DumpOptions* options);
+int import_library_from_dump(Library* library, const char* filename,
+                             const DumpOptions* options, DumpStats* stats);
+
+#endif // DUMP_H
@@ -0,0 +1,721 @@
+#define _POSIX_C_SOURCE 200809L  // clock_gettime and strdup under -std=c99
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <curl/curl.h>
+#include "fetch.h"
+
+// Fill in default fetch options
+void fetch_options_init(FetchOptions* options) {
+    options->api_url = DEFAULT_API_URL;
+    options->concurrency = DEFAULT_FETCH_CONCURRENCY;
+    options->batch_size = DEFAULT_FETCH_BATCH_SIZE;
+    options->reuse_connections = 1;
+    options->report_timing = 0;
+    options->use_cache = 1;
+    options->cache_ttl = DEFAULT_CACHE_TTL;
+    options->cache_file = DEFAULT_CACHE_FILE;
+    options->rate_limit = DEFAULT_RATE_LIMIT;
+    options->request_timeout_ms = DEFAULT_REQUEST_TIMEOUT_MS;
+    options->connect_timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS;
+    options->deadline_seconds = 0;
+    options->max_retries = DEFAULT_MAX_RETRIES;
+    options->honor_backoff = 1;
+    options->retry_file = DEFAULT_RETRY_FILE;
+}
+
+// Monotonic clock in seconds, used for throughput reporting
+double fetch_now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// Order retry entries by ISBN
+static int retry_entry_compare(const void* a, const void* b) {
+    return strcmp(((const RetryEntry*)a)->isbn, ((const RetryEntry*)b)->isbn);
+}
+
+// Load the persistent retry queue. A missing file is an empty queue.
+static void retry_queue_load(RetryQueue* queue, const char* filename) {
+    memset(queue, 0, sizeof(RetryQueue));
+    queue->sorted = 1;
+
+    FILE* file = fopen(filename, "r");
+    if (!file) {
+        return;
+    }
+
+    char isbn[64];
+    int attempts;
+    long next_attempt_at;
+    long last_status;
+    while (fscanf(file, "%63s %d %ld %ld", isbn, &attempts, &next_attempt_at, &last_status) == 4) {
+        if (queue->count >= queue->capacity) {
+            int new_capacity = queue->capacity ? queue->capacity * 2 : 16;
+            RetryEntry* new_entries = (RetryEntry*)realloc(queue->entries, sizeof(RetryEntry) * new_capacity);
+            if (!new_entries) {
+                break;
+            }
+            queue->entries = new_entries;
+            queue->capacity = new_capacity;
+        }
+        RetryEntry* entry = &queue->entries[queue->count++];
+        strncpy(entry->isbn, isbn, sizeof(entry->isbn) - 1);
+        entry->isbn[sizeof(entry->isbn) - 1] = '\0';
+        entry->attempts = attempts;
+        entry->next_attempt_at = (time_t)next_attempt_at;
+        entry->last_status = last_status;
+    }
+    fclose(file);
+    queue->sorted = 0;
+}
+
+// Write the retry queue back via a temporary file, removing it when empty
+static void retry_queue_save(RetryQueue* queue, const char* filename) {
+    if (!queue->dirty) {
+        return;
+    }
+
+    if (queue->count == 0) {
+        remove(filename);
+        queue->dirty = 0;
+        return;
+    }
+
+    char temp_name[512];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+    FILE* file = fopen(temp_name, "w");
+    if (!file) {
+        perror("Error opening retry queue for writing");
+        return;
+    }
+    for (int i = 0; i < queue->count; i++) {
+        const RetryEntry* entry = &queue->entries[i];
+        fprintf(file, "%s\t%d\t%ld\t%ld\n", entry->isbn, entry->attempts,
+                (long)entry->next_attempt_at, entry->last_status);
+    }
+    if (fclose(file) != 0 || rename(temp_name, filename) != 0) {
+        perror("Error writing retry queue");
+        remove(temp_name);
+        return;
+    }
+    queue->dirty = 0;
+}
+
+// Find the queued retry for an ISBN, if any
+const RetryEntry* retry_queue_find(RetryQueue* queue, const char* isbn) {
+    RetryEntry key;
+    cache_normalize_isbn(isbn, key.isbn, sizeof(key.isbn));
+
+    if (!queue->sorted) {
+        qsort(queue->entries, queue->count, sizeof(RetryEntry), retry_entry_compare);
+        queue->sorted = 1;
+    }
+    if (queue->count == 0) {
+        return NULL;
+    }
+    return (const RetryEntry*)bsearch(&key, queue->entries, queue->count, sizeof(RetryEntry), retry_entry_compare);
+}
+
+// Note a transient failure; the ISBN backs off exponentially across runs (capped at a
+// day), or for as long as the server asked with Retry-After if that is longer
+void retry_queue_record_failure(RetryQueue* queue, const char* isbn, long http_status, long retry_after) {
+    RetryEntry* entry = (RetryEntry*)retry_queue_find(queue, isbn);
+
+    if (!entry) {
+        if (queue->count >= queue->capacity) {
+            int new_capacity = queue->capacity ? queue->capacity * 2 : 16;
+            RetryEntry* new_entries = (RetryEntry*)realloc(queue->entries, sizeof(RetryEntry) * new_capacity);
+            if (!new_entries) {
+                fprintf(stderr, "Memory allocation failed while queueing retry\n");
+                return;
+            }
+            queue->entries = new_entries;
+            queue->capacity = new_capacity;
+        }
+        entry = &queue->entries[queue->count++];
+        memset(entry, 0, sizeof(RetryEntry));
+        cache_normalize_isbn(isbn, entry->isbn, sizeof(entry->isbn));
+        queue->sorted = 0;
+    }
+
+    entry->attempts++;
+    long delay = 60L << (entry->attempts < 11 ? entry->attempts - 1 : 10);
+    if (delay > 24L * 60 * 60) {
+        delay = 24L * 60 * 60;
+    }
+    if (retry_after > delay) {
+        delay = retry_after;
+    }
+    entry->next_attempt_at = time(NULL) + delay;
+    entry->last_status = http_status;
+    queue->dirty = 1;
+}
+
+// Drop an ISBN from the retry queue once it has been answered
+void retry_queue_remove(RetryQueue* queue, const char* isbn) {
+    RetryEntry* entry = (RetryEntry*)retry_queue_find(queue, isbn);
+    if (!entry) {
+        return;
+    }
+    int index = (int)(entry - queue->entries);
+    memmove(entry, entry + 1, sizeof(RetryEntry) * (queue->count - index - 1));
+    queue->count--;
+    queue->dirty = 1;
+}
+
+// Top up the token bucket and return how long until a request may start (0 = now)
+static double fetch_token_wait(FetchSession* session, double now) {
+    double rate = session->options.rate_limit;
+    if (rate <= 0) {
+        return 0;
+    }
+
+    // Allow bursts of up to one second's worth of requests
+    double burst = rate > 1.0 ? rate : 1.0;
+    session->tokens += (now - session->last_refill) * rate;
+    if (session->tokens > burst) {
+        session->tokens = burst;
+    }
+    session->last_refill = now;
+
+    return session->tokens >= 1.0 ? 0 : (1.0 - session->tokens) / rate;
+}
+
+// Spend one token for a request that is about to start
+static void fetch_token_take(FetchSession* session) {
+    if (session->options.rate_limit > 0) {
+        session->tokens -= 1.0;
+    }
+}
+
+// Whether a failed request is worth trying again
+static int fetch_is_retryable(CURLcode res, long http_status) {
+    switch (res) {
+        case CURLE_OK:
+            return http_status == 429 || (http_status >= 500 && http_status != 501);
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_GOT_NOTHING:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_PARTIAL_FILE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Exponential backoff with equal jitter: half the delay is fixed, half random,
+// so retries from one burst of failures spread out instead of arriving together.
+// A server's Retry-After is honored up to BACKOFF_MAX_SECONDS.
+static double fetch_backoff_delay(int attempt, long retry_after) {
+    double delay = BACKOFF_BASE_SECONDS * (double)(1L << (attempt < 16 ? attempt - 1 : 15));
+    if (delay > BACKOFF_MAX_SECONDS) {
+        delay = BACKOFF_MAX_SECONDS;
+    }
+    delay = delay / 2 + (delay / 2) * ((double)rand() / RAND_MAX);
+
+    if ((double)retry_after > delay) {
+        delay = (double)retry_after;
+    }
+    return delay < BACKOFF_MAX_SECONDS ? delay : BACKOFF_MAX_SECONDS;
+}
+
+// Create a session. No network activity happens until the first request.
+int fetch_session_init(FetchSession* session, const FetchOptions* options) {
+    memset(session, 0, sizeof(FetchSession));
+
+    if (options) {
+        session->options = *options;
+    } else {
+        fetch_options_init(&session->options);
+    }
+
+    // Clamp concurrency and batch size to something sensible
+    if (session->options.concurrency < 1) {
+        session->options.concurrency = 1;
+    }
+    if (session->options.concurrency > MAX_FETCH_CONCURRENCY) {
+        session->options.concurrency = MAX_FETCH_CONCURRENCY;
+    }
+    if (session->options.batch_size < 1) {
+        session->options.batch_size = 1;
+    }
+    if (session->options.batch_size > MAX_FETCH_BATCH_SIZE) {
+        session->options.batch_size = MAX_FETCH_BATCH_SIZE;
+    }
+
+    cache_init(&session->cache, session->options.cache_ttl);
+    if (session->options.use_cache) {
+        cache_load(&session->cache, session->options.cache_file);
+    }
+    retry_queue_load(&session->retry_queue, session->options.retry_file);
+
+    // Start with a full token bucket
+    session->tokens = session->options.rate_limit > 1.0 ? session->options.rate_limit : 1.0;
+    session->last_refill = fetch_now_seconds();
+    srand((unsigned int)time(NULL));
+
+    session->multi = curl_multi_init();
+    if (!session->multi) {
+        fprintf(stderr, "curl_multi_init() failed\n");
+        return 0;
+    }
+
+    if (session->options.reuse_connections) {
+        // Allow the multi handle to keep one idle connection per in-flight slot
+        curl_multi_setopt(session->multi, CURLMOPT_MAXCONNECTS, (long)session->options.concurrency);
+
+        session->share = curl_share_init();
+        if (session->share) {
+            curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+            curl_share_setopt(session->share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        }
+    }
+
+    return 1;
+}
+
+// Get a configured easy handle, reusing an idle one when allowed
+static CURL* fetch_session_acquire(FetchSession* session) {
+    if (session->options.reuse_connections && session->idle_count > 0) {
+        return session->idle_handles[--session->idle_count];
+    }
+
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        return NULL;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, session->options.connect_timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, session->options.request_timeout_ms);
+
+    if (session->options.reuse_connections) {
+        if (session->share) {
+            curl_easy_setopt(curl, CURLOPT_SHARE, session->share);
+        }
+        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    } else {
+        // Baseline for comparison: every request pays for its own handshake
+        curl_easy_setopt(curl, CURLOPT_FRESH_CONNECT, 1L);
+        curl_easy_setopt(curl, CURLOPT_FORBID_REUSE, 1L);
+    }
+
+    return curl;
+}
+
+// Record timing for a finished request and keep the handle for reuse
+static void fetch_session_release(FetchSession* session, CURL* curl) {
+    curl_off_t total = 0, connect = 0, tls = 0, first_byte = 0;
+    long connects = 0;
+
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &first_byte);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+
+    FetchTiming* timing = &session->timing;
+    timing->requests++;
+    timing->new_connections += connects;
+    timing->total_seconds += total / 1e6;
+    timing->connect_seconds += connect / 1e6;
+    // APPCONNECT is measured from the start, so subtract the TCP part
+    timing->tls_seconds += tls > connect ? (tls - connect) / 1e6 : 0.0;
+    timing->first_byte_seconds += first_byte / 1e6;
+    if (total / 1e6 > timing->max_seconds) {
+        timing->max_seconds = total / 1e6;
+    }
+
+    if (!session->options.reuse_connections) {
+        curl_easy_cleanup(curl);
+        return;
+    }
+
+    if (session->idle_count >= session->idle_capacity) {
+        int new_capacity = session->idle_capacity ? session->idle_capacity * 2 : 8;
+        CURL** new_handles = (CURL**)realloc(session->idle_handles, sizeof(CURL*) * new_capacity);
+        if (!new_handles) {
+            curl_easy_cleanup(curl);
+            return;
+        }
+        session->idle_handles = new_handles;
+        session->idle_capacity = new_capacity;
+    }
+    session->idle_handles[session->idle_count++] = curl;
+}
+
+// Callback function for curl to append response data to the job's buffer
+static size_t fetch_write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t realsize = size * nmemb;
+    FetchJob* job = (FetchJob*)userp;
+
+    char* ptr = realloc(job->body, job->size + realsize + 1);
+    if (!ptr) {
+        printf("Not enough memory (realloc returned NULL)\n");
+        return 0;
+    }
+
+    job->body = ptr;
+    memcpy(&(job->body[job->size]), contents, realsize);
+    job->size += realsize;
+    job->body[job->size] = 0;
+
+    return realsize;
+}
+
+// Print the latency report collected since the session started
+void fetch_session_print_timing(const FetchSession* session) {
+    const FetchTiming* timing = &session->timing;
+    if (timing->requests == 0) {
+        return;
+    }
+
+    double n = (double)timing->requests;
+    printf("\nFetch timing (connection reuse %s):\n", session->options.reuse_connections ? "on" : "off");
+    printf("  Requests:          %d\n", timing->requests);
+    printf("  New connections:   %ld\n", timing->new_connections);
+    printf("  Avg latency:       %.1f ms (max %.1f ms)\n", timing->total_seconds / n * 1000, timing->max_seconds * 1000);
+    printf("  Avg connect:       %.1f ms\n", timing->connect_seconds / n * 1000);
+    printf("  Avg TLS handshake: %.1f ms\n", timing->tls_seconds / n * 1000);
+    printf("  Avg first byte:    %.1f ms\n", timing->first_byte_seconds / n * 1000);
+}
+
+// Release every handle owned by the session and write back the cache
+void fetch_session_free(FetchSession* session) {
+    if (session->options.report_timing) {
+        fetch_session_print_timing(session);
+    }
+
+    if (session->options.use_cache) {
+        if (session->cache.hits + session->cache.misses > 0) {
+            cache_print_stats(&session->cache);
+        }
+        cache_save(&session->cache, session->options.cache_file);
+    }
+    cache_free(&session->cache);
+
+    retry_queue_save(&session->retry_queue, session->options.retry_file);
+    free(session->retry_queue.entries);
+    memset(&session->retry_queue, 0, sizeof(RetryQueue));
+
+    for (int i = 0; i < session->idle_count; i++) {
+        curl_easy_cleanup(session->idle_handles[i]);
+    }
+    free(session->idle_handles);
+    session->idle_handles = NULL;
+    session->idle_count = 0;
+    session->idle_capacity = 0;
+
+    if (session->multi) {
+        curl_multi_cleanup(session->multi);
+        session->multi = NULL;
+    }
+    if (session->share) {
+        curl_share_cleanup(session->share);
+        session->share = NULL;
+    }
+}
+
+// Initialize an empty engine that runs on the given session
+void fetch_engine_init(FetchEngine* engine, FetchSession* session) {
+    engine->session = session;
+    engine->jobs = NULL;
+    engine->job_count = 0;
+    engine->job_capacity = 0;
+    engine->next_job = 0;
+    engine->retries = NULL;
+    engine->retry_count = 0;
+    engine->retry_capacity = 0;
+    engine->retried = 0;
+    engine->aborted = 0;
+}
+
+// Queue a request. May be called from a completion callback to schedule follow-ups.
+int fetch_engine_add(FetchEngine* engine, const char* url, int tag) {
+    if (engine->job_count >= engine->job_capacity) {
+        int new_capacity = engine->job_capacity ? engine->job_capacity * 2 : 16;
+        FetchJob** new_jobs = (FetchJob**)realloc(engine->jobs, sizeof(FetchJob*) * new_capacity);
+        if (!new_jobs) {
+            fprintf(stderr, "Memory allocation failed while queueing fetch job\n");
+            return 0;
+        }
+        engine->jobs = new_jobs;
+        engine->job_capacity = new_capacity;
+    }
+
+    FetchJob* job = (FetchJob*)calloc(1, sizeof(FetchJob));
+    if (!job) {
+        fprintf(stderr, "Memory allocation failed while queueing fetch job\n");
+        return 0;
+    }
+
+    job->url = strdup(url);
+    job->tag = tag;
+    if (!job->url) {
+        free(job);
+        fprintf(stderr, "Memory allocation failed while queueing fetch job\n");
+        return 0;
+    }
+
+    engine->jobs[engine->job_count++] = job;
+    return 1;
+}
+
+// Release a job and its response buffer
+static void fetch_job_free(FetchJob* job) {
+    if (!job) {
+        return;
+    }
+    free(job->url);
+    free(job->body);
+    free(job);
+}
+
+// Point a session handle at the next queued job and attach it to the multi handle
+static int fetch_start_job(FetchSession* session, FetchJob* job, long timeout_ms) {
+    CURL* curl = fetch_session_acquire(session);
+    if (!curl) {
+        return 0;
+    }
+
+    job->attempts++;
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
+    curl_easy_setopt(curl, CURLOPT_URL, job->url);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, fetch_write_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)job);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void*)job);
+
+    if (curl_multi_add_handle(session->multi, curl) != CURLM_OK) {
+        curl_easy_cleanup(curl);
+        return 0;
+    }
+    job->handle = curl;
+    return 1;
+}
+
+// Park a job until its backoff delay has passed
+static int fetch_schedule_retry(FetchEngine* engine, FetchJob* job) {
+    if (engine->retry_count >= engine->retry_capacity) {
+        int new_capacity = engine->retry_capacity ? engine->retry_capacity * 2 : 16;
+        FetchJob** new_retries = (FetchJob**)realloc(engine->retries, sizeof(FetchJob*) * new_capacity);
+        if (!new_retries) {
+            return 0;
+        }
+        engine->retries = new_retries;
+        engine->retry_capacity = new_capacity;
+    }
+    engine->retries[engine->retry_count++] = job;
+    engine->retried++;
+    return 1;
+}
+
+// Pick the next job that may start now: due retries first, then fresh jobs.
+// Lowers *wake to the time the earliest waiting retry becomes due.
+static FetchJob* fetch_next_ready_job(FetchEngine* engine, double now, double* wake) {
+    for (int i = 0; i < engine->retry_count; i++) {
+        FetchJob* job = engine->retries[i];
+        if (job->not_before <= now) {
+            engine->retries[i] = engine->retries[--engine->retry_count];
+            return job;
+        }
+        if (job->not_before < *wake) {
+            *wake = job->not_before;
+        }
+    }
+
+    if (engine->next_job < engine->job_count) {
+        return engine->jobs[engine->next_job++];
+    }
+    return NULL;
+}
+
+// Deadline reached: cancel in-flight transfers and fail everything still queued
+static void fetch_engine_abort(FetchEngine* engine, FetchCompleteFn on_complete, void* context) {
+    FetchSession* session = engine->session;
+    int abandoned = 0;
+
+    engine->aborted = 1;
+
+    for (int i = 0; i < engine->job_count; i++) {
+        FetchJob* job = engine->jobs[i];
+        if (job->handle) {
+            curl_multi_remove_handle(session->multi, job->handle);
+            curl_easy_cleanup(job->handle);
+            job->handle = NULL;
+            abandoned++;
+            on_complete(context, job->tag, 0, 1, 0, 0, NULL, 0);
+        }
+    }
+    for (int i = 0; i < engine->retry_count; i++) {
+        abandoned++;
+        on_complete(context, engine->retries[i]->tag, 0, 1, 0, 0, NULL, 0);
+    }
+    engine->retry_count = 0;
+    while (engine->next_job < engine->job_count) {
+        abandoned++;
+        on_complete(context, engine->jobs[engine->next_job++]->tag, 0, 1, 0, 0, NULL, 0);
+    }
+
+    printf("Run deadline reached: abandoned %d request(s)\n", abandoned);
+}
+
+// Run every queued job with at most `concurrency` transfers in flight, no faster
+// than the session's rate limit, and within the run deadline if one is set.
+// Transient failures are retried with backoff before the caller hears about them.
+// Completions are reported as they arrive, which is not necessarily queue order.
+// Returns the number of jobs that completed successfully.
+int fetch_engine_run(FetchEngine* engine, FetchCompleteFn on_complete, void* context) {
+    FetchSession* session = engine->session;
+    const FetchOptions* options = &session->options;
+    CURLM* multi = session->multi;
+    int in_flight = 0;
+    int succeeded = 0;
+    double deadline = options->deadline_seconds > 0 ? fetch_now_seconds() + options->deadline_seconds : 0;
+
+    while (engine->next_job < engine->job_count || engine->retry_count > 0 || in_flight > 0) {
+        double now = fetch_now_seconds();
+        if (deadline > 0 && now >= deadline) {
+            fetch_engine_abort(engine, on_complete, context);
+            break;
+        }
+
+        // Top up the pipeline while the rate limit allows
+        double wake = now + 1.0;
+        while (in_flight < options->concurrency) {
+            double wait = fetch_token_wait(session, now);
+            if (wait > 0) {
+                if (now + wait < wake) {
+                    wake = now + wait;
+                }
+                break;
+            }
+
+            FetchJob* job = fetch_next_ready_job(engine, now, &wake);
+            if (!job) {
+                break;
+            }
+
+            // Never let a single request outlive the run deadline
+            long timeout_ms = options->request_timeout_ms;
+            if (deadline > 0 && (deadline - now) * 1000 < timeout_ms) {
+                timeout_ms = (long)((deadline - now) * 1000) + 1;
+            }
+
+            fetch_token_take(session);
+            if (fetch_start_job(session, job, timeout_ms)) {
+                in_flight++;
+            } else {
+                fprintf(stderr, "Failed to start request: %s\n", job->url);
+                on_complete(context, job->tag, 0, 1, 0, 0, NULL, 0);
+            }
+        }
+        if (deadline > 0 && deadline < wake) {
+            wake = deadline;
+        }
+
+        int still_running = 0;
+        CURLMcode mc = curl_multi_perform(multi, &still_running);
+        if (mc != CURLM_OK) {
+            fprintf(stderr, "curl_multi_perform() failed: %s\n", curl_multi_strerror(mc));
+            fetch_engine_abort(engine, on_complete, context);
+            break;
+        }
+
+        // Drain completed transfers
+        CURLMsg* msg;
+        int msgs_left;
+        while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+            if (msg->msg != CURLMSG_DONE) {
+                continue;
+            }
+
+            CURL* curl = msg->easy_handle;
+            CURLcode res = msg->data.result;
+            FetchJob* job = NULL;
+            long http_status = 0;
+            curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**)&job);
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_status);
+
+            int ok = (res == CURLE_OK && http_status >= 200 && http_status < 300);
+            if (res != CURLE_OK) {
+                fprintf(stderr, "Request failed (%s): %s\n", job->url, curl_easy_strerror(res));
+            }
+
+            // A server that asks for a longer pause than the backoff ever waits
+            // is left for a later run rather than slept out here
+            curl_off_t retry_after = 0;
+            curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retry_after);
+            int retryable = !ok && fetch_is_retryable(res, http_status);
+            int retry = retryable && retry_after <= BACKOFF_MAX_SECONDS && job->attempts <= options->max_retries;
+            double delay = retry ? fetch_backoff_delay(job->attempts, (long)retry_after) : 0;
+            if (retryable && retry_after > BACKOFF_MAX_SECONDS) {
+                printf("Server asked to wait %ld s; leaving the request for a later run\n", (long)retry_after);
+            }
+
+            curl_multi_remove_handle(multi, curl);
+            fetch_session_release(session, curl);
+            job->handle = NULL;
+            in_flight--;
+
+            if (retry) {
+                free(job->body);
+                job->body = NULL;
+                job->size = 0;
+                job->not_before = fetch_now_seconds() + delay;
+                if (fetch_schedule_retry(engine, job)) {
+                    printf("Retrying request in %.1f s (attempt %d of %d, HTTP %ld)\n",
+                           delay, job->attempts + 1, options->max_retries + 1, http_status);
+                    continue;
+                }
+            }
+
+            if (ok) {
+                succeeded++;
+            }
+            on_complete(context, job->tag, ok, retryable, http_status, retryable ? (long)retry_after : 0,
+                        job->body ? job->body : "", job->size);
+
+            // The response is no longer needed once the caller has seen it
+            free(job->body);
+            job->body = NULL;
+            job->size = 0;
+        }
+
+        // Sleep until there is network activity, a token, a due retry or the deadline
+        now = fetch_now_seconds();
+        int timeout_ms = wake > now ? (int)((wake - now) * 1000) + 1 : 0;
+        if (timeout_ms > 1000) {
+            timeout_ms = 1000;
+        }
+        if (still_running > 0 || timeout_ms > 0) {
+            curl_multi_poll(multi, NULL, 0, timeout_ms, NULL);
+        }
+    }
+
+    return succeeded;
+}
+
+// Free all queued jobs. The session stays alive for further runs.
+void fetch_engine_free(FetchEngine* engine) {
+    for (int i = 0; i < engine->job_count; i++) {
+        fetch_job_free(engine->jobs[i]);
+    }
+    free(engine->jobs);
+    free(engine->retries);
+    engine->jobs = NULL;
+    engine->retries = NULL;
+    engine->retry_count = 0;
+    engine->retry_capacity = 0;
+    engine->job_count = 0;
+    engine->job_capacity = 0;
+    engine->next_job = 0;
+}
@@ -0,0 +1,141 @@
+#ifndef FETCH_H
+#define FETCH_H
+
+#include <stddef.h>
+#include <time.h>
+#include <curl/curl.h>
+#include "cache.h"
+
+#define DEFAULT_API_URL "https://openlibrary.org/api/books"
+#define DEFAULT_FETCH_CONCURRENCY 8
+#define MAX_FETCH_CONCURRENCY 256
+#define DEFAULT_FETCH_BATCH_SIZE 25
+#define MAX_FETCH_BATCH_SIZE 100
+#define DEFAULT_RATE_LIMIT 5.0            // Requests per second, 0 = unlimited
+#define DEFAULT_REQUEST_TIMEOUT_MS 15000
+#define DEFAULT_CONNECT_TIMEOUT_MS 5000
+#define DEFAULT_MAX_RETRIES 4
+#define BACKOFF_BASE_SECONDS 0.5
+#define BACKOFF_MAX_SECONDS 30.0
+#define DEFAULT_RETRY_FILE "bookshelf_retry.tsv"
+
+// Options controlling how metadata is fetched from the API
+typedef struct {
+    const char* api_url;   // Base URL of the books endpoint (overridable for local testing)
+    int concurrency;       // Maximum number of requests in flight at once
+    int batch_size;        // Number of ISBNs packed into one bibkeys request
+    int reuse_connections; // Keep handles, connections, DNS and TLS sessions between requests
+    int report_timing;     // Print a per-request latency report when the session ends
+    int use_cache;         // Answer repeat ISBNs from the on-disk metadata cache
+    long cache_ttl;        // Seconds before a cached answer is refetched
+    const char* cache_file; // Path of the on-disk cache
+    double rate_limit;     // Token bucket refill rate in requests/sec (0 = unlimited)
+    long request_timeout_ms; // Per-request limit on the whole transfer
+    long connect_timeout_ms; // Per-request limit on connection setup
+    double deadline_seconds; // Limit on a whole engine run (0 = none)
+    int max_retries;       // Extra attempts for a transiently failing request
+    int honor_backoff;     // Skip ISBNs whose persistent retry time has not come yet
+    const char* retry_file; // Path of the persistent retry queue
+} FetchOptions;
+
+// Per-request latency totals gathered by a session
+typedef struct {
+    int requests;             // Requests completed
+    long new_connections;     // Connections opened (0 per request when reused)
+    double total_seconds;     // Sum of full request times
+    double max_seconds;       // Slowest request
+    double connect_seconds;   // Sum of DNS + TCP connect times
+    double tls_seconds;       // Sum of TLS handshake times
+    double first_byte_seconds; // Sum of time-to-first-byte
+} FetchTiming;
+
+// An ISBN whose fetch failed transiently and should be tried again later
+typedef struct {
+    char isbn[20];            // Normalized ISBN
+    int attempts;             // Failed runs so far
+    time_t next_attempt_at;   // Earliest time the next run should try it
+    long last_status;         // HTTP status of the last failure (0 = transport error)
+} RetryEntry;
+
+// Persistent retry queue, kept sorted by ISBN for lookups
+typedef struct {
+    RetryEntry* entries;
+    int count;
+    int capacity;
+    int sorted;               // Entries are in ISBN order
+    int dirty;                // Needs to be written back
+} RetryQueue;
+
+// Long-lived fetch session. Owns reusable easy handles, the multi handle and a
+// share handle so DNS lookups, connections and TLS sessions survive between requests,
+// plus the metadata cache consulted before any request is made and the
+// rate limiter and retry queue that pace requests.
+typedef struct {
+    FetchOptions options;
+    CURLM* multi;          // Multi handle used by the concurrent engine
+    CURLSH* share;         // Shared DNS/connection/TLS-session cache
+    CURL** idle_handles;   // Handles ready for the next request
+    int idle_count;
+    int idle_capacity;
+    FetchTiming timing;
+    MetadataCache cache;   // Parsed API answers keyed by normalized ISBN
+    RetryQueue retry_queue; // ISBNs that failed in earlier runs
+    double tokens;         // Requests the token bucket currently allows
+    double last_refill;    // Time the bucket was last topped up
+} FetchSession;
+
+// A single HTTP request queued on the fetch engine
+typedef struct {
+    char* url;             // Request URL (owned by the job)
+    int tag;               // Caller-defined identifier passed back on completion
+    char* body;            // Response body, NUL terminated
+    size_t size;           // Response body size in bytes
+    int attempts;          // Number of times the request has been started
+    double not_before;     // Earliest time the next attempt may start
+    CURL* handle;          // Easy handle while the request is in flight
+} FetchJob;
+
+// Called once per job, in completion order, after any retries. `ok` is 1 if the
+// transfer finished and the server answered with a 2xx status; otherwise
+// `retryable` says whether the failure was transient (timeouts, 429, 5xx, or
+// the run ending first) and worth trying again on a later run, and
+// `retry_after` is how many seconds the server asked to be left alone (0 if
+// it did not say).
+typedef void (*FetchCompleteFn)(void* context, int tag, int ok, int retryable, long http_status,
+                                long retry_after, const char* body, size_t size);
+
+// Concurrent fetch engine built on the curl multi interface
+typedef struct {
+    FetchSession* session; // Session providing handles and options
+    FetchJob** jobs;       // Queue of jobs waiting to be started
+    int job_count;         // Number of jobs in the queue
+    int job_capacity;      // Allocated size of the queue
+    int next_job;          // Index of the next job to start
+    FetchJob** retries;    // Jobs waiting out a backoff delay
+    int retry_count;
+    int retry_capacity;
+    int retried;           // Total retry attempts scheduled
+    int aborted;           // Set when the run deadline (or a curl error) cut the run short
+} FetchEngine;
+
+// Function declarations
+void fetch_options_init(FetchOptions* options);
+double fetch_now_seconds(void);
+
+// Session functions
+int fetch_session_init(FetchSession* session, const FetchOptions* options);
+void fetch_session_print_timing(const FetchSession* session);
+void fetch_session_free(FetchSession* session);
+
+// Engine functions
+void fetch_engine_init(FetchEngine* engine, FetchSession* session);
+int fetch_engine_add(FetchEngine* engine, const char* url, int tag);
+int fetch_engine_run(FetchEngine* engine, FetchCompleteFn on_complete, void* context);
+void fetch_engine_free(FetchEngine* engine);
+
+// Retry queue functions
+const RetryEntry* retry_queue_find(RetryQueue* queue, const char* isbn);
+void retry_queue_record_failure(RetryQueue* queue, const char* isbn, long http_status, long retry_after);
+void retry_queue_remove(RetryQueue* queue, const char* isbn);
+
+#endif // FETCH_H
@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fuzzy.h"
+
+#define FUZZY_PADDED_SIZE (TEXT_MAX_TERM_LENGTH + 4)
+
+// A term of the word index close to one query word
+typedef struct {
+    uint32_t term;
+    int distance;
+} FuzzyTerm;
+
+// The terms close to one query word, and how many postings they hold
+typedef struct {
+    FuzzyTerm* terms;
+    int count;
+    int capacity;
+    size_t postings;
+} FuzzyWord;
+
+// Initialize an empty index
+void fuzzy_index_init(FuzzyIndex* index) {
+    text_index_init(&index->grams);
+    index->term_count = 0;
+}
+
+// Typos allowed in a query word: none in very short words, where one edit
+// turns them into almost anything
+static int fuzzy_word_bound(size_t length) {
+    return length <= 2 ? 0 : length <= 6 ? 1 : 2;
+}
+
+// Edits (insert, delete, replace, or swap two neighbours) turning `a` into
+// `b`, or bound + 1 as soon as it is clear there are more than `bound`.
+// Both strings are terms, so at most TEXT_MAX_TERM_LENGTH bytes.
+static int fuzzy_edit_distance(const char* a, size_t a_length, const char* b, size_t b_length, int bound) {
+    if (a_length > b_length + (size_t)bound || b_length > a_length + (size_t)bound) {
+        return bound + 1;
+    }
+
+    int rows[3][TEXT_MAX_TERM_LENGTH + 1];
+    int* before = rows[0];
+    int* previous = rows[1];
+    int* current = rows[2];
+    for (size_t j = 0; j <= b_length; j++) {
+        previous[j] = (int)j;
+    }
+
+    for (size_t i = 1; i <= a_length; i++) {
+        current[0] = (int)i;
+        int row_min = current[0];
+        for (size_t j = 1; j <= b_length; j++) {
+            int best = previous[j - 1] + (a[i - 1] != b[j - 1]);
+            if (previous[j] + 1 < best) {
+                best = previous[j] + 1;
+            }
+            if (current[j - 1] + 1 < best) {
+                best = current[j - 1] + 1;
+            }
+            if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1] && before[j - 2] + 1 < best) {
+                best = before[j - 2] + 1;
+            }
+            current[j] = best;
+            if (best < row_min) {
+                row_min = best;
+            }
+        }
+        if (row_min > bound) {
+            return bound + 1;
+        }
+        int* spare = before;
+        before = previous;
+        previous = current;
+        current = spare;
+    }
+    return previous[b_length] > bound ? bound + 1 : previous[b_length];
+}
+
+// Pad a term with two '$' at each end, so its first and last letters start
+// and end trigrams of their own. Returns the number of trigrams.
+static size_t fuzzy_pad(const char* term, size_t length, char* padded) {
+    padded[0] = '$';
+    padded[1] = '$';
+    memcpy(padded + 2, term, length);
+    padded[length + 2] = '$';
+    padded[length + 3] = '$';
+    return length + 2;
+}
+
+// Split the terms the word index gained since the last search into trigrams
+static int fuzzy_index_sync(FuzzyIndex* index, const TextIndex* words) {
+    char padded[FUZZY_PADDED_SIZE];
+    for (; index->term_count < words->list_count; index->term_count++) {
+        size_t length = words->lists[index->term_count].term.length;
+        size_t gram_count = fuzzy_pad(text_index_term(words, index->term_count), length, padded);
+        for (size_t i = 0; i < gram_count; i++) {
+            if (!text_index_add_term(&index->grams, padded + i, 3, index->term_count)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+// Add a close term to a query word's list
+static int fuzzy_word_add(FuzzyWord* word, uint32_t term, int distance, size_t postings) {
+    if (word->count == word->capacity) {
+        int capacity = word->capacity ? word->capacity * 2 : 16;
+        FuzzyTerm* terms = (FuzzyTerm*)realloc(word->terms, sizeof(FuzzyTerm) * capacity);
+        if (!terms) {
+            fprintf(stderr, "Memory allocation failed during fuzzy search\n");
+            return 0;
+        }
+        word->terms = terms;
+        word->capacity = capacity;
+    }
+    word->terms[word->count].term = term;
+    word->terms[word->count].distance = distance;
+    word->count++;
+    word->postings += postings;
+    return 1;
+}
+
+// qsort order for term ids
+static int compare_term_ids(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Whether a sorted list holds a value
+static int sorted_contains(const uint32_t* values, uint32_t count, uint32_t value) {
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (values[middle] < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < count && values[low] == value;
+}
+
+// Put the closest terms first, so the first list a book turns up in gives its distance
+static void fuzzy_sort_terms(FuzzyWord* found) {
+    for (int i = 1; i < found->count; i++) {
+        FuzzyTerm term = found->terms[i];
+        int j = i;
+        for (; j > 0 && found->terms[j - 1].distance > term.distance; j--) {
+            found->terms[j] = found->terms[j - 1];
+        }
+        found->terms[j] = term;
+    }
+}
+
+// Compare a query word with every term of about its length. Only used when
+// the word has too few distinct trigrams for the count filter to help.
+static int fuzzy_scan_terms(const TextIndex* words, const char* word, size_t length, int bound, FuzzyWord* found) {
+    for (uint32_t term = 0; term < words->list_count; term++) {
+        const PostingList* postings = &words->lists[term];
+        size_t term_length = postings->term.length;
+        if (postings->count == 0 || term_length + (size_t)bound < length || term_length > length + (size_t)bound) {
+            continue;
+        }
+        int distance = fuzzy_edit_distance(word, length, text_index_term(words, term), term_length, bound);
+        if (distance <= bound && !fuzzy_word_add(found, term, distance, postings->count)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Find the terms within the allowed typos of a query word. An edit breaks at
+// most four trigrams (a swap of two letters; other edits break three), so a
+// term within k edits shares all but 4k of the word's distinct trigrams and
+// only terms reaching that count are compared in full. Terms are gathered
+// from the shortest lists that a qualifying term cannot avoid all of; the
+// longer lists are probed for those candidates alone.
+static int fuzzy_find_terms(const FuzzyIndex* index, const TextIndex* words, const char* word, size_t length,
+                            FuzzyWord* found) {
+    int bound = fuzzy_word_bound(length);
+    if (bound == 0) {
+        const PostingList* list = text_index_list(words, word, length);
+        if (list && list->count > 0) {
+            return fuzzy_word_add(found, (uint32_t)(list - words->lists), 0, list->count);
+        }
+        return 1;
+    }
+
+    // Distinct trigrams of the padded word, shortest list first
+    char padded[FUZZY_PADDED_SIZE];
+    size_t padded_grams = fuzzy_pad(word, length, padded);
+    const PostingList* lists[TEXT_MAX_TERM_LENGTH + 2];
+    uint32_t sizes[TEXT_MAX_TERM_LENGTH + 2];
+    int gram_count = 0;
+    for (size_t i = 0; i < padded_grams; i++) {
+        int repeated = 0;
+        for (size_t j = 0; j < i; j++) {
+            repeated |= memcmp(padded + i, padded + j, 3) == 0;
+        }
+        if (repeated) {
+            continue;
+        }
+        const PostingList* list = text_index_list(&index->grams, padded + i, 3);
+        uint32_t size = list ? list->count : 0;
+        int k = gram_count++;
+        for (; k > 0 && sizes[k - 1] > size; k--) {
+            lists[k] = lists[k - 1];
+            sizes[k] = sizes[k - 1];
+        }
+        lists[k] = list;
+        sizes[k] = size;
+    }
+
+    int needed = gram_count - 4 * bound;
+    if (needed < 1) {
+        int ok = fuzzy_scan_terms(words, word, length, bound, found);
+        fuzzy_sort_terms(found);
+        return ok;
+    }
+    int gathered = gram_count - needed + 1;
+
+    size_t candidate_count = 0;
+    for (int i = 0; i < gathered; i++) {
+        candidate_count += sizes[i];
+    }
+    if (candidate_count == 0) {
+        return 1;
+    }
+    uint32_t* candidates = (uint32_t*)malloc(sizeof(uint32_t) * candidate_count);
+    if (!candidates) {
+        fprintf(stderr, "Memory allocation failed during fuzzy search\n");
+        return 0;
+    }
+    candidate_count = 0;
+    for (int i = 0; i < gathered; i++) {
+        if (sizes[i] > 0) {
+            memcpy(candidates + candidate_count, lists[i]->slots, sizeof(uint32_t) * sizes[i]);
+            candidate_count += sizes[i];
+        }
+    }
+    qsort(candidates, candidate_count, sizeof(uint32_t), compare_term_ids);
+
+    int ok = 1;
+    for (size_t i = 0; i < candidate_count && ok;) {
+        uint32_t term = candidates[i];
+        int shared = 0;
+        for (; i < candidate_count && candidates[i] == term; i++) {
+            shared++;
+        }
+        for (int g = gathered; g < gram_count && shared < needed; g++) {
+            shared += sorted_contains(lists[g]->slots, sizes[g], term);
+        }
+        const PostingList* postings = &words->lists[term];
+        if (shared < needed || postings->count == 0) {
+            continue;
+        }
+        int distance = fuzzy_edit_distance(word, length, text_index_term(words, term), postings->term.length, bound);
+        if (distance <= bound) {
+            ok = fuzzy_word_add(found, term, distance, postings->count);
+        }
+    }
+    free(candidates);
+    fuzzy_sort_terms(found);
+    return ok;
+}
+
+// Keep a match if it is among the `max_matches` closest so far. `matches`
+// holds `*shown` of them, fewest typos first and then in library order.
+static void fuzzy_keep_closest(FuzzyMatch* matches, int* shown, int max_matches, FuzzyMatch match) {
+    int j = *shown;
+    if (j == max_matches) {
+        if (j == 0 || matches[j - 1].distance < match.distance ||
+            (matches[j - 1].distance == match.distance && matches[j - 1].slot < match.slot)) {
+            return;
+        }
+        j--; // Replaces the furthest
+    } else {
+        (*shown)++;
+    }
+    for (; j > 0 && (matches[j - 1].distance > match.distance ||
+                     (matches[j - 1].distance == match.distance && matches[j - 1].slot > match.slot)); j--) {
+        matches[j] = matches[j - 1];
+    }
+    matches[j] = match;
+}
+
+// Find the books that have a close term for every query word and rank them.
+// The word with the fewest books picks the candidates; the others narrow them.
+static int fuzzy_rank_books(const TextIndex* words, FuzzyWord* query_words, int word_count, uint32_t slot_count,
+                            FuzzyMatch* matches, int max_matches) {
+    for (int i = 1; i < word_count; i++) {
+        FuzzyWord word = query_words[i];
+        int j = i;
+        for (; j > 0 && query_words[j - 1].postings > word.postings; j--) {
+            query_words[j] = query_words[j - 1];
+        }
+        query_words[j] = word;
+    }
+
+    // matched[slot] counts the query words a book has matched so far;
+    // distance[slot] sums their typos
+    unsigned char* matched = (unsigned char*)calloc(slot_count, 1);
+    unsigned char* distance = (unsigned char*)malloc(slot_count);
+    uint32_t* books = (uint32_t*)malloc(sizeof(uint32_t) * query_words[0].postings);
+    if (!matched || !distance || !books) {
+        fprintf(stderr, "Memory allocation failed during fuzzy search\n");
+        free(matched);
+        free(distance);
+        free(books);
+        return -1;
+    }
+
+    uint32_t book_count = 0;
+    for (int t = 0; t < query_words[0].count; t++) {
+        const PostingList* list = &words->lists[query_words[0].terms[t].term];
+        for (uint32_t i = 0; i < list->count; i++) {
+            uint32_t slot = list->slots[i];
+            if (!matched[slot]) {
+                matched[slot] = 1;
+                distance[slot] = (unsigned char)query_words[0].terms[t].distance;
+                books[book_count++] = slot;
+            }
+        }
+    }
+
+    for (int w = 1; w < word_count && book_count > 0; w++) {
+        const FuzzyWord* word = &query_words[w];
+        // Walk the word's lists, or look each candidate up in them, whichever touches less
+        if (word->postings <= (size_t)book_count * word->count * 16) {
+            for (int t = 0; t < word->count; t++) {
+                const PostingList* list = &words->lists[word->terms[t].term];
+                for (uint32_t i = 0; i < list->count; i++) {
+                    uint32_t slot = list->slots[i];
+                    if (matched[slot] == w) {
+                        matched[slot] = (unsigned char)(w + 1);
+                        distance[slot] = (unsigned char)(distance[slot] + word->terms[t].distance);
+                    }
+                }
+            }
+        } else {
+            for (uint32_t b = 0; b < book_count; b++) {
+                uint32_t slot = books[b];
+                for (int t = 0; t < word->count; t++) {
+                    const PostingList* list = &words->lists[word->terms[t].term];
+                    if (sorted_contains(list->slots, list->count, slot)) {
+                        matched[slot] = (unsigned char)(w + 1);
+                        distance[slot] = (unsigned char)(distance[slot] + word->terms[t].distance);
+                        break;
+                    }
+                }
+            }
+        }
+
+        uint32_t kept = 0;
+        for (uint32_t b = 0; b < book_count; b++) {
+            if (matched[books[b]] == w + 1) {
+                books[kept++] = books[b];
+            }
+        }
+        book_count = kept;
+    }
+
+    int shown = 0;
+    for (uint32_t b = 0; b < book_count; b++) {
+        FuzzyMatch match;
+        match.slot = books[b];
+        match.distance = distance[match.slot];
+        fuzzy_keep_closest(matches, &shown, max_matches, match);
+    }
+    free(matched);
+    free(distance);
+    free(books);
+    return (int)book_count;
+}
+
+// Find the books where every word of `query` is within a few typos of a word
+// of the title or author (see fuzzy_word_bound). The `max_matches` closest,
+// fewest typos first and then in library order, are written to `matches`.
+// Returns the total number of books found, or -1 if memory runs out.
+int fuzzy_search(FuzzyIndex* index, const TextIndex* words, uint32_t slot_count, const char* query,
+                 FuzzyMatch* matches, int max_matches) {
+    if (!fuzzy_index_sync(index, words)) {
+        return -1;
+    }
+
+    FuzzyWord query_words[TEXT_MAX_QUERY_TERMS];
+    int word_count = 0;
+    int all_found = 1;
+    int ok = 1;
+    char term[TEXT_MAX_TERM_LENGTH + 1];
+    size_t length;
+    while (ok && all_found && word_count < TEXT_MAX_QUERY_TERMS && (length = text_next_term(&query, term)) > 0) {
+        FuzzyWord* word = &query_words[word_count++];
+        memset(word, 0, sizeof(FuzzyWord));
+        ok = fuzzy_find_terms(index, words, term, length, word);
+        all_found = word->count > 0;
+    }
+
+    int result = ok ? 0 : -1;
+    if (ok && all_found && word_count > 0) {
+        result = fuzzy_rank_books(words, query_words, word_count, slot_count, matches, max_matches);
+    }
+    for (int i = 0; i < word_count; i++) {
+        free(query_words[i].terms);
+    }
+    return result;
+}
+
+// Drop every trigram; the next search splits the whole vocabulary again
+void fuzzy_index_clear(FuzzyIndex* index) {
+    text_index_clear(&index->grams);
+    index->term_count = 0;
+}
+
+// Bytes allocated for the trigram index
+size_t fuzzy_index_memory(const FuzzyIndex* index) {
+    return text_index_memory(&index->grams);
+}
+
+// Free the index
+void fuzzy_index_free(FuzzyIndex* index) {
+    text_index_free(&index->grams);
+    index->term_count = 0;
+}
@@ -0,0 +1,35 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "text_index.h"
+
+#define FUZZY_DEFAULT_RESULTS 10   // Books shown by search --fuzzy
+#define FUZZY_MAX_RESULTS 100
+
+// A book found by a fuzzy search
+typedef struct {
+    uint32_t slot;
+    int distance;         // Typos summed over the query words
+} FuzzyMatch;
+
+// Trigram index over the vocabulary of a word index. Each term is padded with
+// "$$" at both ends, and every three-byte window maps to the ids (positions in
+// the word index's lists) of the terms containing it. The word index keeps
+// books in step on add and delete; new terms are split into trigrams when the
+// next search starts.
+typedef struct {
+    TextIndex grams;        // Trigram -> sorted term ids
+    uint32_t term_count;    // Terms of the word index split so far
+} FuzzyIndex;
+
+// Function declarations
+void fuzzy_index_init(FuzzyIndex* index);
+int fuzzy_search(FuzzyIndex* index, const TextIndex* words, uint32_t slot_count, const char* query,
+                 FuzzyMatch* matches, int max_matches);
+void fuzzy_index_clear(FuzzyIndex* index);
+size_t fuzzy_index_memory(const FuzzyIndex* index);
+void fuzzy_index_free(FuzzyIndex* index);
+
+#endif // FUZZY_H
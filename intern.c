@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "intern.h"
+
+#define INTERN_INITIAL_SLOTS 64
+
+// Initialize an empty table
+void intern_init(InternTable* table) {
+    memset(table, 0, sizeof(InternTable));
+}
+
+// Find the slot holding this string, or the free slot where it would go
+static uint32_t intern_find_slot(const InternTable* table, const StringArena* arena,
+                                 const char* value, size_t length, uint32_t hash) {
+    uint32_t mask = table->slot_count - 1;
+    uint32_t slot = hash & mask;
+
+    while (table->slots[slot] != INTERN_EMPTY) {
+        uint32_t id = table->slots[slot];
+        StrRef ref = table->values[id];
+        if (table->hashes[id] == hash && ref.length == length &&
+            memcmp(arena->data + ref.offset, value, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Double the hash table and reinsert every ID
+static int intern_grow_slots(InternTable* table) {
+    uint32_t new_slot_count = table->slot_count ? table->slot_count * 2 : INTERN_INITIAL_SLOTS;
+    uint32_t* new_slots = (uint32_t*)calloc(new_slot_count, sizeof(uint32_t));
+    if (!new_slots) {
+        fprintf(stderr, "Memory allocation failed while growing intern table\n");
+        return 0;
+    }
+
+    uint32_t mask = new_slot_count - 1;
+    for (uint32_t id = 1; id < table->count; id++) {
+        uint32_t slot = table->hashes[id] & mask;
+        while (new_slots[slot] != INTERN_EMPTY) {
+            slot = (slot + 1) & mask;
+        }
+        new_slots[slot] = id;
+    }
+
+    free(table->slots);
+    table->slots = new_slots;
+    table->slot_count = new_slot_count;
+    return 1;
+}
+
+// Make room for one more ID in the value arrays and the hash table
+static int intern_reserve(InternTable* table) {
+    // Keep the table at most 70% full
+    if ((uint64_t)(table->count + 1) * 10 > (uint64_t)table->slot_count * 7 && !intern_grow_slots(table)) {
+        return 0;
+    }
+
+    if (table->count >= table->capacity) {
+        uint32_t new_capacity = table->capacity ? table->capacity * 2 : INTERN_INITIAL_SLOTS;
+        StrRef* new_values = (StrRef*)realloc(table->values, sizeof(StrRef) * new_capacity);
+        if (!new_values) {
+            fprintf(stderr, "Memory allocation failed while growing intern table\n");
+            return 0;
+        }
+        table->values = new_values;
+
+        uint32_t* new_hashes = (uint32_t*)realloc(table->hashes, sizeof(uint32_t) * new_capacity);
+        if (!new_hashes) {
+            fprintf(stderr, "Memory allocation failed while growing intern table\n");
+            return 0;
+        }
+        table->hashes = new_hashes;
+        table->capacity = new_capacity;
+    }
+
+    if (table->count == 0) {
+        // ID 0 is reserved for the empty string
+        StrRef empty = {0, 0};
+        table->values[0] = empty;
+        table->hashes[0] = 0;
+        table->count = 1;
+    }
+    return 1;
+}
+
+// Return the ID of the string just written at the end of the arena (after
+// arena_prepare). A string seen before is dropped from the arena again; a new
+// one is kept and given the next ID. Returns INTERN_EMPTY for "" or on
+// allocation failure.
+uint32_t intern_commit(InternTable* table, StringArena* arena, size_t length) {
+    if (length == 0 || !intern_reserve(table)) {
+        return INTERN_EMPTY;
+    }
+
+    const char* value = arena->data + arena->size;
+    uint32_t hash = arena_hash(value, length);
+    uint32_t slot = intern_find_slot(table, arena, value, length, hash);
+    if (table->slots[slot] != INTERN_EMPTY) {
+        return table->slots[slot];
+    }
+
+    uint32_t id = table->count++;
+    table->values[id] = arena_commit(arena, length);
+    table->hashes[id] = hash;
+    table->slots[slot] = id;
+    return id;
+}
+
+// Return the ID of a string, adding it to the arena if it is new
+uint32_t intern_add(InternTable* table, StringArena* arena, const char* value, size_t length) {
+    if (length == 0) {
+        return INTERN_EMPTY;
+    }
+
+    // Look it up first so repeats never touch the arena
+    uint32_t id = intern_find(table, arena, value, length);
+    if (id != INTERN_NOT_FOUND) {
+        return id;
+    }
+
+    char* dest = arena_prepare(arena, length);
+    if (!dest) {
+        return INTERN_EMPTY;
+    }
+    memcpy(dest, value, length);
+    return intern_commit(table, arena, length);
+}
+
+// Look up a string without adding it. Returns INTERN_NOT_FOUND if it has no ID.
+uint32_t intern_find(const InternTable* table, const StringArena* arena, const char* value, size_t length) {
+    if (length == 0) {
+        return INTERN_EMPTY;
+    }
+    if (table->slot_count == 0) {
+        return INTERN_NOT_FOUND;
+    }
+
+    uint32_t slot = intern_find_slot(table, arena, value, length, arena_hash(value, length));
+    return table->slots[slot] != INTERN_EMPTY ? table->slots[slot] : INTERN_NOT_FOUND;
+}
+
+// The arena reference of an ID's string
+StrRef intern_ref(const InternTable* table, uint32_t id) {
+    StrRef empty = {0, 0};
+    return id < table->count ? table->values[id] : empty;
+}
+
+// Free the table (the strings stay in their arena)
+void intern_free(InternTable* table) {
+    free(table->values);
+    free(table->hashes);
+    free(table->slots);
+    intern_init(table);
+}
@@ -0,0 +1,31 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define INTERN_EMPTY 0                  // ID of the empty string in every table
+#define INTERN_NOT_FOUND UINT32_MAX     // intern_find result for unknown strings
+
+// Dictionary of distinct strings, each given a small integer ID in the order
+// first seen. The strings themselves live in a StringArena shared with the
+// caller; the table holds their references and an open-addressing index.
+typedef struct {
+    StrRef* values;       // String of each ID; values[INTERN_EMPTY] is ""
+    uint32_t* hashes;     // Hash of each ID's string, kept for rehashing
+    uint32_t count;       // IDs in use, the empty string included
+    uint32_t capacity;    // Allocated size of values and hashes
+    uint32_t* slots;      // Hash table of IDs (INTERN_EMPTY = free slot)
+    uint32_t slot_count;  // Size of the hash table (power of two)
+} InternTable;
+
+// Function declarations
+void intern_init(InternTable* table);
+uint32_t intern_add(InternTable* table, StringArena* arena, const char* value, size_t length);
+uint32_t intern_commit(InternTable* table, StringArena* arena, size_t length);
+uint32_t intern_find(const InternTable* table, const StringArena* arena, const char* value, size_t length);
+StrRef intern_ref(const InternTable* table, uint32_t id);
+void intern_free(InternTable* table);
+
+#endif // INTERN_H
@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "isbn.h"
+
+#define ISBN_INDEX_INITIAL_ENTRIES 64
+
+// Collect the digits of an ISBN into `digits` (an X check digit becomes 10).
+// Strict parsing only allows hyphens and spaces between the digits; otherwise
+// anything that is not a digit is skipped. Returns the digit count, or -1 if
+// the string cannot be an ISBN.
+static int isbn_digits(const char* isbn, size_t length, int strict, int digits[13]) {
+    int count = 0;
+    for (size_t i = 0; i < length; i++) {
+        char c = isbn[i];
+        if (c >= '0' && c <= '9') {
+            if (count == 13) {
+                return -1;
+            }
+            digits[count++] = c - '0';
+        } else if ((c == 'X' || c == 'x') && count == 9) {
+            digits[count++] = 10;
+        } else if (strict && c != '-' && c != ' ') {
+            return -1;
+        }
+    }
+
+    // X is only a check digit, so it must be the last of ten
+    if (count == 10 || count == 13) {
+        for (int i = 0; i < count - 1; i++) {
+            if (digits[i] == 10) {
+                return -1;
+            }
+        }
+        if (count == 13 && digits[12] == 10) {
+            return -1;
+        }
+        return count;
+    }
+    return -1;
+}
+
+// Whether the check digit of an ISBN-10 (weights 10..1, mod 11) or an
+// ISBN-13 (weights 1,3,1,3..., mod 10, 978/979 prefix) is right
+static int isbn_check_digit_ok(const int* digits, int count) {
+    int sum = 0;
+    if (count == 10) {
+        for (int i = 0; i < 10; i++) {
+            sum += digits[i] * (10 - i);
+        }
+        return sum % 11 == 0;
+    }
+    if (digits[0] != 9 || digits[1] != 7 || (digits[2] != 8 && digits[2] != 9)) {
+        return 0;
+    }
+    for (int i = 0; i < 13; i++) {
+        sum += digits[i] * (i % 2 == 0 ? 1 : 3);
+    }
+    return sum % 10 == 0;
+}
+
+// Pack digits into the ISBN-13 key. An ISBN-10 gets the 978 prefix and a
+// recomputed check digit, so both forms of a book share a key.
+static uint64_t isbn_pack(const int* digits, int count) {
+    uint64_t key = 0;
+    if (count == 13) {
+        for (int i = 0; i < 13; i++) {
+            key = key * 10 + (uint64_t)digits[i];
+        }
+        return key;
+    }
+
+    int sum = 9 + 7 * 3 + 8;  // weights 1,3,1 for the 9,7,8 prefix
+    key = 978;
+    for (int i = 0; i < 9; i++) {
+        sum += digits[i] * ((i + 3) % 2 == 0 ? 1 : 3);
+        key = key * 10 + (uint64_t)digits[i];
+    }
+    return key * 10 + (uint64_t)((10 - sum % 10) % 10);
+}
+
+// Canonical key of an ISBN-10 or ISBN-13 typed or scanned by the user:
+// hyphens and spaces are dropped and the check digit must be right.
+// Returns ISBN_KEY_NONE if the string is not a valid ISBN.
+uint64_t isbn_key(const char* isbn, size_t length) {
+    int digits[13];
+    int count = isbn_digits(isbn, length, 1, digits);
+    if (count < 0 || !isbn_check_digit_ok(digits, count)) {
+        return ISBN_KEY_NONE;
+    }
+    return isbn_pack(digits, count);
+}
+
+// Canonical key of an ISBN already stored somewhere (a library, a dump),
+// where a wrong check digit or stray characters should not stop a match.
+// Returns ISBN_KEY_NONE if there are not 10 or 13 digits.
+uint64_t isbn_key_unchecked(const char* isbn, size_t length) {
+    int digits[13];
+    int count = isbn_digits(isbn, length, 0, digits);
+    return count < 0 ? ISBN_KEY_NONE : isbn_pack(digits, count);
+}
+
+// Write the 13 digits of a key to `text` (ISBN_TEXT_SIZE bytes)
+void isbn_format(uint64_t key, char* text) {
+    for (int i = 12; i >= 0; i--) {
+        text[i] = (char)('0' + key % 10);
+        key /= 10;
+    }
+    text[13] = '\0';
+}
+
+// Mix a key into a table position (the finalizer of MurmurHash3)
+uint32_t isbn_hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+// Initialize an empty index
+void isbn_index_init(IsbnIndex* index) {
+    memset(index, 0, sizeof(IsbnIndex));
+}
+
+// Put an entry in the first free place of its probe sequence
+static void isbn_index_place(IsbnIndex* index, const IsbnEntry* entry) {
+    uint32_t mask = index->entry_count - 1;
+    uint32_t position = isbn_hash(entry->key) & mask;
+    while (index->entries[position].slot != ISBN_INDEX_EMPTY) {
+        position = (position + 1) & mask;
+    }
+    index->entries[position] = *entry;
+}
+
+// Make room for `count` entries in total, keeping the table at most 70% full
+int isbn_index_reserve(IsbnIndex* index, uint32_t count) {
+    uint32_t entry_count = index->entry_count ? index->entry_count : ISBN_INDEX_INITIAL_ENTRIES;
+    while ((uint64_t)count * 10 > (uint64_t)entry_count * 7) {
+        entry_count *= 2;
+    }
+    if (entry_count == index->entry_count) {
+        return 1;
+    }
+
+    IsbnEntry* entries = (IsbnEntry*)malloc(sizeof(IsbnEntry) * entry_count);
+    if (!entries) {
+        fprintf(stderr, "Memory allocation failed while growing ISBN index\n");
+        return 0;
+    }
+    for (uint32_t i = 0; i < entry_count; i++) {
+        entries[i].slot = ISBN_INDEX_EMPTY;
+    }
+
+    IsbnEntry* old_entries = index->entries;
+    uint32_t old_count = index->entry_count;
+    index->entries = entries;
+    index->entry_count = entry_count;
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (old_entries[i].slot != ISBN_INDEX_EMPTY) {
+            isbn_index_place(index, &old_entries[i]);
+        }
+    }
+    free(old_entries);
+    return 1;
+}
+
+// Index the book in `slot` under its ISBN key
+int isbn_index_add(IsbnIndex* index, uint64_t key, int slot) {
+    if (!isbn_index_reserve(index, index->count + 1)) {
+        return 0;
+    }
+
+    IsbnEntry entry;
+    entry.key = key;
+    entry.slot = slot;
+    isbn_index_place(index, &entry);
+    index->count++;
+    return 1;
+}
+
+// Drop the entry of the book in `slot`. Later entries of the same probe run
+// are shifted back so lookups never stop early at the hole.
+void isbn_index_remove(IsbnIndex* index, uint64_t key, int slot) {
+    if (index->count == 0) {
+        return;
+    }
+
+    uint32_t mask = index->entry_count - 1;
+    uint32_t position = isbn_hash(key) & mask;
+    while (index->entries[position].slot != slot) {
+        if (index->entries[position].slot == ISBN_INDEX_EMPTY) {
+            return;
+        }
+        position = (position + 1) & mask;
+    }
+
+    uint32_t hole = position;
+    for (;;) {
+        position = (position + 1) & mask;
+        const IsbnEntry* entry = &index->entries[position];
+        if (entry->slot == ISBN_INDEX_EMPTY) {
+            break;
+        }
+        // An entry may fill the hole only if the hole lies between its home
+        // position and where it sits now
+        uint32_t home = isbn_hash(entry->key) & mask;
+        if (((position - home) & mask) >= ((position - hole) & mask)) {
+            index->entries[hole] = *entry;
+            hole = position;
+        }
+    }
+    index->entries[hole].slot = ISBN_INDEX_EMPTY;
+    index->count--;
+}
+
+// Find every book with this ISBN key. Up to `max_slots` of their slots are
+// written to `slots`, in no particular order; the return value is the total
+// number of matches, which may be larger.
+int isbn_index_find(const IsbnIndex* index, uint64_t key, int* slots, int max_slots) {
+    if (index->count == 0 || key == ISBN_KEY_NONE) {
+        return 0;
+    }
+
+    uint32_t mask = index->entry_count - 1;
+    int matches = 0;
+    for (uint32_t position = isbn_hash(key) & mask; index->entries[position].slot != ISBN_INDEX_EMPTY;
+         position = (position + 1) & mask) {
+        const IsbnEntry* entry = &index->entries[position];
+        if (entry->key == key) {
+            if (matches < max_slots) {
+                slots[matches] = entry->slot;
+            }
+            matches++;
+        }
+    }
+    return matches;
+}
+
+// Drop every entry, keeping the table
+void isbn_index_clear(IsbnIndex* index) {
+    for (uint32_t i = 0; i < index->entry_count; i++) {
+        index->entries[i].slot = ISBN_INDEX_EMPTY;
+    }
+    index->count = 0;
+}
+
+// Bytes allocated for the table
+size_t isbn_index_memory(const IsbnIndex* index) {
+    return sizeof(IsbnEntry) * (size_t)index->entry_count;
+}
+
+// Free the table
+void isbn_index_free(IsbnIndex* index) {
+    free(index->entries);
+    isbn_index_init(index);
+}
@@ -0,0 +1,41 @@
+#ifndef ISBN_H
+#define ISBN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ISBN_KEY_NONE 0        // Key of something that is not an ISBN
+#define ISBN_INDEX_EMPTY -1    // Slot value of a free table entry
+#define ISBN_TEXT_SIZE 14      // 13 digits and the terminator
+
+// One indexed book: the ISBN-13 of its ISBN, as an integer, and its library slot
+typedef struct {
+    uint64_t key;
+    int32_t slot;         // Library slot, or ISBN_INDEX_EMPTY
+} IsbnEntry;
+
+// Open-addressing (linear probing) hash index from ISBN key to library slots.
+// Books sharing an ISBN each get their own entry, so a lookup returns all of
+// them. Removal shifts later entries back instead of leaving tombstones.
+typedef struct {
+    IsbnEntry* entries;
+    uint32_t entry_count;   // Size of the table (power of two, or 0)
+    uint32_t count;         // Entries in use
+} IsbnIndex;
+
+// Function declarations
+uint64_t isbn_key(const char* isbn, size_t length);
+uint64_t isbn_key_unchecked(const char* isbn, size_t length);
+void isbn_format(uint64_t key, char* text);
+uint32_t isbn_hash(uint64_t key);
+
+void isbn_index_init(IsbnIndex* index);
+int isbn_index_reserve(IsbnIndex* index, uint32_t count);
+int isbn_index_add(IsbnIndex* index, uint64_t key, int slot);
+void isbn_index_remove(IsbnIndex* index, uint64_t key, int slot);
+int isbn_index_find(const IsbnIndex* index, uint64_t key, int* slots, int max_slots);
+void isbn_index_clear(IsbnIndex* index);
+size_t isbn_index_memory(const IsbnIndex* index);
+void isbn_index_free(IsbnIndex* index);
+
+#endif // ISBN_H
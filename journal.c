@@ -0,0 +1,439 @@
+#define _POSIX_C_SOURCE 200809L  // fdatasync, ftruncate and pwrite under -std=c99
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "journal.h"
+#include "crc32.h"
+
+#define JOURNAL_MAGIC "BKJRNL03"    // Deletes leave a free slot (JOURNAL_REMOVE)
+#define JOURNAL_MAGIC_V2 "BKJRNL02" // Deletes move the last book (JOURNAL_DELETE), still replayed
+#define JOURNAL_MAGIC_V1 "BKJRNL01" // As version 2 with 16-bit string lengths, still replayed
+#define JOURNAL_HEADER_SIZE 24  // Magic, snapshot checksum, checksum of the snapshot being folded into
+#define JOURNAL_MAX_RECORD (16 * 1024 * 1024) // Larger length prefixes can only come from corruption
+
+// Little-endian encoding helpers
+static void put_u32(unsigned char* p, uint32_t value) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u64(unsigned char* p, uint64_t value) {
+    put_u32(p, (uint32_t)value);
+    put_u32(p + 4, (uint32_t)(value >> 32));
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+// Size of the snapshot file in bytes (0 if it does not exist)
+static long long snapshot_file_size(const char* snapshot_file) {
+    struct stat st;
+    return stat(snapshot_file, &st) == 0 ? (long long)st.st_size : 0;
+}
+
+// Write all of a buffer, retrying short writes
+static int write_all(int fd, const unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written <= 0) {
+            return 0;
+        }
+        data += written;
+        size -= (size_t)written;
+    }
+    return 1;
+}
+
+// Truncate the journal to a bare header for the given snapshot
+static int journal_write_header(Journal* journal, uint64_t snapshot) {
+    unsigned char header[JOURNAL_HEADER_SIZE];
+    memcpy(header, JOURNAL_MAGIC, 8);
+    put_u64(header + 8, snapshot);
+    put_u64(header + 16, 0);
+
+    if (ftruncate(journal->fd, 0) != 0 || lseek(journal->fd, 0, SEEK_SET) != 0 ||
+        !write_all(journal->fd, header, sizeof(header)) || fdatasync(journal->fd) != 0) {
+        perror("Error writing journal header");
+        return 0;
+    }
+
+    journal->snapshot = snapshot;
+    journal->size = JOURNAL_HEADER_SIZE;
+    journal->records = 0;
+    return 1;
+}
+
+// Encode a length-prefixed string; returns bytes written
+static size_t put_string(unsigned char* p, const char* value) {
+    size_t len = strlen(value);
+    put_u32(p, (uint32_t)len);
+    memcpy(p + 4, value, len);
+    return len + 4;
+}
+
+// Decode a length-prefixed string (16-bit lengths in format 1) into a record
+// field. Returns 0 if it runs past the record.
+static int get_string(const unsigned char** p, const unsigned char* end, int version, char** out) {
+    size_t prefix = version == 1 ? 2 : 4;
+    if ((size_t)(end - *p) < prefix) {
+        return 0;
+    }
+    size_t len = version == 1 ? ((size_t)(*p)[0] | (size_t)(*p)[1] << 8) : get_u32(*p);
+    *p += prefix;
+    if ((size_t)(end - *p) < len) {
+        return 0;
+    }
+    if (len > 0) {
+        book_record_set(out, (const char*)*p, len);
+    }
+    *p += len;
+    return 1;
+}
+
+// Bytes put_book writes for a book
+static size_t book_encoded_size(const BookStrings* strings) {
+    return 4 * 4 + strlen(strings->title) + strlen(strings->author) + strlen(strings->isbn) +
+           strlen(strings->genre) + 20;
+}
+
+// Encode the persistent fields of a book; returns bytes written
+static size_t put_book(unsigned char* p, const Book* book, const BookStrings* strings) {
+    size_t pos = 0;
+    pos += put_string(p + pos, strings->title);
+    pos += put_string(p + pos, strings->author);
+    pos += put_string(p + pos, strings->isbn);
+    pos += put_string(p + pos, strings->genre);
+    put_u32(p + pos, (uint32_t)book->cover_type);
+    put_u32(p + pos + 4, (uint32_t)book->condition);
+    put_u32(p + pos + 8, (uint32_t)book->word_count);
+    put_u32(p + pos + 12, (uint32_t)book->year_published);
+    put_u32(p + pos + 16, (uint32_t)book->metadata_retrieved);
+    return pos + 20;
+}
+
+// Decode a book written by put_book
+static int get_book(const unsigned char** p, const unsigned char* end, int version, BookRecord* book) {
+    if (!get_string(p, end, version, &book->title) ||
+        !get_string(p, end, version, &book->author) ||
+        !get_string(p, end, version, &book->isbn) ||
+        !get_string(p, end, version, &book->genre) ||
+        end - *p < 20) {
+        return 0;
+    }
+    book->cover_type = (CoverType)get_u32(*p);
+    book->condition = (Condition)get_u32(*p + 4);
+    book->word_count = (int)get_u32(*p + 8);
+    book->year_published = (int)get_u32(*p + 12);
+    book->metadata_retrieved = (int)get_u32(*p + 16);
+    *p += 20;
+    return 1;
+}
+
+// Decode one record body (op byte and payload). The record must be freed with
+// book_record_free even when decoding fails.
+static int journal_decode(const unsigned char* body, size_t size, int version, JournalRecord* record) {
+    const unsigned char* p = body + 1;
+    const unsigned char* end = body + size;
+
+    memset(record, 0, sizeof(JournalRecord));
+    record->op = (JournalOp)body[0];
+
+    switch (record->op) {
+        case JOURNAL_ADD:
+            return get_book(&p, end, version, &record->book) && p == end;
+        case JOURNAL_DELETE:
+        case JOURNAL_UPDATE:
+        case JOURNAL_REMOVE:
+            if (end - p < 4) {
+                return 0;
+            }
+            record->index = (int)get_u32(p);
+            p += 4;
+            if (record->op == JOURNAL_UPDATE && !get_book(&p, end, version, &record->book)) {
+                return 0;
+            }
+            return p == end;
+    }
+    return 0;
+}
+
+// Read the whole journal file into memory
+static unsigned char* journal_read_file(int fd, size_t* size) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return NULL;
+    }
+
+    unsigned char* data = (unsigned char*)malloc((size_t)st.st_size + 1);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed while reading journal\n");
+        return NULL;
+    }
+
+    size_t total = 0;
+    while (total < (size_t)st.st_size) {
+        ssize_t got = read(fd, data + total, (size_t)st.st_size - total);
+        if (got <= 0) {
+            break;
+        }
+        total += (size_t)got;
+    }
+    *size = total;
+    return data;
+}
+
+// Move a journal that does not belong to the snapshot out of the way, so its
+// changes are neither applied to the wrong books nor lost, and start a new one
+static int journal_set_aside(Journal* journal, const char* snapshot_file, uint64_t snapshot) {
+    char aside[sizeof(journal->path) + 16];
+    snprintf(aside, sizeof(aside), "%s.unmatched", journal->path);
+    if (access(aside, F_OK) == 0) {
+        printf("Error: Journal %s does not belong to %s, and %s is already taken; leaving it alone.\n",
+               journal->path, snapshot_file, aside);
+        return 0;
+    }
+    if (rename(journal->path, aside) != 0) {
+        perror("Error moving journal aside");
+        return 0;
+    }
+    printf("Error: Journal %s does not belong to %s; its changes have NOT been applied. Moved it to %s.\n",
+           journal->path, snapshot_file, aside);
+
+    close(journal->fd);
+    journal->fd = open(journal->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (journal->fd < 0) {
+        perror("Error opening journal");
+        return 0;
+    }
+    return journal_write_header(journal, snapshot);
+}
+
+// Open (or create) a journal and replay the records that apply to the current
+// snapshot through `apply`. The snapshot is named by a checksum of what is in
+// it (0 when there is none), so copying or touching the file keeps its
+// journal. A journal that was being folded into this very snapshot when the
+// program stopped is emptied; one written for any other snapshot is moved
+// aside rather than applied or thrown away. A torn record at the end, left by
+// a crash during a commit, is cut off. Returns 0 if the journal cannot be used.
+int journal_open(Journal* journal, const char* path, const char* snapshot_file, uint64_t snapshot,
+                 JournalApplyFn apply, void* context) {
+    memset(journal, 0, sizeof(Journal));
+    strncpy(journal->path, path, sizeof(journal->path) - 1);
+
+    journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (journal->fd < 0) {
+        perror("Error opening journal");
+        return 0;
+    }
+    journal->snapshot_size = snapshot_file_size(snapshot_file);
+
+    size_t size = 0;
+    unsigned char* data = journal_read_file(journal->fd, &size);
+    if (!data) {
+        close(journal->fd);
+        journal->fd = -1;
+        return 0;
+    }
+
+    static const char* const magics[] = {JOURNAL_MAGIC_V1, JOURNAL_MAGIC_V2, JOURNAL_MAGIC};
+    int version = 3;
+    for (int v = 1; v < 3; v++) {
+        if (size >= JOURNAL_HEADER_SIZE && memcmp(data, magics[v - 1], 8) == 0) {
+            version = v;
+        }
+    }
+    int valid = size >= JOURNAL_HEADER_SIZE && memcmp(data, magics[version - 1], 8) == 0;
+    int matches = valid && get_u64(data + 8) == snapshot;
+    int folded = valid && snapshot != 0 && get_u64(data + 16) == snapshot;
+
+    if (!matches) {
+        int ok;
+        if (folded) {
+            printf("Journal %s had already been folded into %s; its changes are saved there.\n",
+                   path, snapshot_file);
+            ok = journal_write_header(journal, snapshot);
+        } else if (valid ? size > JOURNAL_HEADER_SIZE : size > 0) {
+            ok = journal_set_aside(journal, snapshot_file, snapshot);
+        } else {
+            ok = journal_write_header(journal, snapshot);
+        }
+        free(data);
+        if (!ok) {
+            if (journal->fd >= 0) {
+                close(journal->fd);
+            }
+            journal->fd = -1;
+            return 0;
+        }
+        return 1;
+    }
+
+    journal->snapshot = snapshot;
+    size_t offset = JOURNAL_HEADER_SIZE;
+    while (size - offset >= 9) {
+        uint32_t body_size = get_u32(data + offset);
+        if (body_size < 1 || body_size > JOURNAL_MAX_RECORD || size - offset - 8 < body_size) {
+            break;
+        }
+
+        const unsigned char* body = data + offset + 4;
+        JournalRecord record;
+        memset(&record, 0, sizeof(JournalRecord));
+        if (get_u32(body + body_size) != crc32_update(0, body, body_size) ||
+            !journal_decode(body, body_size, version, &record)) {
+            book_record_free(&record.book);
+            break;
+        }
+
+        apply(context, &record);
+        book_record_free(&record.book);
+        journal->records++;
+        offset += 8 + body_size;
+    }
+
+    if (offset < size) {
+        printf("Warning: Discarding %zu bytes of incomplete journal records from %s\n", size - offset, path);
+        if (ftruncate(journal->fd, (off_t)offset) != 0) {
+            perror("Error truncating journal");
+        }
+    }
+
+    free(data);
+    journal->size = (long long)offset;
+    lseek(journal->fd, (off_t)offset, SEEK_SET);
+
+    // New records are always written in the current format. An old journal
+    // with records must be compacted first; an empty one is just rewritten.
+    if (version < 3) {
+        if (journal->records > 0) {
+            journal->legacy = 1;
+        } else if (!journal_write_header(journal, snapshot)) {
+            close(journal->fd);
+            journal->fd = -1;
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Buffer a record for the next commit
+int journal_append(Journal* journal, JournalOp op, int index, const Book* book, const BookStrings* strings) {
+    if (journal->fd < 0) {
+        return 0;
+    }
+
+    int has_book = op == JOURNAL_ADD || op == JOURNAL_UPDATE;
+    size_t max_body = 1 + 4 + (has_book ? book_encoded_size(strings) : 0);
+    if (max_body > JOURNAL_MAX_RECORD) {
+        printf("Error: Book is too large for the journal (%zu bytes)\n", max_body);
+        return 0;
+    }
+
+    size_t needed = journal->pending_size + 8 + max_body;
+    if (needed > journal->pending_capacity) {
+        size_t new_capacity = journal->pending_capacity ? journal->pending_capacity * 2 : 4096;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
+        }
+        unsigned char* new_pending = (unsigned char*)realloc(journal->pending, new_capacity);
+        if (!new_pending) {
+            fprintf(stderr, "Memory allocation failed while growing journal buffer\n");
+            return 0;
+        }
+        journal->pending = new_pending;
+        journal->pending_capacity = new_capacity;
+    }
+
+    unsigned char* record = journal->pending + journal->pending_size;
+    unsigned char* body = record + 4;
+    size_t body_size = 1;
+    body[0] = (unsigned char)op;
+    if (op != JOURNAL_ADD) {
+        put_u32(body + body_size, (uint32_t)index);
+        body_size += 4;
+    }
+    if (has_book) {
+        body_size += put_book(body + body_size, book, strings);
+    }
+
+    put_u32(record, (uint32_t)body_size);
+    put_u32(body + body_size, crc32_update(0, body, body_size));
+    journal->pending_size += 8 + body_size;
+    journal->pending_records++;
+    return 1;
+}
+
+// Write every buffered record with one write and one sync
+int journal_commit(Journal* journal) {
+    if (journal->fd < 0 || journal->pending_size == 0) {
+        return 1;
+    }
+
+    if (!write_all(journal->fd, journal->pending, journal->pending_size) || fdatasync(journal->fd) != 0) {
+        perror("Error writing journal");
+        // Drop whatever part of the batch made it out, so the file stays replayable
+        if (ftruncate(journal->fd, (off_t)journal->size) != 0 ||
+            lseek(journal->fd, (off_t)journal->size, SEEK_SET) < 0) {
+            perror("Error rolling back journal");
+        }
+        return 0;
+    }
+
+    journal->size += (long long)journal->pending_size;
+    journal->records += journal->pending_records;
+    journal->pending_size = 0;
+    journal->pending_records = 0;
+    return 1;
+}
+
+// Note in the header which snapshot the journal is about to be folded into,
+// just before that snapshot replaces the current one. If the program stops
+// before journal_reset, the next journal_open sees the changes are saved.
+int journal_mark_folding(Journal* journal, uint64_t next_snapshot) {
+    if (journal->fd < 0) {
+        return 1;
+    }
+
+    unsigned char field[8];
+    put_u64(field, next_snapshot);
+    if (pwrite(journal->fd, field, sizeof(field), 16) != (ssize_t)sizeof(field) || fdatasync(journal->fd) != 0) {
+        perror("Error writing journal header");
+        return 0;
+    }
+    return 1;
+}
+
+// Start an empty journal on top of a freshly written snapshot
+int journal_reset(Journal* journal, const char* snapshot_file, uint64_t snapshot) {
+    if (journal->fd < 0) {
+        return 0;
+    }
+
+    journal->snapshot_size = snapshot_file_size(snapshot_file);
+    journal->pending_size = 0;
+    journal->pending_records = 0;
+    journal->legacy = 0;
+    return journal_write_header(journal, snapshot);
+}
+
+// Commit anything still buffered and close the file
+void journal_close(Journal* journal) {
+    if (journal->fd >= 0) {
+        journal_commit(journal);
+        close(journal->fd);
+    }
+    free(journal->pending);
+    memset(journal, 0, sizeof(Journal));
+    journal->fd = -1;
+}
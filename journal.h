@@ -0,0 +1,54 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "book.h"
+
+#define DEFAULT_JOURNAL_FILE "bookshelf.journal"
+#define JOURNAL_COMPACT_MIN_BYTES (1024 * 1024)  // Never compact a journal smaller than this
+
+// Kinds of change recorded in the journal
+typedef enum {
+    JOURNAL_ADD = 1,      // Append a book
+    JOURNAL_DELETE = 2,   // Delete the book at an index, moving the last book into its place (older journals only)
+    JOURNAL_UPDATE = 3,   // Replace the book at an index
+    JOURNAL_REMOVE = 4    // Delete the book at an index, leaving the slot free for the next add
+} JournalOp;
+
+// One decoded journal record
+typedef struct {
+    JournalOp op;
+    int index;            // Book slot for DELETE, UPDATE and REMOVE
+    BookRecord book;      // Book contents for ADD and UPDATE (freed after the apply callback)
+} JournalRecord;
+
+// Append-only change log. Records are buffered and written together, with a
+// single sync, by journal_commit (group commit).
+typedef struct {
+    int fd;
+    char path[512];
+    uint64_t snapshot;        // Checksum of the snapshot this journal extends (0 = none yet)
+    long long snapshot_size;  // Its size in bytes, for deciding when to compact
+    long long size;           // Committed bytes in the file, header included
+    long records;             // Committed records
+    unsigned char* pending;   // Encoded records waiting for the next commit
+    size_t pending_size;
+    size_t pending_capacity;
+    int pending_records;
+    int legacy;               // Replayed from an older format; compact before appending
+} Journal;
+
+// Called for each intact record while a journal is replayed
+typedef void (*JournalApplyFn)(void* context, const JournalRecord* record);
+
+// Function declarations
+int journal_open(Journal* journal, const char* path, const char* snapshot_file, uint64_t snapshot,
+                 JournalApplyFn apply, void* context);
+int journal_append(Journal* journal, JournalOp op, int index, const Book* book, const BookStrings* strings);
+int journal_commit(Journal* journal);
+int journal_mark_folding(Journal* journal, uint64_t next_snapshot);
+int journal_reset(Journal* journal, const char* snapshot_file, uint64_t snapshot);
+void journal_close(Journal* journal);
+
+#endif // JOURNAL_H
@@ -1,9 +1,16 @@
+#define _POSIX_C_SOURCE 200809L  // sysconf and pthreads under -std=c99
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
 #include <curl/curl.h>  // libcurl for HTTP requests
 #include "library.h"
+#include "csv.h"
+#include "snapshot.h"
 
 /* cJSON implementation */
 #include "cJSON.h"
@@ -11,233 +18,1517 @@
 // Initialize library with dynamic allocation
 void initialize_library(Library* library) {
     library->count = 0;
-    library->capacity = INITIAL_CAPACITY;
-    library->books = (Book*)malloc(sizeof(Book) * library->capacity);
+    library->journal = NULL;
+    library->snapshot_file = DEFAULT_SNAPSHOT_FILE;
+    arena_init(&library->strings);
+    intern_init(&library->authors);
+    intern_init(&library->genres);
+    columns_init(&library->columns);
+    title_index_init(&library->titles);
+    library->titles_indexed = 0;
+    isbn_index_init(&library->isbns);
+    library->isbns_indexed = 0;
+    text_index_init(&library->words);
+    library->words_indexed = 0;
+    fuzzy_index_init(&library->fuzzy);
+    range_index_init(&library->years);
+    range_index_init(&library->word_counts);
+    library->ranges_indexed = 0;
+    for (int i = 0; i < BOOK_BITMAP_COUNT; i++) {
+        bitmap_init(&library->bitmaps[i]);
+    }
+    library->bitmaps_indexed = 0;
+    totals_init(&library->totals);
+    library->columnar = 0;
+    library->free_slots = NULL;
+    library->free_count = 0;
+    library->free_capacity = 0;
+    library->chunks = NULL;
+    library->chunk_count = 0;
+    library->chunk_capacity = 0;
+    library->capacity = 0;
+}
+
+// Make room for at least `capacity` book slots, one chunk at a time. Books
+// already stored never move. Bulk loads reserve up front so they only grow
+// the chunk table once.
+int library_reserve(Library* library, int capacity) {
+    if (capacity <= library->capacity) {
+        return 1;
+    }
     
-    if (!library->books) {
-        fprintf(stderr, "Memory allocation failed during library initialization\n");
-        library->capacity = 0;
+    int needed = (int)(((long long)capacity + BOOK_CHUNK_SIZE - 1) / BOOK_CHUNK_SIZE);
+    if (needed > library->chunk_capacity) {
+        int new_capacity = library->chunk_capacity ? library->chunk_capacity : 16;
+        while (new_capacity < needed) {
+            new_capacity *= 2;
+        }
+        BookChunk** new_chunks = (BookChunk**)realloc(library->chunks, sizeof(BookChunk*) * new_capacity);
+        if (!new_chunks) {
+            fprintf(stderr, "Memory allocation failed while growing the library\n");
+            return 0;
+        }
+        library->chunks = new_chunks;
+        library->chunk_capacity = new_capacity;
+    }
+    
+    // New chunks start with every generation at 0 (free, never used)
+    while (library->chunk_count < needed) {
+        BookChunk* chunk = (BookChunk*)calloc(1, sizeof(BookChunk));
+        if (!chunk) {
+            fprintf(stderr, "Memory allocation failed while growing the library\n");
+            return 0;
+        }
+        library->chunks[library->chunk_count++] = chunk;
+        library->capacity += BOOK_CHUNK_SIZE;
     }
+    return 1;
 }
 
-// Resize the library capacity
-int resize_library(Library* library, int new_capacity) {
-    if (new_capacity < library->count) {
-        return 0; // Can't resize smaller than current count
+// The book in a slot
+Book* library_book(const Library* library, int slot) {
+    return &library->chunks[slot >> BOOK_CHUNK_SHIFT]->books[slot & (BOOK_CHUNK_SIZE - 1)];
+}
+
+// The generation counter of a slot
+static uint32_t* slot_generation(const Library* library, int slot) {
+    return &library->chunks[slot >> BOOK_CHUNK_SHIFT]->generations[slot & (BOOK_CHUNK_SIZE - 1)];
+}
+
+// The canonical ISBN key of the book in a slot (ISBN_KEY_NONE if it has none)
+static uint64_t slot_isbn_key(const Library* library, int slot) {
+    const Book* book = library_book(library, slot);
+    return isbn_key_unchecked(book_isbn(library, book), book->isbn.length);
+}
+
+// Set or clear a book's bit in each bitmap of the bitmap index it belongs to
+static void update_book_bits(Library* library, int slot, int set) {
+    const Book* book = library_book(library, slot);
+    int members[5];
+    int count = 0;
+    members[count++] = BOOK_BITMAP_LIVE;
+    if (book->metadata_retrieved) {
+        members[count++] = BOOK_BITMAP_RETRIEVED;
+    }
+    if (book->isbn.length > 0) {
+        members[count++] = BOOK_BITMAP_HAS_ISBN;
+    }
+    if ((unsigned)book->cover_type < COVER_TYPE_COUNT) {
+        members[count++] = BOOK_BITMAP_COVERS + (int)book->cover_type;
+    }
+    if ((unsigned)book->condition < CONDITION_COUNT) {
+        members[count++] = BOOK_BITMAP_CONDITIONS + (int)book->condition;
     }
     
-    Book* new_books = (Book*)realloc(library->books, sizeof(Book) * new_capacity);
+    for (int i = 0; i < count; i++) {
+        if (set) {
+            bitmap_add(&library->bitmaps[members[i]], (uint32_t)slot);
+        } else {
+            bitmap_remove(&library->bitmaps[members[i]], (uint32_t)slot);
+        }
+    }
+}
+
+// Enter the book in a slot into the indexes that have been built
+static void add_to_indexes(Library* library, int slot) {
+    if (library->titles_indexed) {
+        title_index_add(&library->titles, &library->strings, library_book(library, slot)->title, slot);
+    }
+    if (library->isbns_indexed) {
+        uint64_t key = slot_isbn_key(library, slot);
+        if (key != ISBN_KEY_NONE) {
+            isbn_index_add(&library->isbns, key, slot);
+        }
+    }
+    if (library->words_indexed) {
+        const Book* book = library_book(library, slot);
+        text_index_add(&library->words, book_title(library, book), (uint32_t)slot);
+        text_index_add(&library->words, book_author(library, book), (uint32_t)slot);
+    }
+    if (library->ranges_indexed) {
+        const Book* book = library_book(library, slot);
+        range_index_add(&library->years, book->year_published, (uint32_t)slot);
+        range_index_add(&library->word_counts, book->word_count, (uint32_t)slot);
+    }
+    if (library->bitmaps_indexed) {
+        update_book_bits(library, slot, 1);
+    }
+}
+
+// Take the book in a slot out of the indexes that have been built
+static void remove_from_indexes(Library* library, int slot) {
+    if (library->titles_indexed) {
+        title_index_remove(&library->titles, &library->strings, library_book(library, slot)->title, slot);
+    }
+    if (library->isbns_indexed) {
+        uint64_t key = slot_isbn_key(library, slot);
+        if (key != ISBN_KEY_NONE) {
+            isbn_index_remove(&library->isbns, key, slot);
+        }
+    }
+    if (library->words_indexed) {
+        const Book* book = library_book(library, slot);
+        text_index_remove(&library->words, book_title(library, book), (uint32_t)slot);
+        text_index_remove(&library->words, book_author(library, book), (uint32_t)slot);
+    }
+    if (library->ranges_indexed) {
+        const Book* book = library_book(library, slot);
+        range_index_remove(&library->years, book->year_published, (uint32_t)slot);
+        range_index_remove(&library->word_counts, book->word_count, (uint32_t)slot);
+    }
+    if (library->bitmaps_indexed) {
+        update_book_bits(library, slot, 0);
+    }
+}
+
+// Enter the book in a slot into the library's totals and indexes
+static void index_book(Library* library, int slot) {
+    totals_add(&library->totals, library_book(library, slot));
+    add_to_indexes(library, slot);
+}
+
+// Take the book in a slot out of the library's totals and indexes, before it changes or goes
+static void unindex_book(Library* library, int slot) {
+    totals_remove(&library->totals, library_book(library, slot));
+    remove_from_indexes(library, slot);
+}
+
+// Fill the title index from scratch
+static void build_title_index(Library* library) {
+    title_index_clear(&library->titles);
+    title_index_reserve(&library->titles, (uint32_t)library_book_count(library));
+    for (int slot = 0; slot < library->count; slot++) {
+        if (library_is_live(library, slot)) {
+            title_index_add(&library->titles, &library->strings, library_book(library, slot)->title, slot);
+        }
+    }
+}
+
+// Fill the ISBN index from scratch
+static void build_isbn_index(Library* library) {
+    isbn_index_clear(&library->isbns);
+    isbn_index_reserve(&library->isbns, (uint32_t)library_book_count(library));
+    for (int slot = 0; slot < library->count; slot++) {
+        if (library_is_live(library, slot)) {
+            uint64_t key = slot_isbn_key(library, slot);
+            if (key != ISBN_KEY_NONE) {
+                isbn_index_add(&library->isbns, key, slot);
+            }
+        }
+    }
+}
+
+// Fill the word index from scratch. Slots are visited in order, so every
+// posting list is built by appending.
+static void build_word_index(Library* library) {
+    text_index_clear(&library->words);
+    fuzzy_index_clear(&library->fuzzy); // Its trigrams point at the old term ids
+    for (int slot = 0; slot < library->count; slot++) {
+        if (library_is_live(library, slot)) {
+            const Book* book = library_book(library, slot);
+            text_index_add(&library->words, book_title(library, book), (uint32_t)slot);
+            text_index_add(&library->words, book_author(library, book), (uint32_t)slot);
+        }
+    }
+}
+
+// Fill the year and word count indexes from scratch: books are appended in
+// slot order and each index is sorted once
+static void build_range_indexes(Library* library) {
+    range_index_clear(&library->years);
+    range_index_clear(&library->word_counts);
+    range_index_reserve(&library->years, (uint32_t)library_book_count(library));
+    range_index_reserve(&library->word_counts, (uint32_t)library_book_count(library));
+    for (int slot = 0; slot < library->count; slot++) {
+        if (library_is_live(library, slot)) {
+            const Book* book = library_book(library, slot);
+            range_index_append(&library->years, book->year_published, (uint32_t)slot);
+            range_index_append(&library->word_counts, book->word_count, (uint32_t)slot);
+        }
+    }
+    range_index_sort(&library->years);
+    range_index_sort(&library->word_counts);
+}
+
+// Fill the bitmap index from scratch. Slots are visited in order, so every
+// bitmap is built by appending.
+static void build_bitmap_index(Library* library) {
+    for (int i = 0; i < BOOK_BITMAP_COUNT; i++) {
+        bitmap_clear(&library->bitmaps[i]);
+    }
+    for (int slot = 0; slot < library->count; slot++) {
+        if (library_is_live(library, slot)) {
+            update_book_bits(library, slot, 1);
+        }
+    }
+}
+
+// Re-enter every book after slots were renumbered
+static void rebuild_indexes(Library* library) {
+    if (library->titles_indexed) {
+        build_title_index(library);
+    }
+    if (library->isbns_indexed) {
+        build_isbn_index(library);
+    }
+    if (library->words_indexed) {
+        build_word_index(library);
+    }
+    if (library->ranges_indexed) {
+        build_range_indexes(library);
+    }
+    if (library->bitmaps_indexed) {
+        build_bitmap_index(library);
+    }
+}
+
+// Copy a changed book into the column store, if the library keeps one
+static void sync_columns(Library* library, int index) {
+    if (library->columnar) {
+        columns_set(&library->columns, index, library_book(library, index));
+    }
+}
+
+// The next generation that marks a slot as holding a book
+static uint32_t next_live_generation(uint32_t generation) {
+    return (generation + 1) | 1;
+}
+
+// Store a book in the most recently freed slot, or append it, growing the
+// array if needed. Returns the slot, or -1 if the array could not grow.
+static int append_book(Library* library, const Book* book) {
+    int slot;
+    if (library->free_count > 0) {
+        slot = library->free_slots[--library->free_count];
+    } else {
+        if (!library_reserve(library, library->count + 1)) {
+            return -1;
+        }
+        slot = library->count++;
+    }
     
-    if (!new_books) {
-        fprintf(stderr, "Memory reallocation failed during library resize\n");
-        return 0;
+    *library_book(library, slot) = *book;
+    uint32_t* generation = slot_generation(library, slot);
+    *generation = next_live_generation(*generation);
+    sync_columns(library, slot);
+    index_book(library, slot);
+    return slot;
+}
+
+// Take `added` books written directly past the last slot (by a bulk load)
+// into the library. A loader that already knows the added books' totals
+// passes them so the books are not counted one by one (NULL = count them).
+void library_commit_appended(Library* library, int added, const LibraryTotals* totals) {
+    if (library->titles_indexed) {
+        title_index_reserve(&library->titles, (uint32_t)(library_book_count(library) + added));
     }
+    if (library->isbns_indexed) {
+        isbn_index_reserve(&library->isbns, (uint32_t)(library_book_count(library) + added));
+    }
+    for (int slot = library->count; slot < library->count + added; slot++) {
+        uint32_t* generation = slot_generation(library, slot);
+        *generation = next_live_generation(*generation);
+    }
+    library->count += added;
+    for (int slot = library->count - added; slot < library->count; slot++) {
+        if (totals) {
+            add_to_indexes(library, slot);
+        } else {
+            index_book(library, slot);
+        }
+    }
+    if (totals) {
+        totals_merge(&library->totals, totals);
+    }
+}
+
+// The library's running totals, recounted first if a change could not be
+// counted (check stale in case the recount could not finish either)
+const LibraryTotals* library_totals(Library* library) {
+    if (library->totals.stale) {
+        totals_clear(&library->totals);
+        for (int slot = 0; slot < library->count; slot++) {
+            if (library_is_live(library, slot)) {
+                totals_add(&library->totals, library_book(library, slot));
+            }
+        }
+    }
+    return &library->totals;
+}
+
+// Build a library book from a standalone record, copying its strings into the arena
+static void book_from_record(Library* library, const BookRecord* record, Book* book) {
+    book->title = arena_add(&library->strings, record->title ? record->title : "",
+                            record->title ? strlen(record->title) : 0);
+    book->isbn = arena_add(&library->strings, record->isbn ? record->isbn : "",
+                           record->isbn ? strlen(record->isbn) : 0);
+    book->author_id = intern_add(&library->authors, &library->strings, record->author ? record->author : "",
+                                 record->author ? strlen(record->author) : 0);
+    book->genre_id = intern_add(&library->genres, &library->strings, record->genre ? record->genre : "",
+                                record->genre ? strlen(record->genre) : 0);
+    book->cover_type = record->cover_type;
+    book->condition = record->condition;
+    book->word_count = record->word_count;
+    book->year_published = record->year_published;
+    book->metadata_retrieved = record->metadata_retrieved;
+}
+
+// String accessors. The pointers stay valid until the library's strings next change.
+const char* book_title(const Library* library, const Book* book) {
+    return arena_get(&library->strings, book->title);
+}
+
+const char* book_author(const Library* library, const Book* book) {
+    return arena_get(&library->strings, intern_ref(&library->authors, book->author_id));
+}
+
+const char* book_isbn(const Library* library, const Book* book) {
+    return arena_get(&library->strings, book->isbn);
+}
+
+const char* book_genre(const Library* library, const Book* book) {
+    return arena_get(&library->strings, intern_ref(&library->genres, book->genre_id));
+}
+
+// Look up all of a book's strings at once
+void get_book_strings(const Library* library, const Book* book, BookStrings* strings) {
+    strings->title = book_title(library, book);
+    strings->author = book_author(library, book);
+    strings->isbn = book_isbn(library, book);
+    strings->genre = book_genre(library, book);
+}
+
+// Remove the book at an index, moving the last book into its place. Only
+// journals from before deletes left free slots are replayed this way.
+static void remove_book_at(Library* library, int index) {
+    unindex_book(library, index);
     
-    library->books = new_books;
-    library->capacity = new_capacity;
-    printf("Library resized to capacity: %d\n", new_capacity);
+    // Move the last book to this position (if it's not already the last)
+    if (index < library->count - 1) {
+        unindex_book(library, library->count - 1);
+        *library_book(library, index) = *library_book(library, library->count - 1);
+        *slot_generation(library, index) = next_live_generation(*slot_generation(library, index));
+        sync_columns(library, index);
+        index_book(library, index);
+    }
+    library->count--;
+    (*slot_generation(library, library->count))++;
+    if (library->columnar) {
+        columns_remove_last(&library->columns);
+    }
+}
+
+// Delete the book in a slot: the slot keeps its place and joins the free
+// list. Returns 0 (and changes nothing) if the free list could not grow.
+static int free_slot(Library* library, int slot) {
+    if (library->free_count >= library->free_capacity) {
+        int new_capacity = library->free_capacity ? library->free_capacity * 2 : 64;
+        int* new_free_slots = (int*)realloc(library->free_slots, sizeof(int) * new_capacity);
+        if (!new_free_slots) {
+            fprintf(stderr, "Memory allocation failed while deleting a book\n");
+            return 0;
+        }
+        library->free_slots = new_free_slots;
+        library->free_capacity = new_capacity;
+    }
+    
+    unindex_book(library, slot);
+    (*slot_generation(library, slot))++;
+    library->free_slots[library->free_count++] = slot;
+    if (library->columnar) {
+        columns_clear(&library->columns, slot);
+    }
     return 1;
 }
 
-// Add a book to the library
-void add_book(Library* library, const Book* book) {
-    // Check if we need to resize
-    if (library->count >= library->capacity) {
-        int new_capacity = library->capacity * GROWTH_FACTOR;
-        if (!resize_library(library, new_capacity)) {
-            printf("Failed to expand library capacity. Cannot add more books.\n");
-            return;
+// Number of books, not counting deleted slots
+int library_book_count(const Library* library) {
+    return library->count - library->free_count;
+}
+
+// Whether a slot holds a book
+int library_is_live(const Library* library, int slot) {
+    return slot >= 0 && slot < library->count && (*slot_generation(library, slot) & 1);
+}
+
+// The handle of the book in a slot
+BookHandle library_handle(const Library* library, int slot) {
+    return (BookHandle)*slot_generation(library, slot) << 32 | (uint32_t)slot;
+}
+
+// The slot a handle refers to, or -1 if its book has been deleted
+int library_handle_slot(const Library* library, BookHandle handle) {
+    int slot = (int)(uint32_t)handle;
+    if (!library_is_live(library, slot) || *slot_generation(library, slot) != (uint32_t)(handle >> 32)) {
+        return -1;
+    }
+    return slot;
+}
+
+// The book a handle refers to, or NULL if it has been deleted. Chunks never
+// move, so the pointer stays good until the book is deleted or the library
+// freed; keep the handle to notice the former.
+Book* library_get(Library* library, BookHandle handle) {
+    int slot = library_handle_slot(library, handle);
+    return slot >= 0 ? library_book(library, slot) : NULL;
+}
+
+// Keep a column-per-field copy of the books from now on, so scans such as
+// library_next_book read only the fields they test
+int library_enable_columns(Library* library) {
+    library->columnar = 1;
+    library_refresh_columns(library);
+    return library->columns.count == library->count;
+}
+
+// Rebuild the column store after books were written in bulk
+void library_refresh_columns(Library* library) {
+    if (!library->columnar || !columns_reserve(&library->columns, library->count)) {
+        return;
+    }
+    
+    columns_reset(&library->columns);
+    for (int slot = 0; slot < library->count; slot++) {
+        const BookChunk* chunk = library->chunks[slot >> BOOK_CHUNK_SHIFT];
+        int offset = slot & (BOOK_CHUNK_SIZE - 1);
+        columns_set(&library->columns, slot, &chunk->books[offset]);
+        if (!(chunk->generations[offset] & 1)) {
+            columns_clear(&library->columns, slot);
         }
     }
+}
+
+// Find the first book at or after `start` meeting every SCAN_* condition.
+// Returns -1 if there is none.
+int library_next_book(const Library* library, int start, int conditions) {
+    if (library->columnar) {
+        return columns_next(&library->columns, start, conditions);
+    }
     
-    // Now we have space to add the book
-    library->books[library->count] = *book;
-    library->count++;
-    printf("Added book: %s\n", book->title);
+    for (int i = start; i < library->count; i++) {
+        const Book* book = library_book(library, i);
+        if (!library_is_live(library, i)) {
+            continue;
+        }
+        if ((conditions & SCAN_HAS_ISBN) && book->isbn.length == 0) {
+            continue;
+        }
+        if ((conditions & SCAN_NEEDS_METADATA) && book->metadata_retrieved) {
+            continue;
+        }
+        return i;
+    }
+    return -1;
+}
+
+// Record a change in the journal, if the library has one
+static void log_change(Library* library, JournalOp op, int index) {
+    if (library->journal) {
+        BookStrings strings;
+        const Book* book = NULL;
+        if (op == JOURNAL_ADD || op == JOURNAL_UPDATE) {
+            book = library_book(library, index);
+            get_book_strings(library, book, &strings);
+        }
+        journal_append(library->journal, op, index, book, &strings);
+    }
+}
+
+// Add a book to the library
+void add_book(Library* library, const BookRecord* record) {
+    Book book;
+    book_from_record(library, record, &book);
+    int slot = append_book(library, &book);
+    if (slot < 0) {
+        printf("Failed to expand library capacity. Cannot add more books.\n");
+        return;
+    }
+    log_change(library, JOURNAL_ADD, slot);
+    printf("Added book: %s\n", book_title(library, &book));
 }
 
 // Print all books in the library
 void print_library(const Library* library) {
-    printf("\nLibrary Contents (%d books):\n", library->count);
+    printf("\nLibrary Contents (%d books):\n", library_book_count(library));
     printf("------------------------\n");
     
+    int number = 0;
     for (int i = 0; i < library->count; i++) {
-        printf("Book %d:\n", i + 1);
-        print_book(&library->books[i]);
+        if (!library_is_live(library, i)) {
+            continue;
+        }
+        BookStrings strings;
+        get_book_strings(library, library_book(library, i), &strings);
+        printf("Book %d:\n", ++number);
+        print_book(library_book(library, i), &strings);
         printf("\n");
     }
 }
 
-// Find a book by title
-Book* find_book_by_title(Library* library, const char* title) {
+// Start a filter that lets every book through
+void book_filter_init(BookFilter* filter) {
+    filter->covers = 0;
+    filter->conditions = 0;
+    filter->metadata = FILTER_ANY;
+    filter->has_isbn = FILTER_ANY;
+}
+
+// Narrow `result` to the books in (or, with keep unset, not in) `by`
+static int narrow_bitmap(Bitmap* result, const Bitmap* by, int keep, Bitmap* scratch) {
+    int ok = keep ? bitmap_and(result, by, scratch) : bitmap_andnot(result, by, scratch);
+    Bitmap narrowed = *scratch;
+    *scratch = *result;
+    *result = narrowed;
+    return ok;
+}
+
+// Narrow `result` to the books having any of the values in `mask`, given
+// the bitmaps of a field's values
+static int narrow_to_values(Bitmap* result, const Bitmap* values, int value_count, unsigned mask, Bitmap* scratch) {
+    if ((mask & (mask - 1)) == 0) {
+        return narrow_bitmap(result, &values[__builtin_ctz(mask)], 1, scratch);
+    }
+    
+    Bitmap any;
+    bitmap_init(&any);
+    int ok = 1;
+    for (int i = 0; i < value_count && ok; i++) {
+        if (mask & (1u << i)) {
+            ok = bitmap_or(&any, &values[i], scratch);
+            Bitmap merged = *scratch;
+            *scratch = any;
+            any = merged;
+        }
+    }
+    ok = ok && narrow_bitmap(result, &any, 1, scratch);
+    bitmap_free(&any);
+    return ok;
+}
+
+// Find the books meeting a filter, as a bitmap of their slots in `result`.
+// The answer comes from ANDing, ORing and subtracting the bitmaps of the
+// bitmap index, a machine word of books at a time, so its size is known
+// by popcount before any book is read. The index is built by the first
+// filter. Returns 0 if memory runs out.
+int library_filter(Library* library, const BookFilter* filter, Bitmap* result) {
+    if (!library->bitmaps_indexed) {
+        library->bitmaps_indexed = 1;
+        build_bitmap_index(library);
+    }
+    
+    const Bitmap* bitmaps = library->bitmaps;
+    Bitmap scratch;
+    bitmap_init(&scratch);
+    int ok = bitmap_copy(&bitmaps[BOOK_BITMAP_LIVE], result);
+    if (ok && filter->covers) {
+        ok = narrow_to_values(result, &bitmaps[BOOK_BITMAP_COVERS], COVER_TYPE_COUNT, filter->covers, &scratch);
+    }
+    if (ok && filter->conditions) {
+        ok = narrow_to_values(result, &bitmaps[BOOK_BITMAP_CONDITIONS], CONDITION_COUNT, filter->conditions,
+                              &scratch);
+    }
+    if (ok && filter->metadata != FILTER_ANY) {
+        ok = narrow_bitmap(result, &bitmaps[BOOK_BITMAP_RETRIEVED], filter->metadata, &scratch);
+    }
+    if (ok && filter->has_isbn != FILTER_ANY) {
+        ok = narrow_bitmap(result, &bitmaps[BOOK_BITMAP_HAS_ISBN], filter->has_isbn, &scratch);
+    }
+    bitmap_free(&scratch);
+    return ok;
+}
+
+// Print one book of a filtered listing, numbered by its place in the full one
+static void print_listed_book(const Library* library, const Book* book, int number) {
+    BookStrings strings;
+    get_book_strings(library, book, &strings);
+    printf("Book %d:\n", number);
+    print_book(book, &strings);
+    printf("\n");
+}
+
+// Print the books by one author and/or in one genre (NULL = any) that also
+// meet a filter on the bitmap-indexed fields (NULL = no filter). Names are
+// resolved to dictionary IDs once, so the scan only compares integers; with
+// a filter, only the books in its bitmap are visited at all. With count_only
+// set just the number of matches is printed, which for a filter alone is a
+// popcount.
+void print_library_filtered(Library* library, const char* author, const char* genre, const BookFilter* filter,
+                            int count_only) {
+    uint32_t author_id = author ? intern_find(&library->authors, &library->strings, author, strlen(author)) : 0;
+    uint32_t genre_id = genre ? intern_find(&library->genres, &library->strings, genre, strlen(genre)) : 0;
+    int matches = 0;
+    
+    if (author_id != INTERN_NOT_FOUND && genre_id != INTERN_NOT_FOUND && filter) {
+        Bitmap found;
+        bitmap_init(&found);
+        if (library_filter(library, filter, &found)) {
+            if (count_only && !author && !genre) {
+                matches = (int)bitmap_cardinality(&found);
+            } else {
+                uint32_t slot;
+                for (int more = bitmap_next(&found, 0, &slot); more; more = bitmap_next(&found, slot + 1, &slot)) {
+                    const Book* book = library_book(library, (int)slot);
+                    if ((author && book->author_id != author_id) || (genre && book->genre_id != genre_id)) {
+                        continue;
+                    }
+                    if (!count_only) {
+                        int number = (int)bitmap_rank(&library->bitmaps[BOOK_BITMAP_LIVE], slot) + 1;
+                        print_listed_book(library, book, number);
+                    }
+                    matches++;
+                }
+            }
+        }
+        bitmap_free(&found);
+    } else if (author_id != INTERN_NOT_FOUND && genre_id != INTERN_NOT_FOUND) {
+        int number = 0; // Position in the full listing
+        for (int i = 0; i < library->count; i++) {
+            const Book* book = library_book(library, i);
+            if (!library_is_live(library, i)) {
+                continue;
+            }
+            number++;
+            if ((author && book->author_id != author_id) || (genre && book->genre_id != genre_id)) {
+                continue;
+            }
+            if (!count_only) {
+                print_listed_book(library, book, number);
+            }
+            matches++;
+        }
+    }
+    printf("%d of %d books match.\n", matches, library_book_count(library));
+}
+
+// Print how well a dictionary deduplicates one string column
+static void print_intern_stats(const char* name, const InternTable* table, size_t value_bytes, int values) {
+    size_t distinct_bytes = 0;
+    for (uint32_t id = 1; id < table->count; id++) {
+        distinct_bytes += table->values[id].length + 1;
+    }
+    size_t table_bytes = (sizeof(StrRef) + sizeof(uint32_t)) * table->capacity + sizeof(uint32_t) * table->slot_count;
+    long long saved = (long long)value_bytes - (long long)(distinct_bytes + table_bytes);
+    
+    printf("%s: %d values, %u distinct (%.1fx dedup), %zu bytes of strings instead of %zu, %lld bytes saved\n",
+           name, values, table->count > 0 ? table->count - 1 : 0,
+           table->count > 1 ? (double)values / (table->count - 1) : 0.0,
+           distinct_bytes, value_bytes, saved);
+}
+
+// Print how much memory the library's books take
+void print_library_info(const Library* library) {
+    size_t book_bytes = sizeof(BookChunk) * (size_t)library->chunk_count;
+    size_t string_bytes = library->strings.capacity;
+    
+    printf("Books: %d (capacity %d, %d deleted slots)\n", library_book_count(library), library->capacity,
+           library->free_count);
+    printf("Book records: %zu bytes in %d chunks (%zu per slot)\n", book_bytes, library->chunk_count,
+           sizeof(BookChunk) / BOOK_CHUNK_SIZE);
+    printf("Strings: %zu bytes used, %zu allocated\n", library->strings.size, string_bytes);
+    if (library->columnar) {
+        printf("Columns: %zu bytes\n", columns_memory(&library->columns));
+    }
+    
+    // What each author and genre would take if every book stored its own copy
+    size_t author_bytes = 0, genre_bytes = 0;
+    int authors = 0, genres = 0;
     for (int i = 0; i < library->count; i++) {
-        if (strcmp(library->books[i].title, title) == 0) {
-            return &library->books[i];
+        const Book* book = library_book(library, i);
+        if (!library_is_live(library, i)) {
+            continue;
+        }
+        if (book->author_id != INTERN_EMPTY) {
+            author_bytes += intern_ref(&library->authors, book->author_id).length + 1;
+            authors++;
+        }
+        if (book->genre_id != INTERN_EMPTY) {
+            genre_bytes += intern_ref(&library->genres, book->genre_id).length + 1;
+            genres++;
         }
     }
-    return NULL;
+    print_intern_stats("Authors", &library->authors, author_bytes, authors);
+    print_intern_stats("Genres", &library->genres, genre_bytes, genres);
+    if (library_book_count(library) > 0) {
+        // Only the slots and string bytes in use, so the first chunk's spare
+        // room does not swamp the figure for a small library
+        size_t used_bytes = sizeof(BookChunk) / BOOK_CHUNK_SIZE * (size_t)library->count + library->strings.size;
+        printf("Memory per book: %.1f bytes\n", (double)used_bytes / library_book_count(library));
+    }
+}
+
+// Turn slots found by an index (in table order) into handles in library order
+static void slots_to_handles(const Library* library, int* slots, int count, BookHandle* handles, int max_handles) {
+    for (int i = 1; i < count; i++) {
+        int slot = slots[i];
+        int j = i;
+        for (; j > 0 && slots[j - 1] > slot; j--) {
+            slots[j] = slots[j - 1];
+        }
+        slots[j] = slot;
+    }
+    for (int i = 0; i < count && i < max_handles; i++) {
+        handles[i] = library_handle(library, slots[i]);
+    }
+}
+
+// Find every book with a title, through the title index. Up to `max_handles`
+// handles are written in library order; returns the number of matches. The
+// index is built by the first lookup, so commands that never look up a
+// title do not pay for it at load time.
+int find_books_by_title(Library* library, const char* title, BookHandle* handles, int max_handles) {
+    if (!library->titles_indexed) {
+        library->titles_indexed = 1;
+        build_title_index(library);
+    }
+    
+    size_t length = strlen(title);
+    int slots[16];
+    int* found = slots;
+    int matches = title_index_find(&library->titles, &library->strings, title, length, slots, 16);
+    if (matches > 16) {
+        found = (int*)malloc(sizeof(int) * matches);
+        if (!found) {
+            fprintf(stderr, "Memory allocation failed while looking up a title\n");
+            return 0;
+        }
+        title_index_find(&library->titles, &library->strings, title, length, found, matches);
+    }
+    
+    slots_to_handles(library, found, matches, handles, max_handles);
+    if (found != slots) {
+        free(found);
+    }
+    return matches;
+}
+
+// Find a book by title (the first one, if several share it). Returns
+// BOOK_HANDLE_NONE if there is none.
+BookHandle find_book_by_title(Library* library, const char* title) {
+    BookHandle handle;
+    return find_books_by_title(library, title, &handle, 1) > 0 ? handle : BOOK_HANDLE_NONE;
+}
+
+// Find every book whose ISBN has this canonical key (see isbn_key), so
+// hyphenated, ISBN-10 and ISBN-13 forms of one ISBN all match. Up to
+// `max_handles` handles are written in library order; returns the number
+// of matches. Like the title index, the ISBN index is built on first use.
+int find_books_by_isbn(Library* library, uint64_t key, BookHandle* handles, int max_handles) {
+    if (!library->isbns_indexed) {
+        library->isbns_indexed = 1;
+        build_isbn_index(library);
+    }
+    
+    int slots[16];
+    int* found = slots;
+    int matches = isbn_index_find(&library->isbns, key, slots, 16);
+    if (matches > 16) {
+        found = (int*)malloc(sizeof(int) * matches);
+        if (!found) {
+            fprintf(stderr, "Memory allocation failed while looking up an ISBN\n");
+            return 0;
+        }
+        isbn_index_find(&library->isbns, key, found, matches);
+    }
+    
+    slots_to_handles(library, found, matches, handles, max_handles);
+    if (found != slots) {
+        free(found);
+    }
+    return matches;
+}
+
+// Find a book by ISBN, in any of its written forms (the first one, if the
+// library has several copies). Returns BOOK_HANDLE_NONE if there is none.
+BookHandle find_book_by_isbn(Library* library, const char* isbn) {
+    BookHandle handle;
+    uint64_t key = isbn_key_unchecked(isbn, strlen(isbn));
+    if (key == ISBN_KEY_NONE) {
+        return BOOK_HANDLE_NONE;
+    }
+    return find_books_by_isbn(library, key, &handle, 1) > 0 ? handle : BOOK_HANDLE_NONE;
+}
+
+// Find the books whose title and author together contain every word of
+// `query`, ignoring case and punctuation. Up to `max_handles` handles are
+// written in library order; returns the number of matches. The word index
+// is built by the first search.
+int search_books(Library* library, const char* query, BookHandle* handles, int max_handles) {
+    if (!library->words_indexed) {
+        library->words_indexed = 1;
+        build_word_index(library);
+    }
+    
+    uint32_t slots[SEARCH_MAX_SHOWN];
+    uint32_t* found = slots;
+    if (max_handles > SEARCH_MAX_SHOWN) {
+        found = (uint32_t*)malloc(sizeof(uint32_t) * max_handles);
+        if (!found) {
+            fprintf(stderr, "Memory allocation failed while searching\n");
+            return 0;
+        }
+    }
+    
+    int matches = text_index_search(&library->words, query, found, max_handles);
+    for (int i = 0; i < matches && i < max_handles; i++) {
+        handles[i] = library_handle(library, (int)found[i]);
+    }
+    
+    if (found != slots) {
+        free(found);
+    }
+    return matches > 0 ? matches : 0;
+}
+
+// Print the books matching every word of a query
+void print_search_results(Library* library, const char* query) {
+    BookHandle handles[SEARCH_MAX_SHOWN];
+    int matches = search_books(library, query, handles, SEARCH_MAX_SHOWN);
+    
+    if (matches == 0) {
+        printf("No books match: %s\n", query);
+        return;
+    }
+    printf("%d book%s match%s: %s\n", matches, matches == 1 ? "" : "s", matches == 1 ? "es" : "", query);
+    
+    for (int i = 0; i < matches && i < SEARCH_MAX_SHOWN; i++) {
+        const Book* book = library_get(library, handles[i]);
+        BookStrings strings;
+        get_book_strings(library, book, &strings);
+        printf("\n");
+        print_book(book, &strings);
+    }
+    if (matches > SEARCH_MAX_SHOWN) {
+        printf("\n(%d more not shown)\n", matches - SEARCH_MAX_SHOWN);
+    }
+}
+
+// Find the books whose title and author have a word within a few typos of
+// every word of `query` (accents and case ignored). The `max_handles` closest
+// are written with their typo counts, fewest first; returns the number of
+// books found. Builds the word index if no search has yet.
+int fuzzy_search_books(Library* library, const char* query, BookHandle* handles, int* distances, int max_handles) {
+    if (!library->words_indexed) {
+        library->words_indexed = 1;
+        build_word_index(library);
+    }
+    
+    FuzzyMatch found[FUZZY_MAX_RESULTS];
+    if (max_handles > FUZZY_MAX_RESULTS) {
+        max_handles = FUZZY_MAX_RESULTS;
+    }
+    int matches = fuzzy_search(&library->fuzzy, &library->words, (uint32_t)library->count, query, found, max_handles);
+    for (int i = 0; i < matches && i < max_handles; i++) {
+        handles[i] = library_handle(library, (int)found[i].slot);
+        distances[i] = found[i].distance;
+    }
+    return matches > 0 ? matches : 0;
+}
+
+// Print the books closest to a query that may have typos in it
+void print_fuzzy_results(Library* library, const char* query, int max_shown) {
+    BookHandle handles[FUZZY_MAX_RESULTS];
+    int distances[FUZZY_MAX_RESULTS];
+    if (max_shown > FUZZY_MAX_RESULTS) {
+        max_shown = FUZZY_MAX_RESULTS;
+    }
+    int matches = fuzzy_search_books(library, query, handles, distances, max_shown);
+    
+    if (matches == 0) {
+        printf("No books come close to: %s\n", query);
+        return;
+    }
+    printf("%d book%s close to: %s\n", matches, matches == 1 ? "" : "s", query);
+    
+    for (int i = 0; i < matches && i < max_shown; i++) {
+        const Book* book = library_get(library, handles[i]);
+        BookStrings strings;
+        get_book_strings(library, book, &strings);
+        if (distances[i] == 0) {
+            printf("\n[exact]\n");
+        } else {
+            printf("\n[%d typo%s]\n", distances[i], distances[i] == 1 ? "" : "s");
+        }
+        print_book(book, &strings);
+    }
+    if (matches > max_shown) {
+        printf("\n(%d more not shown)\n", matches - max_shown);
+    }
+}
+
+// Start a walk over the books whose year published (or word count) is from
+// `low` to `high`, inclusive; range_cursor_next then yields their slots in
+// order of that field, ties in library order. The cursor is good until the
+// library next changes. Both indexes are built by the first range query.
+void library_range_find(Library* library, RangeField field, int low, int high, RangeCursor* cursor) {
+    if (!library->ranges_indexed) {
+        library->ranges_indexed = 1;
+        build_range_indexes(library);
+    }
+    range_index_find(field == RANGE_YEAR ? &library->years : &library->word_counts, low, high, cursor);
+}
+
+// Print the books whose year published (or word count) is in a range, in order of it
+void print_library_range(Library* library, RangeField field, int low, int high) {
+    RangeCursor cursor;
+    library_range_find(library, field, low, high, &cursor);
+    
+    int matches = 0;
+    uint32_t slot;
+    while (range_cursor_next(&cursor, &slot)) {
+        const Book* book = library_book(library, (int)slot);
+        BookStrings strings;
+        get_book_strings(library, book, &strings);
+        print_book(book, &strings);
+        printf("\n");
+        matches++;
+    }
+    printf("%d of %d books match.\n", matches, library_book_count(library));
 }
 
 // Delete a book by title
 int delete_book_by_title(Library* library, const char* title) {
-    for (int i = 0; i < library->count; i++) {
-        if (strcmp(library->books[i].title, title) == 0) {
-            // Move the last book to this position (if it's not already the last)
-            if (i < library->count - 1) {
-                library->books[i] = library->books[library->count - 1];
-            }
-            library->count--;
-            return 1; // Successful deletion
+    return library_delete(library, find_book_by_title(library, title));
+}
+
+// Delete the book a handle refers to. Other books keep their slots, so their
+// handles stay valid. Returns 0 if the handle is stale.
+int library_delete(Library* library, BookHandle handle) {
+    int slot = library_handle_slot(library, handle);
+    if (slot < 0) {
+        return 0;
+    }
+    if (!free_slot(library, slot)) {
+        return 0;
+    }
+    log_change(library, JOURNAL_REMOVE, slot);
+    return 1;
+}
+
+// Close the gaps left by deleted books, keeping the remaining books in order.
+// Each of the `handle_count` handles is rewritten to its book's new slot (or
+// to BOOK_HANDLE_NONE if the book is gone); any other handle held across the
+// call is stale afterwards. Returns the number of slots reclaimed, or -1 if
+// the handles could not be remapped (the library is then left as it was).
+int library_compact(Library* library, BookHandle* handles, int handle_count) {
+    int reclaimed = library->free_count;
+    if (reclaimed == 0) {
+        return 0;
+    }
+    
+    // Old slot of each handle's book, and new slot of each old slot
+    int* handle_slots = NULL;
+    int* new_slots = NULL;
+    if (handle_count > 0) {
+        handle_slots = (int*)malloc(sizeof(int) * handle_count);
+        new_slots = (int*)malloc(sizeof(int) * library->count);
+        if (!handle_slots || !new_slots) {
+            fprintf(stderr, "Memory allocation failed while compacting library\n");
+            free(handle_slots);
+            free(new_slots);
+            return -1;
+        }
+        for (int i = 0; i < handle_count; i++) {
+            handle_slots[i] = library_handle_slot(library, handles[i]);
         }
     }
-    return 0; // Book not found
+    
+    int live = 0;
+    for (int slot = 0; slot < library->count; slot++) {
+        if (!library_is_live(library, slot)) {
+            continue;
+        }
+        if (new_slots) {
+            new_slots[slot] = live;
+        }
+        if (live != slot) {
+            // Skip every generation the slot has handed out, so no handle to
+            // its earlier books can match the book moving in
+            *library_book(library, live) = *library_book(library, slot);
+            uint32_t* generation = slot_generation(library, live);
+            *generation = next_live_generation(*generation | 1);
+        }
+        live++;
+    }
+    
+    // Slots past the end keep their generations (marked free) for when they are reused
+    for (int slot = live; slot < library->count; slot++) {
+        uint32_t* generation = slot_generation(library, slot);
+        *generation = next_live_generation(*generation) + 1;
+    }
+    library->count = live;
+    library->free_count = 0;
+    library_refresh_columns(library);
+    rebuild_indexes(library);
+    
+    for (int i = 0; i < handle_count; i++) {
+        handles[i] = handle_slots[i] >= 0 ? library_handle(library, new_slots[handle_slots[i]]) : BOOK_HANDLE_NONE;
+    }
+    free(handle_slots);
+    free(new_slots);
+    return reclaimed;
 }
 
-// Free any allocated resources
+// Free any allocated resources. Uncommitted journal records are committed first.
 void free_library(Library* library) {
-    if (library->books) {
-        free(library->books);
-        library->books = NULL;
+    if (library->journal) {
+        journal_close(library->journal);
+        library->journal = NULL;
     }
+    for (int i = 0; i < library->chunk_count; i++) {
+        free(library->chunks[i]);
+    }
+    free(library->chunks);
+    library->chunks = NULL;
+    library->chunk_count = 0;
+    library->chunk_capacity = 0;
+    free(library->free_slots);
+    library->free_slots = NULL;
+    library->free_count = 0;
+    library->free_capacity = 0;
+    arena_free(&library->strings);
+    intern_free(&library->authors);
+    intern_free(&library->genres);
+    columns_free(&library->columns);
+    title_index_free(&library->titles);
+    library->titles_indexed = 0;
+    isbn_index_free(&library->isbns);
+    library->isbns_indexed = 0;
+    text_index_free(&library->words);
+    library->words_indexed = 0;
+    fuzzy_index_free(&library->fuzzy);
+    range_index_free(&library->years);
+    range_index_free(&library->word_counts);
+    library->ranges_indexed = 0;
+    for (int i = 0; i < BOOK_BITMAP_COUNT; i++) {
+        bitmap_free(&library->bitmaps[i]);
+    }
+    library->bitmaps_indexed = 0;
+    totals_free(&library->totals);
     library->count = 0;
     library->capacity = 0;
 }
 
-// Helper function to escape CSV special characters in strings
-static void escape_csv_field(const char* input, char* output, size_t output_size) {
+// Helper function to write a string as a CSV field, escaping special characters
+static void write_csv_field(FILE* file, const char* value) {
     // Simple escaping: enclose in quotes if field contains delimiter, quotes, or newlines
-    int needs_quotes = 0;
+    if (!value[strcspn(value, ",\"\n\r")]) {
+        fputs(value, file);
+        return;
+    }
     
-    for (const char* p = input; *p; p++) {
-        if (*p == ',' || *p == '"' || *p == '\n' || *p == '\r') {
-            needs_quotes = 1;
+    fputc('"', file);
+    for (const char* p = value; *p; p++) {
+        // Double up quotes for escaping
+        if (*p == '"') {
+            fputc('"', file);
+        }
+        fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
+// Save library to CSV file. The file is written under a temporary name and
+// renamed into place, so a crash never leaves a half-written library.
+int save_library_to_csv(const Library* library, const char* filename) {
+    char temp_name[512];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+    
+    FILE* file = fopen(temp_name, "w");
+    if (!file) {
+        perror("Error opening file for writing");
+        return 0;
+    }
+    
+    // Write CSV header
+    fprintf(file, "title,author,isbn,genre,cover_type,condition,word_count,year_published,metadata_retrieved\n");
+    
+    // Write each book as a CSV row
+    for (int i = 0; i < library->count; i++) {
+        const Book* book = library_book(library, i);
+        if (!library_is_live(library, i)) {
+            continue;
+        }
+        
+        write_csv_field(file, book_title(library, book));
+        fputc(',', file);
+        write_csv_field(file, book_author(library, book));
+        fputc(',', file);
+        write_csv_field(file, book_isbn(library, book));
+        fputc(',', file);
+        write_csv_field(file, book_genre(library, book));
+        fprintf(file, ",%d,%d,%d,%d,%d\n",
+                book->cover_type,
+                book->condition,
+                book->word_count,
+                book->year_published,
+                book->metadata_retrieved);
+    }
+    
+    int ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = fclose(file) == 0 && ok;
+    
+    if (!ok || rename(temp_name, filename) != 0) {
+        perror("Error writing library file");
+        remove(temp_name);
+        return 0;
+    }
+    printf("Library saved to %s\n", filename);
+    return 1;
+}
+
+// Copy a CSV field into a string arena, collapsing doubled quotes on the way
+static StrRef csv_field_to_arena(const CsvField* field, StringArena* strings) {
+    char* dest = arena_prepare(strings, field->length);
+    if (!dest) {
+        StrRef empty = {0, 0};
+        return empty;
+    }
+    return arena_commit(strings, csv_field_copy(field, dest, field->length + 1));
+}
+
+// Copy a CSV field into a string arena and intern it
+static uint32_t csv_field_to_id(const CsvField* field, StringArena* strings, InternTable* table) {
+    char* dest = arena_prepare(strings, field->length);
+    if (!dest) {
+        return INTERN_EMPTY;
+    }
+    return intern_commit(table, strings, csv_field_copy(field, dest, field->length + 1));
+}
+
+// Fill a book from one CSV record, storing its strings in `strings` and
+// interning its author and genre. Returns 0 if the record has the wrong number
+// of fields.
+static int book_from_csv_record(const CsvField* fields, int field_count, Book* book, StringArena* strings,
+                                InternTable* authors, InternTable* genres) {
+    // Handle both old (8 column) and new (9 column) formats
+    if (field_count != 8 && field_count != 9) {
+        return 0;
+    }
+    
+    memset(book, 0, sizeof(Book)); // Initialize all fields to 0/NULL
+    
+    book->title = csv_field_to_arena(&fields[0], strings);
+    book->author_id = csv_field_to_id(&fields[1], strings, authors);
+    book->isbn = csv_field_to_arena(&fields[2], strings);
+    book->genre_id = csv_field_to_id(&fields[3], strings, genres);
+    book->cover_type = (CoverType)csv_field_int(&fields[4]);
+    book->condition = (Condition)csv_field_int(&fields[5]);
+    book->word_count = csv_field_int(&fields[6]);
+    book->year_published = csv_field_int(&fields[7]);
+    
+    // Handle metadata_retrieved flag (if present in the CSV)
+    if (field_count == 9) {
+        book->metadata_retrieved = csv_field_int(&fields[8]);
+    } else {
+        book->metadata_retrieved = 0; // Default for backward compatibility
+    }
+    return 1;
+}
+
+// Load the remaining records from a reader one at a time
+static void load_csv_records(Library* library, CsvReader* reader) {
+    CsvField fields[CSV_MAX_FIELDS];
+    int field_count;
+    
+    while (csv_next_record(reader, fields, CSV_MAX_FIELDS, &field_count)) {
+        Book book;
+        if (!book_from_csv_record(fields, field_count, &book, &library->strings,
+                                  &library->authors, &library->genres)) {
+            printf("Warning: Line %ld contains %d fields (expected 8 or 9), skipping\n", 
+                   reader->record_line, field_count);
+            continue;
+        }
+        
+        // Add book to library - this will handle resizing if needed
+        if (append_book(library, &book) < 0) {
+            printf("Failed to expand library capacity. Cannot add more books.\n");
             break;
         }
     }
     
-    size_t pos = 0;
+    if (reader->unterminated) {
+        printf("Warning: Line %ld starts a quoted field that is never closed\n", reader->record_line);
+    }
+}
+
+// A record skipped during a parallel load, reported once all threads finish
+typedef struct {
+    long line;
+    int field_count;
+} SkippedRecord;
+
+// One byte range of a parallel load and the books parsed from it
+typedef struct {
+    const char* begin;       // Raw split point, then first record of the range
+    const char* end;         // End of the range
+    size_t quotes;           // Quote characters in the raw range
+    long lines;              // Line feeds in the raw range
+    long first_line;         // Line number of the first record
+    int record_bytes;        // Estimated bytes per record, for sizing the buffer
+    Book* books;             // Books parsed from this range
+    StringArena strings;     // Their strings, rebased when stitched into the library
+    InternTable authors;     // Range-local author and genre IDs, remapped when stitched
+    InternTable genres;
+    int count;
+    int capacity;
+    SkippedRecord* skipped;  // Records with the wrong number of fields
+    int skipped_count;
+    int skipped_capacity;
+    long unterminated_line;  // Line of a quoted field still open at the range end (0 = none)
+    int failed;              // Ran out of memory
+} LoadChunk;
+
+// First pass: count quotes and line feeds so each split point's quote state is known
+static void* count_csv_chunk(void* arg) {
+    LoadChunk* chunk = (LoadChunk*)arg;
+    csv_count_quotes_and_lines(chunk->begin, (size_t)(chunk->end - chunk->begin), &chunk->quotes, &chunk->lines);
+    return NULL;
+}
+
+// Second pass: parse one range of whole records into the chunk's own buffer
+static void* parse_csv_chunk(void* arg) {
+    LoadChunk* chunk = (LoadChunk*)arg;
+    size_t size = (size_t)(chunk->end - chunk->begin);
     
-    if (needs_quotes && pos < output_size - 1) {
-        output[pos++] = '"';
+    chunk->capacity = (int)(size / (size_t)chunk->record_bytes) + 16;
+    chunk->books = (Book*)malloc(sizeof(Book) * chunk->capacity);
+    if (!chunk->books) {
+        chunk->failed = 1;
+        return NULL;
     }
     
-    for (const char* p = input; *p && pos < output_size - 2 - needs_quotes; p++) {
-        // Double up quotes for escaping
-        if (*p == '"') {
-            output[pos++] = '"';
-            if (pos < output_size - 2 - needs_quotes) {
-                output[pos++] = '"';
+    CsvReader reader;
+    csv_reader_init(&reader, chunk->begin, size);
+    reader.line = chunk->first_line;
+    
+    CsvField fields[CSV_MAX_FIELDS];
+    int field_count;
+    
+    while (csv_next_record(&reader, fields, CSV_MAX_FIELDS, &field_count)) {
+        if (chunk->count >= chunk->capacity) {
+            int new_capacity = chunk->capacity * GROWTH_FACTOR;
+            Book* new_books = (Book*)realloc(chunk->books, sizeof(Book) * new_capacity);
+            if (!new_books) {
+                chunk->failed = 1;
+                return NULL;
             }
-        } else {
-            output[pos++] = *p;
+            chunk->books = new_books;
+            chunk->capacity = new_capacity;
+        }
+        
+        if (book_from_csv_record(fields, field_count, &chunk->books[chunk->count], &chunk->strings,
+                                 &chunk->authors, &chunk->genres)) {
+            chunk->count++;
+            continue;
+        }
+        
+        if (chunk->skipped_count >= chunk->skipped_capacity) {
+            int new_capacity = chunk->skipped_capacity ? chunk->skipped_capacity * 2 : 16;
+            SkippedRecord* new_skipped = (SkippedRecord*)realloc(chunk->skipped, sizeof(SkippedRecord) * new_capacity);
+            if (!new_skipped) {
+                chunk->failed = 1;
+                return NULL;
+            }
+            chunk->skipped = new_skipped;
+            chunk->skipped_capacity = new_capacity;
         }
+        chunk->skipped[chunk->skipped_count].line = reader.record_line;
+        chunk->skipped[chunk->skipped_count].field_count = field_count;
+        chunk->skipped_count++;
     }
     
-    if (needs_quotes && pos < output_size - 1) {
-        output[pos++] = '"';
+    if (reader.unterminated) {
+        chunk->unterminated_line = reader.record_line;
     }
+    return NULL;
+}
+
+// Run fn on every chunk, one thread each. Returns 0 if a thread could not be started.
+static int run_load_threads(LoadChunk* chunks, int thread_count, void* (*fn)(void*)) {
+    pthread_t threads[MAX_LOAD_THREADS];
+    int started = 0;
     
-    output[pos] = '\0';
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&threads[i], NULL, fn, &chunks[i]) != 0) {
+            break;
+        }
+        started++;
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    return started == thread_count;
 }
 
-// Save library to CSV file
-int save_library_to_csv(const Library* library, const char* filename) {
-    // Skip if library is empty
-    if (library->count == 0) {
-        printf("Library is empty. Nothing to save.\n");
-        return 1;
+// Estimate bytes per record from the first few records after the header
+static int estimate_record_bytes(const char* data, size_t size) {
+    CsvReader reader;
+    CsvField fields[CSV_MAX_FIELDS];
+    int field_count;
+    int records = 0;
+    
+    csv_reader_init(&reader, data, size);
+    while (records < 256 && csv_next_record(&reader, fields, CSV_MAX_FIELDS, &field_count)) {
+        records++;
     }
     
-    FILE* file = fopen(filename, "w");
-    if (!file) {
-        perror("Error opening file for writing");
-        return 0;
+    int estimate = records > 0 ? (int)((reader.cursor - data) / records) : 64;
+    return estimate > 16 ? estimate : 16;
+}
+
+// Intern a loader thread's dictionary into the library's. Returns the library ID
+// for each of the range's IDs (to be freed by the caller), or NULL if out of memory.
+static uint32_t* remap_intern_ids(Library* library, InternTable* table, const InternTable* local,
+                                  const StringArena* local_strings) {
+    uint32_t* ids = (uint32_t*)malloc(sizeof(uint32_t) * (local->count + 1));
+    if (!ids) {
+        fprintf(stderr, "Memory allocation failed while merging dictionaries\n");
+        return NULL;
     }
     
-    // Write CSV header
-    fprintf(file, "title,author,isbn,genre,cover_type,condition,word_count,year_published,metadata_retrieved\n");
+    ids[INTERN_EMPTY] = INTERN_EMPTY;
+    for (uint32_t id = 1; id < local->count; id++) {
+        StrRef ref = local->values[id];
+        ids[id] = intern_add(table, &library->strings, arena_get(local_strings, ref), ref.length);
+    }
+    return ids;
+}
+
+// Load the records in [data, end) using several threads. The range is split at
+// even byte offsets; each split point's quote state comes from the quote counts
+// before it, so ranges can be moved forward to the next line feed outside
+// quotes. Returns 0 without touching the library if the split turned out not to
+// match the file's records (only possible with stray quotes), so the caller can
+// fall back to a serial load.
+static int load_csv_records_parallel(Library* library, const char* data, const char* end,
+                                     long first_line, int thread_count) {
+    LoadChunk chunks[MAX_LOAD_THREADS];
+    size_t size = (size_t)(end - data);
     
-    char escaped_title[200];
-    char escaped_author[200];
-    char escaped_isbn[40];
-    char escaped_genre[100];
+    memset(chunks, 0, sizeof(LoadChunk) * thread_count);
+    for (int i = 0; i < thread_count; i++) {
+        chunks[i].begin = data + size * i / thread_count;
+        chunks[i].end = data + size * (i + 1) / thread_count;
+    }
+    
+    if (!run_load_threads(chunks, thread_count, count_csv_chunk)) {
+        return 0;
+    }
     
-    // Write each book as a CSV row
-    for (int i = 0; i < library->count; i++) {
-        const Book* book = &library->books[i];
+    // Move each split point to the start of the next record
+    int record_bytes = estimate_record_bytes(data, size);
+    size_t quotes_before = 0;
+    long lines_before = 0;
+    for (int i = 0; i < thread_count; i++) {
+        const char* split = chunks[i].begin;
+        long line = first_line + lines_before;
         
-        escape_csv_field(book->title, escaped_title, sizeof(escaped_title));
-        escape_csv_field(book->author, escaped_author, sizeof(escaped_author));
-        escape_csv_field(book->isbn, escaped_isbn, sizeof(escaped_isbn));
-        escape_csv_field(book->genre, escaped_genre, sizeof(escaped_genre));
+        if (i > 0) {
+            const char* start = csv_resync(split, end, (int)(quotes_before & 1), &line);
+            if (start < chunks[i - 1].begin) {
+                start = chunks[i - 1].begin;
+            }
+            // A record longer than a whole range leaves this range empty
+            if (start == chunks[i - 1].begin) {
+                line = chunks[i - 1].first_line;
+            }
+            chunks[i].begin = start;
+            chunks[i - 1].end = start;
+        }
         
-        fprintf(file, "%s,%s,%s,%s,%d,%d,%d,%d,%d\n",
-                escaped_title,
-                escaped_author,
-                escaped_isbn,
-                escaped_genre,
-                book->cover_type,
-                book->condition,
-                book->word_count,
-                book->year_published,
-                book->metadata_retrieved);
+        chunks[i].first_line = line;
+        chunks[i].record_bytes = record_bytes;
+        quotes_before += chunks[i].quotes;
+        lines_before += chunks[i].lines;
     }
+    chunks[thread_count - 1].end = end;
     
-    fclose(file);
-    printf("Library saved to %s\n", filename);
-    return 1;
-}
-
-// Parse a CSV line into tokens
-static int parse_csv_line(char* line, char** tokens, int max_tokens) {
-    int count = 0;
-    int in_quotes = 0;
-    char* p = line;
-    tokens[count++] = p;
+    int ok = run_load_threads(chunks, thread_count, parse_csv_chunk);
     
-    while (*p && count < max_tokens) {
-        if (*p == '"') {
-            in_quotes = !in_quotes;
-        } else if (*p == ',' && !in_quotes) {
-            *p = '\0';
-            tokens[count++] = p + 1;
+    // Every range but the last must end outside quotes, or the split was wrong
+    int total = 0;
+    for (int i = 0; i < thread_count; i++) {
+        if (chunks[i].failed || (i < thread_count - 1 && chunks[i].unterminated_line)) {
+            ok = 0;
         }
-        p++;
+        total += chunks[i].count;
     }
     
-    // Remove quotes from quoted fields
-    for (int i = 0; i < count; i++) {
-        char* field = tokens[i];
-        size_t len = strlen(field);
-        
-        if (len >= 2 && field[0] == '"' && field[len-1] == '"') {
-            // Shift left to remove opening quote
-            memmove(field, field + 1, len - 1);
-            // Replace closing quote with null terminator
-            field[len - 2] = '\0';
+    // Stitch the ranges together with a single allocation for books and one for
+    // strings (room for the range's strings, plus authors and genres new to the library)
+    size_t string_bytes = 0;
+    for (int i = 0; i < thread_count; i++) {
+        string_bytes += chunks[i].strings.size;
+        for (uint32_t id = 1; id < chunks[i].authors.count; id++) {
+            string_bytes += chunks[i].authors.values[id].length + 1;
+        }
+        for (uint32_t id = 1; id < chunks[i].genres.count; id++) {
+            string_bytes += chunks[i].genres.values[id].length + 1;
+        }
+    }
+    if (ok) {
+        ok = library_reserve(library, library->count + total);
+    }
+    if (ok) {
+        ok = arena_reserve(&library->strings, string_bytes);
+    }
+    
+    for (int i = 0; i < thread_count; i++) {
+        uint32_t* author_ids = NULL;
+        uint32_t* genre_ids = NULL;
+        if (ok) {
+            author_ids = remap_intern_ids(library, &library->authors, &chunks[i].authors, &chunks[i].strings);
+            genre_ids = remap_intern_ids(library, &library->genres, &chunks[i].genres, &chunks[i].strings);
+            ok = author_ids && genre_ids;
+        }
+        if (ok) {
+            for (int s = 0; s < chunks[i].skipped_count; s++) {
+                printf("Warning: Line %ld contains %d fields (expected 8 or 9), skipping\n", 
+                       chunks[i].skipped[s].line, chunks[i].skipped[s].field_count);
+            }
             
-            // Handle doubled quotes inside field
-            char* src = field;
-            char* dst = field;
-            while (*src) {
-                if (*src == '"' && *(src + 1) == '"') {
-                    *dst++ = '"';
-                    src += 2;
-                } else {
-                    *dst++ = *src++;
-                }
+            // Move the range's strings to the end of the library arena and rebase its books
+            uint32_t base = (uint32_t)library->strings.size;
+            if (chunks[i].strings.size > 0) {
+                memcpy(library->strings.data + base, chunks[i].strings.data, chunks[i].strings.size);
+                library->strings.size += chunks[i].strings.size;
             }
-            *dst = '\0';
+            for (int b = 0; b < chunks[i].count; b++) {
+                Book* book = library_book(library, library->count + b);
+                *book = chunks[i].books[b];
+                book->title.offset += base;
+                book->isbn.offset += base;
+                book->author_id = author_ids[book->author_id];
+                book->genre_id = genre_ids[book->genre_id];
+            }
+            library_commit_appended(library, chunks[i].count, NULL);
         }
+        free(author_ids);
+        free(genre_ids);
+        free(chunks[i].books);
+        free(chunks[i].skipped);
+        arena_free(&chunks[i].strings);
+        intern_free(&chunks[i].authors);
+        intern_free(&chunks[i].genres);
     }
     
-    return count;
+    if (ok && chunks[thread_count - 1].unterminated_line) {
+        printf("Warning: Line %ld starts a quoted field that is never closed\n",
+               chunks[thread_count - 1].unterminated_line);
+    }
+    return ok;
 }
 
 // Load library from CSV file
 int load_library_from_csv(Library* library, const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
+    return load_library_from_csv_parallel(library, filename, 0);
+}
+
+// Load library from CSV file, parsing with up to `threads` threads (0 = one per
+// online core). Small files are always loaded on the calling thread.
+int load_library_from_csv_parallel(Library* library, const char* filename, int threads) {
+    CsvFile csv;
+    if (!csv_file_open(&csv, filename)) {
         // It's not an error if the file doesn't exist yet
         FILE* new_file = fopen(filename, "w");
         if (new_file) {
@@ -248,92 +1539,195 @@ int load_library_from_csv(Library* library, const char* filename) {
         return 0;
     }
     
-    char line[1024];
-    int line_num = 0;
-    
     // Note: We don't initialize library here anymore as it should be initialized before calling this function
     // The library is already initialized in main()
     
-    // Read and parse each line
-    while (fgets(line, sizeof(line), file)) {
-        line_num++;
-        
-        // Remove newline character if present
-        size_t len = strlen(line);
-        if (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r')) {
-            line[len-1] = '\0';
-            // Also handle \r\n
-            if (len > 1 && line[len-2] == '\r') {
-                line[len-2] = '\0';
+    // Tokenize records directly over the mapped file, skipping the header row
+    CsvReader reader;
+    CsvField fields[CSV_MAX_FIELDS];
+    int field_count;
+    csv_reader_init(&reader, csv.data, csv.size);
+    csv_next_record(&reader, fields, CSV_MAX_FIELDS, &field_count);
+    
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    size_t remaining = (size_t)(reader.end - reader.cursor);
+    if ((size_t)threads > remaining / PARALLEL_LOAD_MIN_BYTES) {
+        threads = (int)(remaining / PARALLEL_LOAD_MIN_BYTES);
+    }
+    if (threads > MAX_LOAD_THREADS) {
+        threads = MAX_LOAD_THREADS;
+    }
+    
+    if (threads < 2 || !load_csv_records_parallel(library, reader.cursor, reader.end, reader.line, threads)) {
+        load_csv_records(library, &reader);
+    }
+    
+    csv_file_close(&csv);
+    library_refresh_columns(library);
+    printf("Loaded %d books from %s\n", library_book_count(library), filename);
+    return 1;
+}
+
+// Apply one replayed journal record without logging it again
+static void apply_journal_record(void* context, const JournalRecord* record) {
+    Library* library = (Library*)context;
+    Book book;
+    
+    switch (record->op) {
+        case JOURNAL_ADD:
+            book_from_record(library, &record->book, &book);
+            append_book(library, &book);
+            break;
+        case JOURNAL_DELETE:
+            if (library_is_live(library, record->index)) {
+                remove_book_at(library, record->index);
             }
-        }
-        
-        // Skip header row
-        if (line_num == 1) {
-            continue;
-        }
-        
-        // Parse CSV line
-        char* tokens[9];
-        int token_count = parse_csv_line(line, tokens, 9);
-        
-        // Handle both old (8 column) and new (9 column) formats
-        if (token_count != 8 && token_count != 9) {
-            printf("Warning: Line %d contains %d fields (expected 8 or 9), skipping\n", 
-                   line_num, token_count);
-            continue;
-        }
-        
-        // Create new book from parsed data
-        Book book;
-        memset(&book, 0, sizeof(Book)); // Initialize all fields to 0/NULL
-        
-        strncpy(book.title, tokens[0], sizeof(book.title) - 1);
-        book.title[sizeof(book.title) - 1] = '\0';
-        
-        strncpy(book.author, tokens[1], sizeof(book.author) - 1);
-        book.author[sizeof(book.author) - 1] = '\0';
-        
-        strncpy(book.isbn, tokens[2], sizeof(book.isbn) - 1);
-        book.isbn[sizeof(book.isbn) - 1] = '\0';
-        
-        strncpy(book.genre, tokens[3], sizeof(book.genre) - 1);
-        book.genre[sizeof(book.genre) - 1] = '\0';
-        book.cover_type = (CoverType)atoi(tokens[4]);
-        book.condition = (Condition)atoi(tokens[5]);
-        book.word_count = atoi(tokens[6]);
-        book.year_published = atoi(tokens[7]);
-        
-        // Handle metadata_retrieved flag (if present in the CSV)
-        if (token_count == 9) {
-            book.metadata_retrieved = atoi(tokens[8]);
-        } else {
-            book.metadata_retrieved = 0; // Default for backward compatibility
-        }
-        
-        // Add book to library - this will handle resizing if needed
-        add_book(library, &book);
+            break;
+        case JOURNAL_REMOVE:
+            if (library_is_live(library, record->index)) {
+                free_slot(library, record->index);
+            }
+            break;
+        case JOURNAL_UPDATE:
+            if (library_is_live(library, record->index)) {
+                unindex_book(library, record->index);
+                book_from_record(library, &record->book, library_book(library, record->index));
+                sync_columns(library, record->index);
+                index_book(library, record->index);
+            }
+            break;
+    }
+}
+
+// Checksum naming the file a journal extends: a snapshot's own header
+// checksums, or the contents of a library still kept as CSV
+static uint64_t journal_base_checksum(const char* file) {
+    uint64_t checksum = snapshot_checksum(file);
+    return checksum ? checksum : csv_file_checksum(file);
+}
+
+// Replay the journal on top of the loaded snapshot and log further changes to it
+int open_library_journal(Library* library, Journal* journal, const char* journal_file, const char* snapshot_file) {
+    if (!journal_open(journal, journal_file, snapshot_file, journal_base_checksum(snapshot_file),
+                      apply_journal_record, library)) {
+        printf("Warning: Changes will be saved by rewriting %s.\n", snapshot_file);
+        return 0;
+    }
+    
+    if (journal->records > 0) {
+        printf("Replayed %ld changes from %s\n", journal->records, journal_file);
+    }
+    library->journal = journal;
+    library->snapshot_file = snapshot_file;
+    return 1;
+}
+
+// Make pending changes durable. With a journal this is one append and one sync
+// for all changes since the last commit; the journal is folded into a new
+// snapshot once it grows past half the snapshot's size.
+int commit_library_changes(Library* library) {
+    Journal* journal = library->journal;
+    if (!journal) {
+        return compact_library(library);
+    }
+    
+    if (!journal_commit(journal)) {
+        return 0;
     }
     
-    fclose(file);
-    printf("Loaded %d books from %s\n", library->count, filename);
+    if (journal->size > JOURNAL_COMPACT_MIN_BYTES && journal->size > journal->snapshot_size / 2) {
+        return compact_library(library);
+    }
     return 1;
 }
 
+// Close the gaps left by deleted books, write the whole library as a new
+// snapshot and empty the journal. Journal records name slots, so the
+// compacted slots and the new snapshot must agree.
+int compact_library(Library* library) {
+    if (library_compact(library, NULL, 0) < 0 || !save_library_to_snapshot(library, library->snapshot_file)) {
+        return 0;
+    }
+    return library->journal ? journal_reset(library->journal, library->snapshot_file,
+                                            journal_base_checksum(library->snapshot_file)) : 1;
+}
+
+// Load the library and replay its journal. The binary snapshot is the primary
+// store; a library that only exists as CSV (from older versions) is converted
+// once, as is a journal in an older record format. Returns 0 if the snapshot is damaged, so nothing overwrites it.
+int load_library(Library* library, Journal* journal) {
+    if (access(DEFAULT_SNAPSHOT_FILE, F_OK) == 0) {
+        if (!load_library_from_snapshot(library, DEFAULT_SNAPSHOT_FILE)) {
+            return 0;
+        }
+        open_library_journal(library, journal, DEFAULT_JOURNAL_FILE, DEFAULT_SNAPSHOT_FILE);
+        return library->journal && journal->legacy ? compact_library(library) : 1;
+    }
+    
+    if (access(DEFAULT_CSV_FILE, F_OK) == 0) {
+        load_library_from_csv(library, DEFAULT_CSV_FILE);
+        open_library_journal(library, journal, DEFAULT_JOURNAL_FILE, DEFAULT_CSV_FILE);
+        printf("Converting %s to %s (use 'export-csv' to write a CSV copy later)\n",
+               DEFAULT_CSV_FILE, DEFAULT_SNAPSHOT_FILE);
+        library->snapshot_file = DEFAULT_SNAPSHOT_FILE;
+        return compact_library(library);
+    }
+    
+    // New library: the snapshot is written by the first compaction
+    open_library_journal(library, journal, DEFAULT_JOURNAL_FILE, DEFAULT_SNAPSHOT_FILE);
+    return library->journal && journal->legacy ? compact_library(library) : 1;
+}
+
+// Clear a book's metadata_retrieved flag so the next fetch refreshes it
+void reset_book_metadata_flag(Library* library, int index) {
+    unindex_book(library, index);
+    library_book(library, index)->metadata_retrieved = 0;
+    index_book(library, index);
+    sync_columns(library, index);
+    log_change(library, JOURNAL_UPDATE, index);
+}
+
 // Interactive CLI functions
+// Check an ISBN typed or scanned for a new book. It must be a valid ISBN-10
+// or ISBN-13, and the library must not own it already in any written form.
+// An empty ISBN passes. Returns 1 if the book may be added.
+static int check_new_isbn(Library* library, const char* isbn) {
+    if (isbn[0] == '\0') {
+        return 1;
+    }
+    
+    uint64_t key = isbn_key(isbn, strlen(isbn));
+    if (key == ISBN_KEY_NONE) {
+        printf("\n%s is not a valid ISBN (wrong length or check digit). Book not added.\n", isbn);
+        return 0;
+    }
+    
+    BookHandle handle;
+    if (find_books_by_isbn(library, key, &handle, 1) > 0) {
+        char canonical[ISBN_TEXT_SIZE];
+        isbn_format(key, canonical);
+        const Book* book = library_get(library, handle);
+        BookStrings strings;
+        get_book_strings(library, book, &strings);
+        printf("\nYou already own ISBN %s. Book not added:\n", canonical);
+        print_book(book, &strings);
+        return 0;
+    }
+    return 1;
+}
+
 void interactive_add_book(Library* library) {
-    Book new_book;
-    char buffer[256];
+    BookRecord new_book;
+    char buffer[1024];
     int cover_choice, condition_choice, input_method;
     
     printf("\nADD NEW BOOK\n");
     printf("------------\n");
     
     // Initialize the book with zeros
-    memset(&new_book, 0, sizeof(Book));
-    
-    // Explicitly set metadata_retrieved to 0
-    new_book.metadata_retrieved = 0;
+    book_record_init(&new_book);
     
     // Choose input method
     printf("How would you like to add this book?\n");
@@ -351,12 +1745,16 @@ void interactive_add_book(Library* library) {
         // Read ISBN from stdin (simulating barcode scanner input)
         fgets(buffer, sizeof(buffer), stdin);
         buffer[strcspn(buffer, "\n")] = 0; // Remove newline
+        printf("ISBN scanned: %s\n", buffer);
         
-        // Store the ISBN
-        strncpy(new_book.isbn, buffer, sizeof(new_book.isbn) - 1);
-        new_book.isbn[sizeof(new_book.isbn) - 1] = '\0';
+        // Reject misreads and books we already have before asking for more
+        if (!check_new_isbn(library, buffer)) {
+            book_record_free(&new_book);
+            return;
+        }
         
-        printf("ISBN scanned: %s\n", new_book.isbn);
+        // Store the ISBN
+        book_record_set(&new_book.isbn, buffer, strlen(buffer));
         
         // Ask if user wants to add minimal required info or fetch later
         printf("\nWould you like to:\n");
@@ -370,11 +1768,14 @@ void interactive_add_book(Library* library) {
         if (details_choice == 2) {
             // User wants to save with just ISBN
             printf("Adding book with ISBN only. Using temporary title...\n");
-            sprintf(new_book.title, "Book with ISBN: %s", new_book.isbn);
+            char title[sizeof(buffer) + 32];
+            int title_length = snprintf(title, sizeof(title), "Book with ISBN: %s", new_book.isbn);
+            book_record_set(&new_book.title, title, (size_t)title_length);
             
             // Add the book to the library with minimal information
             add_book(library, &new_book);
-            save_library_to_csv(library, DEFAULT_CSV_FILE);
+            commit_library_changes(library);
+            book_record_free(&new_book);
             printf("\nBook added! Run 'fetch-metadata' to retrieve full details.\n");
             return;
         }
@@ -386,30 +1787,30 @@ void interactive_add_book(Library* library) {
         printf("Enter ISBN (optional, press enter to skip): ");
         fgets(buffer, sizeof(buffer), stdin);
         buffer[strcspn(buffer, "\n")] = 0; // Remove newline
-        strncpy(new_book.isbn, buffer, sizeof(new_book.isbn) - 1);
-        new_book.isbn[sizeof(new_book.isbn) - 1] = '\0';
+        if (!check_new_isbn(library, buffer)) {
+            book_record_free(&new_book);
+            return;
+        }
+        book_record_set(&new_book.isbn, buffer, strlen(buffer));
     }
     
     // Get title
     printf("Enter title: ");
     fgets(buffer, sizeof(buffer), stdin);
     buffer[strcspn(buffer, "\n")] = 0; // Remove newline
-    strncpy(new_book.title, buffer, sizeof(new_book.title) - 1);
-    new_book.title[sizeof(new_book.title) - 1] = '\0';
+    book_record_set(&new_book.title, buffer, strlen(buffer));
     
     // Get author
     printf("Enter author: ");
     fgets(buffer, sizeof(buffer), stdin);
     buffer[strcspn(buffer, "\n")] = 0; // Remove newline
-    strncpy(new_book.author, buffer, sizeof(new_book.author) - 1);
-    new_book.author[sizeof(new_book.author) - 1] = '\0';
+    book_record_set(&new_book.author, buffer, strlen(buffer));
     
     // Get genre (as a string now)
     printf("Enter genre: ");
     fgets(buffer, sizeof(buffer), stdin);
     buffer[strcspn(buffer, "\n")] = 0; // Remove newline
-    strncpy(new_book.genre, buffer, sizeof(new_book.genre) - 1);
-    new_book.genre[sizeof(new_book.genre) - 1] = '\0';
+    book_record_set(&new_book.genre, buffer, strlen(buffer));
     
     // Get cover type
     printf("Select cover type:\n");
@@ -454,31 +1855,57 @@ void interactive_add_book(Library* library) {
     add_book(library, &new_book);
     
     // Save the updated library
-    save_library_to_csv(library, DEFAULT_CSV_FILE);
+    commit_library_changes(library);
+    book_record_free(&new_book);
 }
 
 void interactive_lookup_book(Library* library) {
-    char title[100];
+    char title[1024];
     
     printf("\nLOOKUP BOOK\n");
     printf("-----------\n");
-    printf("Enter book title: ");
+    printf("Enter book title or ISBN: ");
     
     fgets(title, sizeof(title), stdin);
     title[strcspn(title, "\n")] = 0; // Remove newline
     
-    Book* book = find_book_by_title(library, title);
+    // A title comes first; failing that, the input may be an ISBN in any form
+    BookHandle handles[LOOKUP_MAX_MATCHES];
+    int matches = find_books_by_title(library, title, handles, LOOKUP_MAX_MATCHES);
+    if (matches == 0) {
+        uint64_t key = isbn_key_unchecked(title, strlen(title));
+        if (key != ISBN_KEY_NONE) {
+            matches = find_books_by_isbn(library, key, handles, LOOKUP_MAX_MATCHES);
+        }
+    }
     
-    if (book) {
+    if (matches == 1) {
         printf("\nBook found:\n");
-        print_book(book);
+    } else if (matches > 1) {
+        printf("\n%d books found:\n", matches);
     } else {
-        printf("\nBook not found: %s\n", title);
+        // No exact title or ISBN; the words may still be part of a title or author
+        printf("\nNo book titled %s.\n", title);
+        print_search_results(library, title);
+        return;
+    }
+    
+    for (int i = 0; i < matches && i < LOOKUP_MAX_MATCHES; i++) {
+        const Book* book = library_get(library, handles[i]);
+        BookStrings strings;
+        get_book_strings(library, book, &strings);
+        if (i > 0) {
+            printf("\n");
+        }
+        print_book(book, &strings);
+    }
+    if (matches > LOOKUP_MAX_MATCHES) {
+        printf("\n(%d more not shown)\n", matches - LOOKUP_MAX_MATCHES);
     }
 }
 
 void interactive_delete_book(Library* library) {
-    char title[100];
+    char title[1024];
     char confirm[10];
     
     printf("\nDELETE BOOK\n");
@@ -488,11 +1915,38 @@ void interactive_delete_book(Library* library) {
     fgets(title, sizeof(title), stdin);
     title[strcspn(title, "\n")] = 0; // Remove newline
     
-    Book* book = find_book_by_title(library, title);
+    BookHandle handles[LOOKUP_MAX_MATCHES];
+    int matches = find_books_by_title(library, title, handles, LOOKUP_MAX_MATCHES);
+    BookHandle handle = matches > 0 ? handles[0] : BOOK_HANDLE_NONE;
+    
+    // Several books share the title: let the user pick one
+    if (matches > 1) {
+        int shown = matches < LOOKUP_MAX_MATCHES ? matches : LOOKUP_MAX_MATCHES;
+        printf("\n%d books have this title:\n", matches);
+        for (int i = 0; i < shown; i++) {
+            const Book* match = library_get(library, handles[i]);
+            BookStrings strings;
+            get_book_strings(library, match, &strings);
+            printf("\n%d) ", i + 1);
+            print_book(match, &strings);
+        }
+        
+        printf("\nEnter the number of the book to delete (1-%d): ", shown);
+        fgets(confirm, sizeof(confirm), stdin);
+        int choice = atoi(confirm);
+        handle = choice >= 1 && choice <= shown ? handles[choice - 1] : BOOK_HANDLE_NONE;
+        if (handle == BOOK_HANDLE_NONE) {
+            printf("Deletion cancelled.\n");
+            return;
+        }
+    }
+    Book* book = library_get(library, handle);
     
     if (book) {
         printf("\nFound book to delete:\n");
-        print_book(book);
+        BookStrings strings;
+        get_book_strings(library, book, &strings);
+        print_book(book, &strings);
         
         printf("\nAre you sure you want to delete this book? (yes/no): ");
         fgets(confirm, sizeof(confirm), stdin);
@@ -504,9 +1958,9 @@ void interactive_delete_book(Library* library) {
         }
         
         if (strcmp(confirm, "yes") == 0 || strcmp(confirm, "y") == 0) {
-            if (delete_book_by_title(library, title)) {
+            if (library_delete(library, handle)) {
                 printf("Book deleted successfully.\n");
-                save_library_to_csv(library, DEFAULT_CSV_FILE);
+                commit_library_changes(library);
             } else {
                 printf("Error deleting book.\n");
             }
@@ -518,243 +1972,435 @@ void interactive_delete_book(Library* library) {
     }
 }
 
-// Structure to store response data from API calls
-struct MemoryStruct {
-    char *memory;
-    size_t size;
-};
+// Fill a book from the JSON object the API returns for a single ISBN
+static int parse_book_json(const cJSON* book_data, BookRecord* book) {
+    int success = 0;
+    
+    // Extract title
+    cJSON *title = cJSON_GetObjectItem(book_data, "title");
+    if (title && title->valuestring) {
+        book_record_set(&book->title, title->valuestring, strlen(title->valuestring));
+        success = 1;
+    }
+    
+    // Extract authors (first author only)
+    cJSON *authors = cJSON_GetObjectItem(book_data, "authors");
+    if (authors && authors->type == cJSON_Array) {
+        cJSON *first_author = cJSON_GetArrayItem(authors, 0);
+        if (first_author) {
+            cJSON *name = cJSON_GetObjectItem(first_author, "name");
+            if (name && name->valuestring) {
+                book_record_set(&book->author, name->valuestring, strlen(name->valuestring));
+            }
+        }
+    }
+    
+    // Extract publication date
+    cJSON *publish_date = cJSON_GetObjectItem(book_data, "publish_date");
+    if (publish_date && publish_date->valuestring) {
+        int year = extract_year(publish_date->valuestring);
+        if (year > 0) {
+            book->year_published = year;
+        }
+    }
+    
+    // Extract genre from subjects
+    cJSON *subjects = cJSON_GetObjectItem(book_data, "subjects");
+    if (subjects && subjects->type == cJSON_Array && cJSON_GetArraySize(subjects) > 0) {
+        cJSON *first_subject = cJSON_GetArrayItem(subjects, 0);
+        if (first_subject && first_subject->type == cJSON_Object) {
+            cJSON *subject_name = cJSON_GetObjectItem(first_subject, "name");
+            if (subject_name && subject_name->valuestring) {
+                // Capitalize first letter for consistent formatting
+                const char* genre_str = subject_name->valuestring;
+                if (genre_str[0] != '\0') {
+                    book_record_set(&book->genre, genre_str, strlen(genre_str));
+                    book->genre[0] = toupper((unsigned char)book->genre[0]);
+                }
+            }
+        }
+    }
+    
+    // Try to determine number of pages/word count
+    cJSON *num_pages = cJSON_GetObjectItem(book_data, "number_of_pages");
+    if (num_pages && num_pages->type == cJSON_Number) {
+        // Estimate word count based on pages (rough estimate: 250 words per page)
+        book->word_count = num_pages->valueint * 250;
+    }
+    
+    return success;
+}
 
-// Callback function for curl to write response data
-static size_t WriteMemoryCallback(void *contents, size_t size, size_t nmemb, void *userp) {
-    size_t realsize = size * nmemb;
-    struct MemoryStruct *mem = (struct MemoryStruct *)userp;
+// Copy fetched fields onto a library book, keeping existing values where the source had none
+void update_book_metadata(Library* library, int index, const BookRecord* fetched) {
+    Book* book = library_book(library, index);
     
-    char *ptr = realloc(mem->memory, mem->size + realsize + 1);
-    if(!ptr) {
-        printf("Not enough memory (realloc returned NULL)\n");
-        return 0;
+    // The indexes key on the title and author, so the book leaves them while it changes
+    unindex_book(library, index);
+    
+    // Only update if we got actual data. Replaced titles and ISBNs stay in the
+    // arena until the library is next loaded from its snapshot.
+    if (fetched->title && fetched->title[0] != '\0') {
+        book->title = arena_add(&library->strings, fetched->title, strlen(fetched->title));
+    }
+    
+    if (fetched->author && fetched->author[0] != '\0') {
+        book->author_id = intern_add(&library->authors, &library->strings, fetched->author, strlen(fetched->author));
+    }
+    
+    if (fetched->year_published > 0) {
+        book->year_published = fetched->year_published;
     }
     
-    mem->memory = ptr;
-    memcpy(&(mem->memory[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->memory[mem->size] = 0;
+    // Update genre if found in API data
+    if (fetched->genre && fetched->genre[0] != '\0') {
+        book->genre_id = intern_add(&library->genres, &library->strings, fetched->genre, strlen(fetched->genre));
+    }
+    
+    // Update word count if estimated from page count
+    if (fetched->word_count > 0) {
+        book->word_count = fetched->word_count;
+    }
+    
+    // Mark this book as having its metadata retrieved
+    book->metadata_retrieved = 1;
+    index_book(library, index);
+    sync_columns(library, index);
+    log_change(library, JOURNAL_UPDATE, index);
+}
+
+// A group of books whose ISBNs are requested together in one bibkeys list
+typedef struct {
+    int* book_indices;  // Library slots
+    int count;          // Number of books in this batch
+} MetadataBatch;
+
+// State shared with the fetch engine's completion callback
+typedef struct {
+    Library* library;
+    FetchEngine* engine;
+    MetadataCache* cache;     // NULL when caching is disabled
+    MetadataBatch* batches;   // Indexed by the fetch job tag
+    int batch_count;
+    int batch_capacity;
+    int* followers;           // Books sharing an ISBN with one already requested
+    int follower_count;
+    RetryQueue* retry_queue;  // Persistent record of transient failures
+    int updated_count;
+    int retried_count;
+    int failed_count;
+} MetadataUpdate;
+
+// Build a request URL whose bibkeys lists every ISBN in the batch. Caller frees.
+static char* build_batch_url(const Library* library, const char* api_url, const MetadataBatch* batch) {
+    size_t size = strlen(api_url) + 64;
+    for (int i = 0; i < batch->count; i++) {
+        size += library_book(library, batch->book_indices[i])->isbn.length + 6; // "ISBN:" + ","
+    }
+    
+    char* url = (char*)malloc(size);
+    if (!url) {
+        return NULL;
+    }
     
-    return realsize;
+    size_t pos = (size_t)snprintf(url, size, "%s?bibkeys=", api_url);
+    for (int i = 0; i < batch->count; i++) {
+        pos += (size_t)snprintf(url + pos, size - pos, "%sISBN:%s", i > 0 ? "," : "",
+                                book_isbn(library, library_book(library, batch->book_indices[i])));
+    }
+    snprintf(url + pos, size - pos, "&format=json&jscmd=data");
+    return url;
 }
 
-// Function to fetch book information by ISBN from Open Library API
-int fetch_book_info_by_isbn(const char* isbn, Book* book) {
-    if (!isbn || !*isbn) {
-        printf("Error: ISBN is empty\n");
+// Register a batch and queue its request on the engine
+static int queue_metadata_batch(MetadataUpdate* update, const int* book_indices, int count) {
+    if (update->batch_count >= update->batch_capacity) {
+        int new_capacity = update->batch_capacity ? update->batch_capacity * GROWTH_FACTOR : 16;
+        MetadataBatch* new_batches = (MetadataBatch*)realloc(update->batches, sizeof(MetadataBatch) * new_capacity);
+        if (!new_batches) {
+            fprintf(stderr, "Memory allocation failed while batching ISBNs\n");
+            return 0;
+        }
+        update->batches = new_batches;
+        update->batch_capacity = new_capacity;
+    }
+    
+    MetadataBatch* batch = &update->batches[update->batch_count];
+    batch->book_indices = (int*)malloc(sizeof(int) * count);
+    if (!batch->book_indices) {
+        fprintf(stderr, "Memory allocation failed while batching ISBNs\n");
         return 0;
     }
+    memcpy(batch->book_indices, book_indices, sizeof(int) * count);
+    batch->count = count;
     
-    CURL *curl;
-    CURLcode res;
-    struct MemoryStruct chunk;
-    int success = 0;
+    char* url = build_batch_url(update->library, update->engine->session->options.api_url, batch);
+    if (!url) {
+        free(batch->book_indices);
+        fprintf(stderr, "Memory allocation failed while batching ISBNs\n");
+        return 0;
+    }
     
-    // Skip if the ISBN field is empty
-    if (strlen(isbn) == 0) {
+    int queued = fetch_engine_add(update->engine, url, update->batch_count);
+    free(url);
+    if (!queued) {
+        free(batch->book_indices);
         return 0;
     }
     
-    // Initialize the memory struct
-    chunk.memory = malloc(1);
-    chunk.size = 0;
+    update->batch_count++;
+    return 1;
+}
+
+// Parse one book out of a (possibly combined) response and apply it. Returns 1 if the key was present.
+static int apply_book_from_response(MetadataUpdate* update, const cJSON* root, int index) {
+    Library* library = update->library;
+    Book* book = library_book(library, index);
+    const char* isbn = book_isbn(library, book);
+    
+    // The response has the format: {"ISBN:XXXXXXXXXX": { ... book data ... }, ...}
+    char isbn_key[30];
+    snprintf(isbn_key, sizeof(isbn_key), "ISBN:%s", isbn);
     
-    curl = curl_easy_init();
-    if(curl) {
-        char url[256];
-        snprintf(url, sizeof(url), "https://openlibrary.org/api/books?bibkeys=ISBN:%s&format=json&jscmd=data", isbn);
-        
-        printf("Fetching data for ISBN: %s\n", isbn);
-        printf("URL: %s\n", url);
-        
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteMemoryCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    cJSON *book_data = cJSON_GetObjectItem(root, isbn_key);
+    if (!book_data) {
+        return 0;
+    }
+    
+    // Parse into a temporary book so partial data never clobbers good fields
+    BookRecord temp_book;
+    book_record_init(&temp_book);
+    
+    int parsed = parse_book_json(book_data, &temp_book);
+    if (update->cache) {
+        cache_store(update->cache, isbn, parsed ? &temp_book : NULL);
+    }
+    retry_queue_remove(update->retry_queue, isbn);
+    
+    if (parsed) {
+        update_book_metadata(library, index, &temp_book);
+        update->updated_count++;
+        printf("Updated book #%d: %s by %s (%d)\n", 
+               index+1, book_title(library, book), book_author(library, book), book->year_published);
+    }
+    book_record_free(&temp_book);
+    return 1;
+}
+
+// Apply a cached answer to a book. Returns 1 if the entry was a final answer.
+static int apply_cached_entry(MetadataUpdate* update, int index, const CacheEntry* entry) {
+    Library* library = update->library;
+    Book* book = library_book(library, index);
+    
+    if (entry->state == CACHE_FOUND) {
+        update_book_metadata(library, index, &entry->metadata);
+        update->updated_count++;
+        printf("Updated book #%d from cache: %s by %s (%d)\n", 
+               index+1, book_title(library, book), book_author(library, book), book->year_published);
+        return 1;
+    }
+    if (entry->state == CACHE_NOT_FOUND) {
+        printf("No data found for ISBN: %s (cached)\n", book_isbn(library, book));
+        return 1;
+    }
+    return 0;
+}
+
+// Handle one finished API request; tag is the index of the batch it was issued for.
+// Books missing from a multi-ISBN response are retried on their own; when the
+// transfer itself failed, the engine has already retried it and the whole batch
+// is left for a later run.
+static void on_metadata_fetched(void* context, int tag, int ok, int retryable, long http_status,
+                                long retry_after, const char* body, size_t size) {
+    MetadataUpdate* update = (MetadataUpdate*)context;
+    (void)size;
+    
+    // Copy the batch out: queueing retries may move the batch table
+    MetadataBatch batch = update->batches[tag];
+    
+    cJSON *root = ok ? cJSON_Parse(body) : NULL;
+    if (!ok) {
+        printf("Failed to fetch %d ISBN(s) (HTTP %ld)\n", batch.count, http_status);
+    } else if (!root) {
+        printf("Failed to parse JSON response for %d ISBN(s)\n", batch.count);
+    }
+    
+    for (int i = 0; i < batch.count; i++) {
+        int index = batch.book_indices[i];
+        const char* isbn = book_isbn(update->library, library_book(update->library, index));
         
-        res = curl_easy_perform(curl);
+        if (root && apply_book_from_response(update, root, index)) {
+            continue;
+        }
         
-        if(res != CURLE_OK) {
-            fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-        } else {
-            // Parse JSON response using cJSON
-            printf("Response: %s\n", chunk.memory);
-            
-            cJSON *root = cJSON_Parse(chunk.memory);
-            if (root) {
-                // The response has the format: {"ISBN:XXXXXXXXXX": { ... book data ... }}
-                char isbn_key[30];
-                snprintf(isbn_key, sizeof(isbn_key), "ISBN:%s", isbn);
-                
-                cJSON *book_data = cJSON_GetObjectItem(root, isbn_key);
-                if (book_data) {
-                    // Extract title
-                    cJSON *title = cJSON_GetObjectItem(book_data, "title");
-                    if (title && title->valuestring) {
-                        strncpy(book->title, title->valuestring, sizeof(book->title) - 1);
-                        book->title[sizeof(book->title) - 1] = '\0';
-                        success = 1;
-                    }
-                    
-                    // Extract authors (first author only)
-                    cJSON *authors = cJSON_GetObjectItem(book_data, "authors");
-                    if (authors && authors->type == cJSON_Array) {
-                        cJSON *first_author = cJSON_GetArrayItem(authors, 0);
-                        if (first_author) {
-                            cJSON *name = cJSON_GetObjectItem(first_author, "name");
-                            if (name && name->valuestring) {
-                                strncpy(book->author, name->valuestring, sizeof(book->author) - 1);
-                                book->author[sizeof(book->author) - 1] = '\0';
-                            }
-                        }
-                    }
-                    
-                    // Extract publication date
-                    cJSON *publish_date = cJSON_GetObjectItem(book_data, "publish_date");
-                    if (publish_date && publish_date->valuestring) {
-                        const char* date_str = publish_date->valuestring;
-                        size_t date_len = strlen(date_str);
-                        
-                        // Try to extract year from the date string (looking for 4 digit year)
-                        for (int i = 0; i <= (int)date_len - 4; i++) {
-                            if (isdigit(date_str[i]) && isdigit(date_str[i+1]) && 
-                                isdigit(date_str[i+2]) && isdigit(date_str[i+3])) {
-                                char year_str[5] = {0};
-                                strncpy(year_str, date_str + i, 4);
-                                int year = atoi(year_str);
-                                // Only use years that make sense (1400-2100)
-                                if (year >= 1400 && year <= 2100) {
-                                    book->year_published = year;
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                    
-                    // Extract genre from subjects
-                    cJSON *subjects = cJSON_GetObjectItem(book_data, "subjects");
-                    if (subjects && subjects->type == cJSON_Array && cJSON_GetArraySize(subjects) > 0) {
-                        cJSON *first_subject = cJSON_GetArrayItem(subjects, 0);
-                        if (first_subject && first_subject->type == cJSON_Object) {
-                            cJSON *subject_name = cJSON_GetObjectItem(first_subject, "name");
-                            if (subject_name && subject_name->valuestring) {
-                                // Capitalize first letter for consistent formatting
-                                char genre_str[50] = {0};
-                                strncpy(genre_str, subject_name->valuestring, sizeof(genre_str) - 1);
-                                if (genre_str[0] != '\0') {
-                                    genre_str[0] = toupper(genre_str[0]);
-                                    strncpy(book->genre, genre_str, sizeof(book->genre) - 1);
-                                    book->genre[sizeof(book->genre) - 1] = '\0';
-                                }
-                            }
-                        }
-                    }
-                    
-                    // Try to determine number of pages/word count
-                    cJSON *num_pages = cJSON_GetObjectItem(book_data, "number_of_pages");
-                    if (num_pages && num_pages->type == cJSON_Number) {
-                        // Estimate word count based on pages (rough estimate: 250 words per page)
-                        book->word_count = num_pages->valueint * 250;
-                    }
-                    
-                    printf("Successfully fetched book data: %s by %s (%d)\n", 
-                           book->title, book->author, book->year_published);
-                } else {
-                    printf("No data found in JSON response for ISBN: %s\n", isbn);
+        if (!ok) {
+            if (retryable) {
+                // Out of retries or out of time: remember it for the next run
+                retry_queue_record_failure(update->retry_queue, isbn, http_status, retry_after);
+                update->failed_count++;
+            } else if (http_status >= 400 && http_status < 500 && batch.count > 1) {
+                // One bad key or an overlong URL fails the whole request; ask for each ISBN on its own
+                if (queue_metadata_batch(update, &index, 1)) {
+                    update->retried_count++;
                 }
-                
-                cJSON_Delete(root);
-            } else {
-                printf("Failed to parse JSON for ISBN: %s\n", isbn);
+            } else if (http_status >= 400 && http_status < 500) {
+                // The API refused this ISBN outright (404 and the like); asking again will not help
+                if (update->cache) {
+                    cache_store(update->cache, isbn, NULL);
+                }
+                retry_queue_remove(update->retry_queue, isbn);
             }
+        } else if (!root) {
+            // An unreadable answer may come out right next time
+            retry_queue_record_failure(update->retry_queue, isbn, http_status, retry_after);
+            update->failed_count++;
+        } else if (batch.count > 1) {
+            // Missing from a combined answer: ask for it on its own
+            if (queue_metadata_batch(update, &index, 1)) {
+                update->retried_count++;
+            }
+        } else {
+            printf("No data found in JSON response for ISBN: %s\n", isbn);
+            if (update->cache) {
+                cache_store(update->cache, isbn, NULL);
+            }
+            retry_queue_remove(update->retry_queue, isbn);
         }
-        
-        curl_easy_cleanup(curl);
     }
     
-    free(chunk.memory);
-    return success;
+    if (root) {
+        cJSON_Delete(root);
+    }
 }
 
-// Function to update library books with metadata from Open Library API
-int update_library_with_api_data(Library* library) {
-    int updated_count = 0;
+// Function to update library books with metadata from Open Library API.
+// ISBNs are answered from the metadata cache where possible; the rest are
+// packed into batched requests that are issued concurrently over the session's
+// reusable connections. With the cache on, duplicate ISBNs are only requested
+// once (their copies wait for the first answer in the cache).
+int update_library_with_api_data(Library* library, FetchSession* session) {
+    FetchEngine engine;
+    fetch_engine_init(&engine, session);
+    
+    MetadataUpdate update;
+    memset(&update, 0, sizeof(update));
+    update.library = library;
+    update.engine = &engine;
+    update.cache = session->options.use_cache ? &session->cache : NULL;
+    update.retry_queue = &session->retry_queue;
+    time_t now = time(NULL);
+    
+    int batch_size = session->options.batch_size;
+    int* pending = (int*)malloc(sizeof(int) * batch_size);
+    int pending_count = 0;
+    int requested = 0;
     
-    // Initialize curl once for all requests
-    curl_global_init(CURL_GLOBAL_ALL);
+    update.followers = (int*)malloc(sizeof(int) * (library->count > 0 ? library->count : 1));
+    if (!pending || !update.followers) {
+        free(pending);
+        free(update.followers);
+        fprintf(stderr, "Memory allocation failed while batching ISBNs\n");
+        fetch_engine_free(&engine);
+        return 0;
+    }
     
+    int next_wanted = -1;
     for (int i = 0; i < library->count; i++) {
-        Book* book = &library->books[i];
+        Book* book = library_book(library, i);
         
-        // Skip books without an ISBN
-        if (book->isbn[0] == '\0') {
-            printf("Skipping book #%d: %s (no ISBN)\n", i+1, book->title);
+        // Find the next book with an ISBN and no metadata from the columns;
+        // everything before it is skipped
+        if (next_wanted < i) {
+            next_wanted = library_next_book(library, i, SCAN_HAS_ISBN | SCAN_NEEDS_METADATA);
+            if (next_wanted < 0) {
+                next_wanted = library->count;
+            }
+        }
+        if (i < next_wanted) {
+            if (!library_is_live(library, i)) {
+                continue;
+            }
+            if (book->isbn.length == 0) {
+                printf("Skipping book #%d: %s (no ISBN)\n", i+1, book_title(library, book));
+            } else {
+                printf("Skipping book #%d: %s (metadata already retrieved)\n", i+1, book_title(library, book));
+            }
             continue;
         }
         
-        // Skip books that already have metadata retrieved
-        if (book->metadata_retrieved) {
-            printf("Skipping book #%d: %s (metadata already retrieved)\n", i+1, book->title);
+        // Applying cached answers moves the arena, so only hold this for one book
+        const char* isbn = book_isbn(library, book);
+        
+        // Respect the backoff of ISBNs that failed in earlier runs
+        const RetryEntry* retry = retry_queue_find(update.retry_queue, isbn);
+        if (retry && session->options.honor_backoff && retry->next_attempt_at > now) {
+            printf("Skipping book #%d: %s (retry %d backing off for %lds)\n", i+1, book_title(library, book),
+                   retry->attempts + 1, (long)(retry->next_attempt_at - now));
             continue;
         }
         
-        printf("Processing book #%d: %s, ISBN: %s\n", i+1, book->title, book->isbn);
+        if (update.cache) {
+            const CacheEntry* entry = cache_lookup(update.cache, isbn);
+            if (entry && entry->in_flight) {
+                // Another copy of this edition is already queued; reuse its answer
+                update.followers[update.follower_count++] = i;
+                continue;
+            }
+            if (entry && apply_cached_entry(&update, i, entry)) {
+                continue;
+            }
+            cache_mark_pending(update.cache, isbn);
+        }
+        
+        printf("Queueing book #%d: %s, ISBN: %s\n", i+1, book_title(library, book), isbn);
+        
+        pending[pending_count++] = i;
+        requested++;
+        if (pending_count == batch_size) {
+            queue_metadata_batch(&update, pending, pending_count);
+            pending_count = 0;
+        }
+    }
+    
+    if (pending_count > 0) {
+        queue_metadata_batch(&update, pending, pending_count);
+    }
+    free(pending);
+    
+    if (requested > 0) {
+        printf("Fetching %d books in %d requests (batches of up to %d, %d in flight)...\n",
+               requested, update.batch_count, batch_size, session->options.concurrency);
         
-        // Create a temporary book to store API data
-        Book temp_book;
-        memset(&temp_book, 0, sizeof(Book));
+        double start = fetch_now_seconds();
+        fetch_engine_run(&engine, on_metadata_fetched, &update);
+        double elapsed = fetch_now_seconds() - start;
         
-        // Copy the ISBN to the temporary book
-        strncpy(temp_book.isbn, book->isbn, sizeof(temp_book.isbn) - 1);
-        temp_book.isbn[sizeof(temp_book.isbn) - 1] = '\0';
+        printf("Processed %d books in %.2f s (%d updated) using %d requests, %d retried individually, %d retries after errors (%.1f books/sec)\n",
+               requested, elapsed, update.updated_count, engine.job_count, update.retried_count, engine.retried,
+               elapsed > 0 ? requested / elapsed : 0.0);
         
-        // Fetch book info from Open Library API
-        if (fetch_book_info_by_isbn(book->isbn, &temp_book)) {
-            // Update the book data with fetched information
-            // Only update if we got actual data
-            if (temp_book.title[0] != '\0') {
-                strncpy(book->title, temp_book.title, sizeof(book->title) - 1);
-                book->title[sizeof(book->title) - 1] = '\0';
-            }
-            
-            if (temp_book.author[0] != '\0') {
-                strncpy(book->author, temp_book.author, sizeof(book->author) - 1);
-                book->author[sizeof(book->author) - 1] = '\0';
-            }
-            
-            if (temp_book.year_published > 0) {
-                book->year_published = temp_book.year_published;
-            }
-            
-            // Update genre if found in API data
-            if (temp_book.genre[0] != '\0') {
-                strncpy(book->genre, temp_book.genre, sizeof(book->genre) - 1);
-                book->genre[sizeof(book->genre) - 1] = '\0';
-            }
-            
-            // Update word count if estimated from page count
-            if (temp_book.word_count > 0) {
-                book->word_count = temp_book.word_count;
-            }
-            
-            // Mark this book as having its metadata retrieved
-            book->metadata_retrieved = 1;
-            
-            updated_count++;
-            printf("Updated book #%d: %s by %s (%d)\n", 
-                   i+1, book->title, book->author, book->year_published);
+        if (update.failed_count > 0) {
+            printf("%d book(s) could not be fetched and were queued for retry in %s\n",
+                   update.failed_count, session->options.retry_file);
         }
     }
     
-    // Clean up curl
-    curl_global_cleanup();
+    // Duplicates take whatever answer their first copy received
+    for (int i = 0; i < update.follower_count; i++) {
+        int index = update.followers[i];
+        const CacheEntry* entry = cache_lookup(update.cache, book_isbn(library, library_book(library, index)));
+        if (!entry || entry->in_flight || !apply_cached_entry(&update, index, entry)) {
+            printf("No data fetched for book #%d: %s\n", index+1, book_isbn(library, library_book(library, index)));
+        }
+    }
+    free(update.followers);
     
-    return updated_count;
+    for (int i = 0; i < update.batch_count; i++) {
+        free(update.batches[i].book_indices);
+    }
+    free(update.batches);
+    fetch_engine_free(&engine);
+    return update.updated_count;
 }
 
 void print_usage(const char* program_name) {
@@ -762,11 +2408,51 @@ void print_usage(const char* program_name) {
     printf("Usage: %s [command]\n\n", program_name);
     printf("Commands:\n");
     printf("  add           - Add a new book (interactive)\n");
-    printf("  lookup        - Look up a book by title\n");
+    printf("  lookup        - Look up a book by title or ISBN\n");
+    printf("  search WORDS  - Find books whose title and author contain every word\n");
+    printf("      --fuzzy          - Allow typos and missing accents; show the closest books first\n");
+    printf("      --top N          - How many of the closest books --fuzzy shows (default %d, max %d)\n",
+           FUZZY_DEFAULT_RESULTS, FUZZY_MAX_RESULTS);
     printf("  delete        - Delete a book by title\n");
+    printf("  info          - Show how much memory the library uses\n");
     printf("  list          - List all books in the library\n");
+    printf("      --author NAME    - Only books by this author\n");
+    printf("      --genre NAME     - Only books in this genre\n");
+    printf("      --cover TYPES    - Only these cover types, comma-separated (hardcover, softcover, ebook)\n");
+    printf("      --condition LIST - Only books in these conditions (excellent, good, fair, poor)\n");
+    printf("      --metadata yes|no - Only books whose metadata has (or has not) been fetched\n");
+    printf("      --isbn yes|no    - Only books with (or without) an ISBN\n");
+    printf("      --count          - Print how many books match instead of listing them\n");
+    printf("  range year|words MIN [MAX] - List books published in (or with a word count in) a range, in order\n");
+    printf("  query EXPR    - List books matching comparisons joined by and, or, not and parentheses,\n");
+    printf("                  e.g. year >= 1990 and genre = \"Fiction\" and cover = softcover\n");
+    printf("                  (<, <=, > and >= skip books with no year or word count; year = 0 finds them)\n");
+    printf("      --count          - Print how many books match instead of listing them\n");
+    printf("      --timing         - Also time the query against a row-at-a-time interpreter\n");
+    printf("  stats         - Show the number of books and words and how many books lack metadata\n");
+    printf("  stats genre|author|cover|condition|decade [words|year] - Count books per group, with the\n");
+    printf("                  total, minimum, maximum and average word count or year if one is named\n");
+    printf("      --top N          - Only the N largest groups, largest first\n");
+    printf("      --threads N      - Aggregation threads (default: one per CPU core)\n");
+    printf("      --timing         - Print how long the aggregation took\n");
     printf("  fetch-metadata      - Fetch book metadata from Open Library for books with ISBNs\n");
     printf("  fetch-metadata --force - Force update all books with ISBNs, even if already fetched\n");
+    printf("      --concurrency N  - Number of requests in flight at once (default %d)\n", DEFAULT_FETCH_CONCURRENCY);
+    printf("      --batch N        - ISBNs per request (default %d, max %d)\n", DEFAULT_FETCH_BATCH_SIZE, MAX_FETCH_BATCH_SIZE);
+    printf("      --no-reuse       - Open a fresh connection for every request\n");
+    printf("      --timing         - Print a per-request latency report\n");
+    printf("      --no-cache       - Ignore the local metadata cache and always hit the network\n");
+    printf("      --cache-ttl SECS - Refetch cached answers older than this (default %ld)\n", DEFAULT_CACHE_TTL);
+    printf("      --rate N         - Limit requests per second (default %.0f, 0 = unlimited)\n", DEFAULT_RATE_LIMIT);
+    printf("      --timeout MS     - Per-request timeout in milliseconds (default %d)\n", DEFAULT_REQUEST_TIMEOUT_MS);
+    printf("      --deadline SECS  - Give up on the whole run after this long\n");
+    printf("      --retries N      - Retries per request after transient errors (default %d)\n", DEFAULT_MAX_RETRIES);
+    printf("      --api-url URL    - Use a different books endpoint (e.g. a local mock server)\n");
+    printf("  import-dump FILE    - Fill in metadata from an Open Library editions dump (\"-\" reads stdin)\n");
+    printf("      --threads N      - Parser threads (default: one per CPU core)\n");
+    printf("  compact       - Fold the change journal into %s\n", DEFAULT_SNAPSHOT_FILE);
+    printf("  import-csv FILE     - Add the books in a CSV file to the library\n");
+    printf("  export-csv [FILE]   - Write the library as CSV (default %s)\n", DEFAULT_CSV_FILE);
     printf("  help          - Show this help message\n");
     printf("\nIf no command is given, the program will show all books.\n");
 }
\ No newline at end of file
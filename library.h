@@ -2,37 +2,167 @@
 #define LIBRARY_H
 
 #include "book.h"
+#include "fetch.h"
+#include "journal.h"
+#include "intern.h"
+#include "columns.h"
+#include "title_index.h"
+#include "isbn.h"
+#include "text_index.h"
+#include "fuzzy.h"
+#include "range_index.h"
+#include "bitmap.h"
+#include "totals.h"
 
-#define INITIAL_CAPACITY 10
 #define GROWTH_FACTOR 2
+#define BOOK_CHUNK_SHIFT 12
+#define BOOK_CHUNK_SIZE (1 << BOOK_CHUNK_SHIFT)  // Book slots per storage chunk
 #define CSV_DELIMITER ","
 #define DEFAULT_CSV_FILE "bookshelf.csv"
+#define DEFAULT_SNAPSHOT_FILE "bookshelf.bin"
+#define PARALLEL_LOAD_MIN_BYTES (256 * 1024)  // Smallest range worth a loader thread
+#define MAX_LOAD_THREADS 64
+#define LOOKUP_MAX_MATCHES 64   // Books sharing a title shown by lookup and delete
+#define SEARCH_MAX_SHOWN 50     // Matches printed by search
+
+// Stable reference to a book: slot in the low 32 bits, the slot's generation in
+// the high 32. Deleting a book bumps its slot's generation, so handles to it go
+// stale instead of silently pointing at whichever book reuses the slot.
+typedef uint64_t BookHandle;
+#define BOOK_HANDLE_NONE 0   // Never refers to a book (live generations are odd)
+
+// Bitmaps of the bitmap index: one of slots per cover type, per condition
+// and per flag, and one of every live slot for NOT to be taken against
+#define BOOK_BITMAP_LIVE 0
+#define BOOK_BITMAP_RETRIEVED 1      // metadata_retrieved is set
+#define BOOK_BITMAP_HAS_ISBN 2
+#define BOOK_BITMAP_COVERS 3         // COVER_TYPE_COUNT bitmaps, by CoverType
+#define BOOK_BITMAP_CONDITIONS (BOOK_BITMAP_COVERS + COVER_TYPE_COUNT)
+#define BOOK_BITMAP_COUNT (BOOK_BITMAP_CONDITIONS + CONDITION_COUNT)
+
+#define FILTER_ANY -1
+
+// Conditions on the bitmap-indexed fields. Values within a field are ORed,
+// fields are ANDed.
+typedef struct {
+    unsigned covers;      // Bit per CoverType allowed (0 = any)
+    unsigned conditions;  // Bit per Condition allowed (0 = any)
+    int metadata;         // 1 = retrieved, 0 = not yet, or FILTER_ANY
+    int has_isbn;         // 1 = has one, 0 = has none, or FILTER_ANY
+} BookFilter;
+
+// Book fields with an ordered index, for range queries
+typedef enum {
+    RANGE_YEAR,
+    RANGE_WORD_COUNT
+} RangeField;
+
+// Fixed-size block of book slots. Chunks never move once allocated, so the
+// library grows without copying books and a Book* stays put until its book
+// is deleted or compacted.
+typedef struct {
+    Book books[BOOK_CHUNK_SIZE];
+    uint32_t generations[BOOK_CHUNK_SIZE]; // Per slot: odd while it holds a book, even once the book is deleted
+} BookChunk;
 
 // Library structure to hold books with dynamic allocation
 typedef struct {
-    Book* books;       // Dynamically allocated array of books
-    int count;         // Number of books currently in the library
-    int capacity;      // Total capacity of the allocated array
+    BookChunk** chunks; // Book storage; slot N is in chunk N / BOOK_CHUNK_SIZE
+    int chunk_count;
+    int chunk_capacity; // Allocated size of the chunk table
+    StringArena strings; // Titles, authors, ISBNs and genres of every book
+    InternTable authors; // Each distinct author once, by ID
+    InternTable genres;  // Each distinct genre once, by ID
+    BookColumns columns; // Column-per-field copy of books, kept in step when columnar is set
+    TitleIndex titles;   // Slots by title, for lookups and deletes
+    int titles_indexed;  // Set once the title index is built (by the first lookup)
+    IsbnIndex isbns;     // Slots by canonical ISBN, for ownership checks
+    int isbns_indexed;   // Set once the ISBN index is built (by the first ISBN lookup)
+    TextIndex words;     // Slots by each word of the title and author, for search
+    int words_indexed;   // Set once the word index is built (by the first search)
+    FuzzyIndex fuzzy;    // Trigrams of the word index's terms, for search --fuzzy
+    RangeIndex years;    // Slots in order of year published, for range
+    RangeIndex word_counts; // Slots in order of word count, for range
+    int ranges_indexed;  // Set once the year and word count indexes are built (by the first range query)
+    Bitmap bitmaps[BOOK_BITMAP_COUNT]; // Slots by cover type, condition and flags (BOOK_BITMAP_*)
+    int bitmaps_indexed; // Set once the bitmap index is built (by the first filtered listing)
+    LibraryTotals totals; // Books per genre, cover and condition and other totals, kept in step with every change
+    int columnar;        // Set by library_enable_columns
+    int* free_slots;   // Deleted slots, reused most recent first
+    int free_count;    // Number of deleted slots
+    int free_capacity;
+    int count;         // Slots in use, deleted ones included
+    int capacity;      // Slots in the allocated chunks
+    Journal* journal;  // Change log for adds, deletes and updates (NULL = save the whole CSV instead)
+    const char* snapshot_file; // Snapshot the journal applies on top of
 } Library;
 
 // Function declarations
 void initialize_library(Library* library);
-void add_book(Library* library, const Book* book);
+void add_book(Library* library, const BookRecord* record);
 void print_library(const Library* library);
-Book* find_book_by_title(Library* library, const char* title);
+BookHandle find_book_by_title(Library* library, const char* title);
+int find_books_by_title(Library* library, const char* title, BookHandle* handles, int max_handles);
+BookHandle find_book_by_isbn(Library* library, const char* isbn);
+int search_books(Library* library, const char* query, BookHandle* handles, int max_handles);
+void print_search_results(Library* library, const char* query);
+int fuzzy_search_books(Library* library, const char* query, BookHandle* handles, int* distances, int max_handles);
+void print_fuzzy_results(Library* library, const char* query, int max_shown);
+int find_books_by_isbn(Library* library, uint64_t key, BookHandle* handles, int max_handles);
+void library_range_find(Library* library, RangeField field, int low, int high, RangeCursor* cursor);
+void print_library_range(Library* library, RangeField field, int low, int high);
 int delete_book_by_title(Library* library, const char* title);
 void free_library(Library* library);
 
+// Book handle functions
+Book* library_book(const Library* library, int slot);
+int library_book_count(const Library* library);
+int library_is_live(const Library* library, int slot);
+BookHandle library_handle(const Library* library, int slot);
+int library_handle_slot(const Library* library, BookHandle handle);
+Book* library_get(Library* library, BookHandle handle);
+int library_delete(Library* library, BookHandle handle);
+int library_compact(Library* library, BookHandle* handles, int handle_count);
+
+// Book string accessors
+const char* book_title(const Library* library, const Book* book);
+const char* book_author(const Library* library, const Book* book);
+const char* book_isbn(const Library* library, const Book* book);
+const char* book_genre(const Library* library, const Book* book);
+void get_book_strings(const Library* library, const Book* book, BookStrings* strings);
+void book_filter_init(BookFilter* filter);
+int library_filter(Library* library, const BookFilter* filter, Bitmap* result);
+void print_library_filtered(Library* library, const char* author, const char* genre, const BookFilter* filter,
+                            int count_only);
+void print_library_info(const Library* library);
+
 // Memory management functions
-int resize_library(Library* library, int new_capacity);
+int library_reserve(Library* library, int capacity);
 
-// CSV functions
+// Column store functions
+int library_enable_columns(Library* library);
+void library_refresh_columns(Library* library);
+int library_next_book(const Library* library, int start, int conditions);
+
+// Storage functions
+int load_library(Library* library, Journal* journal);
+void library_commit_appended(Library* library, int added, const LibraryTotals* totals);
+const LibraryTotals* library_totals(Library* library);
+
+// CSV import/export functions
 int save_library_to_csv(const Library* library, const char* filename);
 int load_library_from_csv(Library* library, const char* filename);
+int load_library_from_csv_parallel(Library* library, const char* filename, int threads);
+
+// Journal functions
+int open_library_journal(Library* library, Journal* journal, const char* journal_file, const char* snapshot_file);
+int commit_library_changes(Library* library);
+int compact_library(Library* library);
+void reset_book_metadata_flag(Library* library, int index);
 
 // API functions
-int fetch_book_info_by_isbn(const char* isbn, Book* book);
-int update_library_with_api_data(Library* library);
+int update_library_with_api_data(Library* library, FetchSession* session);
+void update_book_metadata(Library* library, int index, const BookRecord* fetched);
 
 // Interactive CLI functions
 void interactive_add_book(Library* library);
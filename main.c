@@ -3,27 +3,114 @@
  * This file includes all other source files for direct compilation
  */
 
+#define _POSIX_C_SOURCE 200809L  // access() under -std=c99
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
 #include <curl/curl.h>  // Include curl for global init/cleanup
 
 // Include the implementation files directly instead of using headers
 // This effectively creates a unity build in a single file
 #include "book.h"
 #include "library.h"
+#include "dump.h"
+#include "query.h"
+#include "stats.h"
+
+// Parse fetch-metadata flags starting at argv[first]
+static int parse_fetch_args(int argc, char *argv[], int first, FetchOptions* options, int* force_update) {
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], "--force") == 0) {
+            *force_update = 1;
+            options->honor_backoff = 0;
+        } else if (strcmp(argv[i], "--concurrency") == 0 && i + 1 < argc) {
+            options->concurrency = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            options->batch_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-reuse") == 0) {
+            options->reuse_connections = 0;
+        } else if (strcmp(argv[i], "--timing") == 0) {
+            options->report_timing = 1;
+        } else if (strcmp(argv[i], "--no-cache") == 0) {
+            options->use_cache = 0;
+        } else if (strcmp(argv[i], "--cache-ttl") == 0 && i + 1 < argc) {
+            options->cache_ttl = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            options->rate_limit = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) {
+            options->request_timeout_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--deadline") == 0 && i + 1 < argc) {
+            options->deadline_seconds = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--retries") == 0 && i + 1 < argc) {
+            options->max_retries = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--api-url") == 0 && i + 1 < argc) {
+            options->api_url = argv[++i];
+        } else {
+            printf("Unknown option for fetch-metadata: %s\n", argv[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Parse a whole argument as an int. Returns 0 if it is not one.
+static int parse_int_arg(const char* text, int* value) {
+    char* end;
+    long parsed = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || parsed < INT_MIN || parsed > INT_MAX) {
+        return 0;
+    }
+    *value = (int)parsed;
+    return 1;
+}
+
+// Parse a comma-separated list of enum names into a mask with a bit per
+// value. Returns 0 if a name is not a value.
+static int parse_value_list(const char* list, int (*parse)(const char*), unsigned* mask) {
+    char names[256];
+    snprintf(names, sizeof(names), "%s", list);
+    *mask = 0;
+    for (char* name = strtok(names, ","); name; name = strtok(NULL, ",")) {
+        int value = parse(name);
+        if (value < 0) {
+            return 0;
+        }
+        *mask |= 1u << value;
+    }
+    return *mask != 0;
+}
+
+// Parse yes or no into 1 or 0. Returns -1 for anything else.
+static int parse_yes_no(const char* text) {
+    return strcmp(text, "yes") == 0 ? 1 : strcmp(text, "no") == 0 ? 0 : -1;
+}
 
 int main(int argc, char *argv[]) {
     printf("Bookshelf Management System\n\n");
     
+    // Commands that do not need the library are answered before loading it
+    if (argc > 1 && strcmp(argv[1], "help") == 0) {
+        print_usage(argv[0]);
+        return 0;
+    }
+    
     // Initialize curl at program start
     curl_global_init(CURL_GLOBAL_DEFAULT);
     
     Library library;
     initialize_library(&library);
+    library_enable_columns(&library);
     
-    // Load existing library from CSV file
-    load_library_from_csv(&library, DEFAULT_CSV_FILE);
+    // Load the snapshot and apply changes made since it was last written
+    Journal journal;
+    if (!load_library(&library, &journal)) {
+        free_library(&library);
+        curl_global_cleanup();
+        return 1;
+    }
     
     // Process command line arguments
     if (argc > 1) {
@@ -33,13 +120,7 @@ int main(int argc, char *argv[]) {
             interactive_add_book(&library);
             
             // Offer to immediately fetch metadata if book has ISBN
-            int has_isbn = 0;
-            for (int i = 0; i < library.count; i++) {
-                if (library.books[i].isbn[0] != '\0' && !library.books[i].metadata_retrieved) {
-                    has_isbn = 1;
-                    break;
-                }
-            }
+            int has_isbn = library_next_book(&library, 0, SCAN_HAS_ISBN | SCAN_NEEDS_METADATA) >= 0;
             
             if (has_isbn) {
                 char choice[10];
@@ -49,10 +130,13 @@ int main(int argc, char *argv[]) {
                 
                 if (choice[0] == 'y' || choice[0] == 'Y') {
                     printf("Fetching metadata...\n");
-                    int updated = update_library_with_api_data(&library);
+                    FetchSession session;
+                    fetch_session_init(&session, NULL);
+                    int updated = update_library_with_api_data(&library, &session);
+                    fetch_session_free(&session);
                     if (updated > 0) {
                         printf("Successfully updated %d books with metadata.\n", updated);
-                        save_library_to_csv(&library, DEFAULT_CSV_FILE);
+                        commit_library_changes(&library);
                     } else {
                         printf("No books were updated.\n");
                     }
@@ -62,33 +146,205 @@ int main(int argc, char *argv[]) {
         else if (strcmp(command, "lookup") == 0) {
             interactive_lookup_book(&library);
         }
+        else if (strcmp(command, "search") == 0) {
+            int fuzzy = 0;
+            int top = FUZZY_DEFAULT_RESULTS;
+            int first = 2;
+            for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++) {
+                if (strcmp(argv[first], "--fuzzy") == 0) {
+                    fuzzy = 1;
+                } else if (strcmp(argv[first], "--top") == 0 && first + 1 < argc) {
+                    top = atoi(argv[++first]);
+                } else {
+                    break;
+                }
+            }
+            
+            if (first >= argc) {
+                printf("search needs at least one word.\n");
+                print_usage(argv[0]);
+            } else if (strncmp(argv[first], "--", 2) == 0) {
+                printf("Unknown option for search: %s\n", argv[first]);
+                print_usage(argv[0]);
+            } else {
+                // Words may be given as one quoted argument or several
+                char query[1024] = "";
+                size_t length = 0;
+                for (int i = first; i < argc && length < sizeof(query) - 1; i++) {
+                    length += (size_t)snprintf(query + length, sizeof(query) - length, "%s%s", i > first ? " " : "", argv[i]);
+                }
+                if (fuzzy) {
+                    print_fuzzy_results(&library, query, top > 0 ? top : FUZZY_DEFAULT_RESULTS);
+                } else {
+                    print_search_results(&library, query);
+                }
+            }
+        }
         else if (strcmp(command, "delete") == 0) {
             interactive_delete_book(&library);
         }
         else if (strcmp(command, "list") == 0) {
-            print_library(&library);
+            const char* author = NULL;
+            const char* genre = NULL;
+            BookFilter filter;
+            book_filter_init(&filter);
+            int filtered = 0;
+            int count_only = 0;
+            for (int i = 2; i < argc; i++) {
+                int valid = 1;
+                if (strcmp(argv[i], "--author") == 0 && i + 1 < argc) {
+                    author = argv[++i];
+                } else if (strcmp(argv[i], "--genre") == 0 && i + 1 < argc) {
+                    genre = argv[++i];
+                } else if (strcmp(argv[i], "--cover") == 0 && i + 1 < argc) {
+                    valid = parse_value_list(argv[++i], parse_cover_type, &filter.covers);
+                    filtered = 1;
+                } else if (strcmp(argv[i], "--condition") == 0 && i + 1 < argc) {
+                    valid = parse_value_list(argv[++i], parse_condition, &filter.conditions);
+                    filtered = 1;
+                } else if (strcmp(argv[i], "--metadata") == 0 && i + 1 < argc) {
+                    filter.metadata = parse_yes_no(argv[++i]);
+                    valid = filter.metadata >= 0;
+                    filtered = 1;
+                } else if (strcmp(argv[i], "--isbn") == 0 && i + 1 < argc) {
+                    filter.has_isbn = parse_yes_no(argv[++i]);
+                    valid = filter.has_isbn >= 0;
+                    filtered = 1;
+                } else if (strcmp(argv[i], "--count") == 0) {
+                    count_only = 1;
+                } else {
+                    valid = 0;
+                }
+                
+                if (!valid) {
+                    printf("Unknown option or value for list: %s\n", argv[i]);
+                    print_usage(argv[0]);
+                    free_library(&library);
+                    curl_global_cleanup();
+                    return 1;
+                }
+            }
+            
+            if (author || genre || filtered || count_only) {
+                print_library_filtered(&library, author, genre, filtered ? &filter : NULL, count_only);
+            } else {
+                print_library(&library);
+            }
+        }
+        else if (strcmp(command, "range") == 0) {
+            // range year|words MIN [MAX]; without MAX the range is open-ended
+            int low = 0;
+            int high = INT_MAX;
+            int valid = argc >= 4 && argc <= 5 && parse_int_arg(argv[3], &low) &&
+                        (argc == 4 || parse_int_arg(argv[4], &high));
+            if (valid && strcmp(argv[2], "year") == 0) {
+                print_library_range(&library, RANGE_YEAR, low, high);
+            } else if (valid && strcmp(argv[2], "words") == 0) {
+                print_library_range(&library, RANGE_WORD_COUNT, low, high);
+            } else {
+                printf("range needs year or words and a minimum, and optionally a maximum.\n");
+                print_usage(argv[0]);
+            }
+        }
+        else if (strcmp(command, "query") == 0) {
+            // query [--count] [--timing] EXPRESSION, options in any position.
+            // The expression may be given as one quoted argument or several.
+            int count_only = 0;
+            int timing = 0;
+            const char* unknown = NULL;
+            char text[1024] = "";
+            size_t length = 0;
+            for (int i = 2; i < argc; i++) {
+                if (strcmp(argv[i], "--count") == 0) {
+                    count_only = 1;
+                } else if (strcmp(argv[i], "--timing") == 0) {
+                    timing = 1;
+                } else if (strncmp(argv[i], "--", 2) == 0) {
+                    if (!unknown) {
+                        unknown = argv[i];
+                    }
+                } else if (length < sizeof(text) - 1) {
+                    length += (size_t)snprintf(text + length, sizeof(text) - length, "%s%s", length > 0 ? " " : "", argv[i]);
+                }
+            }
+            
+            if (unknown) {
+                printf("Unknown option for query: %s\n", unknown);
+                print_usage(argv[0]);
+            } else if (length == 0) {
+                printf("query needs an expression.\n");
+                print_usage(argv[0]);
+            } else {
+                print_query_results(&library, text, count_only, timing);
+            }
+        }
+        else if (strcmp(command, "stats") == 0) {
+            // stats [GROUP [words|year] [--top N] [--threads N] [--timing]]
+            int group_by = argc >= 3 ? parse_stats_group_by(argv[2]) : -1;
+            int measure = STATS_COUNT_ONLY;
+            int top = 0;
+            int threads = 0;
+            int timing = 0;
+            int valid = group_by >= 0;
+            int first = 3;
+            if (valid && first < argc && strncmp(argv[first], "--", 2) != 0) {
+                measure = parse_stats_measure(argv[first++]);
+                valid = measure >= 0;
+            }
+            for (int i = first; valid && i < argc; i++) {
+                if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+                    valid = parse_int_arg(argv[++i], &top) && top > 0;
+                } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                    valid = parse_int_arg(argv[++i], &threads) && threads > 0;
+                } else if (strcmp(argv[i], "--timing") == 0) {
+                    timing = 1;
+                } else {
+                    valid = 0;
+                }
+            }
+            
+            if (argc == 2) {
+                print_library_totals(&library);
+            } else if (valid) {
+                print_library_stats(&library, (StatsGroupBy)group_by, (StatsMeasure)measure, top, threads, timing);
+            } else {
+                printf("stats needs genre, author, cover, condition or decade, optionally words or year, and options.\n");
+                print_usage(argv[0]);
+            }
         }
         else if (strcmp(command, "fetch-metadata") == 0) {
             printf("Attempting to update library with metadata from Open Library API...\n");
             
+            FetchOptions options;
+            fetch_options_init(&options);
+            
             // Check for force flag to update all books regardless of metadata_retrieved status
             int force_update = 0;
-            if (argc > 2 && strcmp(argv[2], "--force") == 0) {
-                force_update = 1;
+            if (!parse_fetch_args(argc, argv, 2, &options, &force_update)) {
+                print_usage(argv[0]);
+                free_library(&library);
+                curl_global_cleanup();
+                return 1;
+            }
+            
+            if (force_update) {
                 printf("Force flag detected. Will attempt to update all books with ISBNs.\n");
                 
                 // Reset metadata_retrieved flags if forcing update
-                for (int i = 0; i < library.count; i++) {
-                    if (library.books[i].isbn[0] != '\0') {
-                        library.books[i].metadata_retrieved = 0;
-                    }
+                for (int i = library_next_book(&library, 0, SCAN_HAS_ISBN); i >= 0;
+                     i = library_next_book(&library, i + 1, SCAN_HAS_ISBN)) {
+                    reset_book_metadata_flag(&library, i);
                 }
             }
             
-            int updated = update_library_with_api_data(&library);
+            FetchSession session;
+            fetch_session_init(&session, &options);
+            int updated = update_library_with_api_data(&library, &session);
+            fetch_session_free(&session);
+            
             if (updated > 0) {
                 printf("Successfully updated %d books with metadata.\n", updated);
-                save_library_to_csv(&library, DEFAULT_CSV_FILE);
+                commit_library_changes(&library);
             } else {
                 if (force_update) {
                     printf("No books were updated. Ensure your books have valid ISBNs.\n");
@@ -97,8 +353,63 @@ int main(int argc, char *argv[]) {
                 }
             }
         }
-        else if (strcmp(command, "help") == 0) {
-            print_usage(argv[0]);
+        else if (strcmp(command, "import-dump") == 0) {
+            if (argc < 3) {
+                printf("import-dump needs a dump file (or - for stdin).\n");
+                print_usage(argv[0]);
+                free_library(&library);
+                curl_global_cleanup();
+                return 1;
+            }
+
+            DumpOptions options;
+            dump_options_init(&options);
+            for (int i = 3; i < argc; i++) {
+                if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+                    options.threads = atoi(argv[++i]);
+                } else {
+                    printf("Unknown option for import-dump: %s\n", argv[i]);
+                    print_usage(argv[0]);
+                    free_library(&library);
+                    curl_global_cleanup();
+                    return 1;
+                }
+            }
+
+            DumpStats stats;
+            double started = fetch_now_seconds();
+            int updated = import_library_from_dump(&library, argv[2], &options, &stats);
+            double elapsed = fetch_now_seconds() - started;
+
+            if (updated > 0) {
+                printf("Scanned %lld records (%.1f MB) in %.2f s, %.1f MB/s\n",
+                       stats.lines, stats.bytes / 1e6, elapsed,
+                       elapsed > 0 ? stats.bytes / 1e6 / elapsed : 0.0);
+                printf("Successfully updated %d of %d books with metadata.\n", updated, stats.candidates);
+                commit_library_changes(&library);
+            } else if (updated == 0 && stats.candidates > 0) {
+                printf("Scanned %lld records (%.1f MB) in %.2f s; none matched the library.\n",
+                       stats.lines, stats.bytes / 1e6, elapsed);
+            }
+        }
+        else if (strcmp(command, "info") == 0) {
+            print_library_info(&library);
+        }
+        else if (strcmp(command, "compact") == 0) {
+            compact_library(&library);
+        }
+        else if (strcmp(command, "import-csv") == 0) {
+            if (argc < 3 || access(argv[2], F_OK) != 0) {
+                printf("import-csv needs an existing CSV file.\n");
+            } else {
+                int before = library_book_count(&library);
+                load_library_from_csv(&library, argv[2]);
+                printf("Imported %d books.\n", library_book_count(&library) - before);
+                compact_library(&library);
+            }
+        }
+        else if (strcmp(command, "export-csv") == 0) {
+            save_library_to_csv(&library, argc > 2 ? argv[2] : DEFAULT_CSV_FILE);
         }
         else {
             printf("Unknown command: %s\n", command);
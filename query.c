@@ -0,0 +1,929 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <limits.h>
+#include "query.h"
+
+#define QUERY_INDEX_FRACTION 32   // Use a range index when it holds at most 1/32 of the books
+
+typedef enum {
+    TOKEN_END,
+    TOKEN_WORD,       // Field name, keyword, number or bare value
+    TOKEN_STRING,     // "quoted value"
+    TOKEN_COMPARE,    // = != < <= > >=
+    TOKEN_OPEN,
+    TOKEN_CLOSE,
+    TOKEN_ERROR
+} TokenType;
+
+typedef struct {
+    TokenType type;
+    const char* start;
+    size_t length;
+    QueryOp op;           // TOKEN_COMPARE
+} Token;
+
+// Recursive-descent parser state
+typedef struct {
+    Query* query;
+    const char* text;     // Start of the query, for error positions
+    const char* cursor;
+    Token token;          // The current token
+} QueryParser;
+
+// Field names, in QueryField order
+static const char* const query_field_names[] = {
+    "year", "words", "title", "author", "genre", "isbn", "cover", "condition", "metadata"
+};
+
+// Initialize an empty query
+void query_init(Query* query) {
+    memset(query, 0, sizeof(Query));
+    query->root = -1;
+    query->plan_root = -1;
+}
+
+// Whether a byte can be part of a bare word (UTF-8 bytes included)
+static int word_char(char c) {
+    return isalnum((unsigned char)c) || c == '_' || c == '-' || c == '.' || (unsigned char)c >= 0x80;
+}
+
+// Read the next token into parser->token
+static void next_token(QueryParser* parser) {
+    const char* p = parser->cursor;
+    while (isspace((unsigned char)*p)) {
+        p++;
+    }
+    Token* token = &parser->token;
+    token->start = p;
+    token->length = 1;
+
+    if (*p == '\0') {
+        token->type = TOKEN_END;
+        token->length = 0;
+    } else if (*p == '(' || *p == ')') {
+        token->type = *p == '(' ? TOKEN_OPEN : TOKEN_CLOSE;
+    } else if (*p == '"') {
+        // The closing quote ends the token; \" and \\ stand for themselves
+        const char* end = p + 1;
+        while (*end && *end != '"') {
+            end += (end[0] == '\\' && end[1]) ? 2 : 1;
+        }
+        token->type = *end == '"' ? TOKEN_STRING : TOKEN_ERROR;
+        token->length = (size_t)(end - p) + (*end == '"');
+    } else if (*p == '=' || *p == '!' || *p == '<' || *p == '>') {
+        int equals = p[1] == '=';
+        token->type = TOKEN_COMPARE;
+        token->length = 1 + (size_t)equals;
+        if (*p == '=') {
+            token->op = QUERY_EQ;
+        } else if (*p == '!') {
+            token->op = QUERY_NE;
+            token->type = equals ? TOKEN_COMPARE : TOKEN_ERROR;
+        } else if (*p == '<') {
+            token->op = equals ? QUERY_LE : QUERY_LT;
+        } else {
+            token->op = equals ? QUERY_GE : QUERY_GT;
+        }
+    } else if (word_char(*p)) {
+        const char* end = p;
+        while (word_char(*end)) {
+            end++;
+        }
+        token->type = TOKEN_WORD;
+        token->length = (size_t)(end - p);
+    } else {
+        token->type = TOKEN_ERROR;
+    }
+    parser->cursor = token->start + token->length;
+}
+
+// Record a parse error at the current token. Always returns -1.
+static int parse_error(QueryParser* parser, const char* message) {
+    snprintf(parser->query->error, sizeof(parser->query->error), "%s at position %d", message,
+             (int)(parser->token.start - parser->text) + 1);
+    return -1;
+}
+
+// Whether the current token is a word equal to `keyword`, ignoring case
+static int token_is(const QueryParser* parser, const char* keyword) {
+    const Token* token = &parser->token;
+    size_t length = strlen(keyword);
+    if (token->type != TOKEN_WORD || token->length != length) {
+        return 0;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (tolower((unsigned char)token->start[i]) != keyword[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Take a free node. Returns its index, or -1 if the query is too long.
+static int new_node(QueryParser* parser, QueryNodeType type) {
+    Query* query = parser->query;
+    if (query->node_count == QUERY_MAX_NODES) {
+        return parse_error(parser, "Query too long");
+    }
+    QueryNode* node = &query->nodes[query->node_count];
+    memset(node, 0, sizeof(QueryNode));
+    node->type = type;
+    node->left = -1;
+    node->right = -1;
+    return query->node_count++;
+}
+
+// Copy the value of the current token (unquoted) into the query's text
+static int store_value(QueryParser* parser, QueryNode* node) {
+    Query* query = parser->query;
+    const Token* token = &parser->token;
+    const char* value = token->start;
+    size_t length = token->length;
+    if (token->type == TOKEN_STRING) {
+        value++;
+        length -= 2;
+    }
+    if (query->text_size + length + 1 > QUERY_MAX_TEXT) {
+        return parse_error(parser, "Query too long");
+    }
+
+    char* out = query->text + query->text_size;
+    size_t size = 0;
+    for (size_t i = 0; i < length; i++) {
+        if (token->type == TOKEN_STRING && value[i] == '\\' && i + 1 < length) {
+            i++;
+        }
+        out[size++] = value[i];
+    }
+    out[size] = '\0';
+    node->text = query->text_size;
+    node->length = (uint32_t)size;
+    query->text_size += (uint32_t)size + 1;
+    return 0;
+}
+
+// Parse `field op value`
+static int parse_comparison(QueryParser* parser) {
+    int field = -1;
+    for (int i = 0; i < (int)(sizeof(query_field_names) / sizeof(query_field_names[0])); i++) {
+        if (token_is(parser, query_field_names[i])) {
+            field = i;
+        }
+    }
+    if (field < 0) {
+        return parse_error(parser, "Expected a field (year, words, title, author, genre, isbn, cover, condition or metadata)");
+    }
+    next_token(parser);
+    if (parser->token.type != TOKEN_COMPARE) {
+        return parse_error(parser, "Expected =, !=, <, <=, > or >=");
+    }
+    QueryOp op = parser->token.op;
+    next_token(parser);
+    if (parser->token.type == TOKEN_ERROR && *parser->token.start == '"') {
+        return parse_error(parser, "Missing closing quote");
+    }
+    if (parser->token.type != TOKEN_WORD && parser->token.type != TOKEN_STRING) {
+        return parse_error(parser, "Expected a value");
+    }
+
+    int index = new_node(parser, QUERY_COMPARE);
+    if (index < 0) {
+        return -1;
+    }
+    QueryNode* node = &parser->query->nodes[index];
+    node->field = (QueryField)field;
+    node->op = op;
+    if (store_value(parser, node) < 0) {
+        return -1;
+    }
+    const char* value = parser->query->text + node->text;
+
+    if (field == QUERY_YEAR || field == QUERY_WORDS) {
+        char* end;
+        long long number = strtoll(value, &end, 10);
+        if (node->length == 0 || *end != '\0' || number < INT_MIN || number > INT_MAX) {
+            return parse_error(parser, "Expected a whole number");
+        }
+        node->value = number;
+    } else if (op != QUERY_EQ && op != QUERY_NE) {
+        return parse_error(parser, "Only = and != compare this field");
+    } else if (field == QUERY_COVER || field == QUERY_CONDITION) {
+        node->value = field == QUERY_COVER ? parse_cover_type(value) : parse_condition(value);
+        if (node->value < 0) {
+            return parse_error(parser, field == QUERY_COVER ? "Expected hardcover, softcover or ebook"
+                                                             : "Expected excellent, good, fair or poor");
+        }
+    } else if (field == QUERY_METADATA) {
+        node->value = strcmp(value, "yes") == 0 ? 1 : strcmp(value, "no") == 0 ? 0 : -1;
+        if (node->value < 0) {
+            return parse_error(parser, "Expected yes or no");
+        }
+    } else if (field == QUERY_ISBN) {
+        node->value = (int64_t)isbn_key_unchecked(value, node->length);
+        if (node->value == ISBN_KEY_NONE) {
+            return parse_error(parser, "Expected an ISBN");
+        }
+    }
+    next_token(parser);
+    return index;
+}
+
+static int parse_or(QueryParser* parser);
+
+// Parse `not term`, `( expression )` or a comparison
+static int parse_term(QueryParser* parser) {
+    if (token_is(parser, "not")) {
+        next_token(parser);
+        int operand = parse_term(parser);
+        int index = operand < 0 ? -1 : new_node(parser, QUERY_NOT);
+        if (index >= 0) {
+            parser->query->nodes[index].left = operand;
+        }
+        return index;
+    }
+    if (parser->token.type == TOKEN_OPEN) {
+        next_token(parser);
+        int index = parse_or(parser);
+        if (index >= 0 && parser->token.type != TOKEN_CLOSE) {
+            return parse_error(parser, "Expected )");
+        }
+        next_token(parser);
+        return index;
+    }
+    return parse_comparison(parser);
+}
+
+// Parse terms joined by `and`, or (with `or` set) and-expressions joined by `or`
+static int parse_chain(QueryParser* parser, int or) {
+    int left = or ? parse_chain(parser, 0) : parse_term(parser);
+    while (left >= 0 && token_is(parser, or ? "or" : "and")) {
+        next_token(parser);
+        int right = or ? parse_chain(parser, 0) : parse_term(parser);
+        int index = right < 0 ? -1 : new_node(parser, or ? QUERY_OR : QUERY_AND);
+        if (index >= 0) {
+            parser->query->nodes[index].left = left;
+            parser->query->nodes[index].right = right;
+        }
+        left = index;
+    }
+    return left;
+}
+
+static int parse_or(QueryParser* parser) {
+    return parse_chain(parser, 1);
+}
+
+// Parse a query such as: year >= 1990 and genre = "Fiction" and cover = softcover.
+// Comparisons are joined with and, or and not (in falling order of
+// precedence) and grouped with parentheses. Returns 0 with the reason in
+// query->error if the text is not a query.
+int query_parse(Query* query, const char* text) {
+    QueryParser parser;
+    parser.query = query;
+    parser.text = text;
+    parser.cursor = text;
+    next_token(&parser);
+    if (parser.token.type == TOKEN_END) {
+        parse_error(&parser, "Empty query");
+        return 0;
+    }
+
+    query->root = parse_or(&parser);
+    if (query->root >= 0 && parser.token.type != TOKEN_END) {
+        query->root = parse_error(&parser, "Expected and, or or the end of the query");
+    }
+    return query->root >= 0;
+}
+
+// Whether a comparison leaves out books whose year or word count is empty
+// (0), as everywhere else in the library: <, <=, > and >= only match books
+// that have the field, unless the constant is 0 itself. = 0 and != 0 test
+// for the empty field.
+static int skips_empty(const QueryNode* node) {
+    return (node->field == QUERY_YEAR || node->field == QUERY_WORDS) && node->op != QUERY_EQ &&
+           node->op != QUERY_NE && node->value != 0;
+}
+
+// Narrow the candidate bitmap to the books in (or, with keep unset, not in) `by`
+static int narrow_candidates(Bitmap* candidates, int* has_candidates, const Bitmap* by, int keep,
+                             const Bitmap* live) {
+    Bitmap narrowed;
+    bitmap_init(&narrowed);
+    const Bitmap* from = *has_candidates ? candidates : live;
+    int ok = keep ? bitmap_and(from, by, &narrowed) : bitmap_andnot(from, by, &narrowed);
+    bitmap_free(candidates);
+    *candidates = narrowed;
+    *has_candidates = 1;
+    return ok;
+}
+
+// qsort order for slots
+static int compare_slots(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+// Turn slots into a bitmap (sorting them first, so every add appends)
+static int slots_to_bitmap(uint32_t* slots, uint32_t count, Bitmap* bitmap) {
+    qsort(slots, count, sizeof(uint32_t), compare_slots);
+    for (uint32_t i = 0; i < count; i++) {
+        if (!bitmap_add(bitmap, slots[i])) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Answer the comparisons on one field of the top-level conjunction from its
+// range index, if the range they leave is narrow enough that visiting its
+// books beats scanning the column. Folded comparisons become QUERY_TRUE.
+static int plan_range(Query* query, Library* library, QueryField field, const int* conjuncts, int conjunct_count,
+                      Bitmap* candidates, int* has_candidates) {
+    int64_t low = INT_MIN;
+    int64_t high = INT_MAX;
+    int used = 0;
+    int skip_empty = 0;
+    for (int i = 0; i < conjunct_count; i++) {
+        const QueryNode* node = &query->plan[conjuncts[i]];
+        if (node->type != QUERY_COMPARE || node->field != field || node->op == QUERY_NE) {
+            continue;
+        }
+        skip_empty |= skips_empty(node);
+        if ((node->op == QUERY_EQ || node->op == QUERY_GE) && node->value > low) {
+            low = node->value;
+        }
+        if (node->op == QUERY_GT && node->value + 1 > low) {
+            low = node->value + 1;
+        }
+        if ((node->op == QUERY_EQ || node->op == QUERY_LE) && node->value < high) {
+            high = node->value;
+        }
+        if (node->op == QUERY_LT && node->value - 1 < high) {
+            high = node->value - 1;
+        }
+        used++;
+    }
+    if (used == 0) {
+        return 1;
+    }
+
+    uint32_t limit = (uint32_t)library_book_count(library) / QUERY_INDEX_FRACTION + 1;
+    uint32_t* slots = (uint32_t*)malloc(sizeof(uint32_t) * limit);
+    if (!slots) {
+        fprintf(stderr, "Memory allocation failed while planning a query\n");
+        return 0;
+    }
+    // Empty values sit at 0 in the index; when they are left out, the range
+    // is walked as the parts below and above 0
+    int64_t lows[2] = {low, low};
+    int64_t highs[2] = {high, high};
+    int parts = 1;
+    if (skip_empty && low <= 0 && high >= 0) {
+        highs[0] = -1;
+        lows[1] = 1;
+        parts = 2;
+    }
+    uint32_t count = 0;
+    for (int part = 0; part < parts; part++) {
+        if (lows[part] > highs[part]) {
+            continue;
+        }
+        RangeCursor cursor;
+        library_range_find(library, field == QUERY_YEAR ? RANGE_YEAR : RANGE_WORD_COUNT, (int)lows[part],
+                           (int)highs[part], &cursor);
+        while (count < limit && range_cursor_next(&cursor, &slots[count])) {
+            count++;
+        }
+    }
+
+    int ok = 1;
+    if (count < limit) {
+        Bitmap found;
+        bitmap_init(&found);
+        ok = slots_to_bitmap(slots, count, &found) &&
+             narrow_candidates(candidates, has_candidates, &found, 1, &found);
+        bitmap_free(&found);
+        for (int i = 0; i < conjunct_count; i++) {
+            QueryNode* node = &query->plan[conjuncts[i]];
+            if (node->type == QUERY_COMPARE && node->field == field && node->op != QUERY_NE) {
+                node->type = QUERY_TRUE;
+            }
+        }
+    }
+    free(slots);
+    return ok;
+}
+
+// Answer an equality on title or ISBN from its hash index
+static int plan_lookup(Query* query, Library* library, QueryNode* node, Bitmap* candidates, int* has_candidates) {
+    BookHandle handles[LOOKUP_MAX_MATCHES];
+    const char* value = query->text + node->text;
+    int matches = node->field == QUERY_TITLE ? find_books_by_title(library, value, handles, LOOKUP_MAX_MATCHES)
+                                             : find_books_by_isbn(library, (uint64_t)node->value, handles,
+                                                                  LOOKUP_MAX_MATCHES);
+    if (matches > LOOKUP_MAX_MATCHES) {
+        return 1; // Common enough to leave to the scan
+    }
+
+    uint32_t slots[LOOKUP_MAX_MATCHES];
+    for (int i = 0; i < matches; i++) {
+        slots[i] = (uint32_t)library_handle_slot(library, handles[i]);
+    }
+    Bitmap found;
+    bitmap_init(&found);
+    int ok = slots_to_bitmap(slots, (uint32_t)matches, &found) &&
+             narrow_candidates(candidates, has_candidates, &found, 1, &found);
+    bitmap_free(&found);
+    node->type = QUERY_TRUE;
+    return ok;
+}
+
+// Collect the operands of the AND nodes at the top of a plan
+static void collect_conjuncts(const QueryNode* plan, int index, int* conjuncts, int* count) {
+    if (plan[index].type == QUERY_AND) {
+        collect_conjuncts(plan, plan[index].left, conjuncts, count);
+        collect_conjuncts(plan, plan[index].right, conjuncts, count);
+    } else {
+        conjuncts[(*count)++] = index;
+    }
+}
+
+// Answer what the library's built indexes can of the top-level conjunction:
+// cover, condition and metadata from the bitmap index, title and ISBN from
+// their hash indexes, and narrow year and word count ranges from the range
+// indexes. Their answers are ANDed into one bitmap of candidate slots.
+// Indexes not yet built are not built for one query; scanning the columns
+// is cheaper than building them.
+static int plan_indexes(Query* query, Library* library) {
+    int conjuncts[QUERY_MAX_NODES];
+    int conjunct_count = 0;
+    collect_conjuncts(query->plan, query->plan_root, conjuncts, &conjunct_count);
+
+    Bitmap candidates;
+    bitmap_init(&candidates);
+    int has_candidates = 0;
+    int ok = 1;
+    for (int i = 0; i < conjunct_count && ok; i++) {
+        QueryNode* node = &query->plan[conjuncts[i]];
+        if (node->type != QUERY_COMPARE) {
+            continue;
+        }
+        int keep = node->op == QUERY_EQ;
+        if (library->bitmaps_indexed && (node->field == QUERY_COVER || node->field == QUERY_CONDITION ||
+                                         node->field == QUERY_METADATA)) {
+            int bitmap = node->field == QUERY_COVER     ? BOOK_BITMAP_COVERS + (int)node->value
+                         : node->field == QUERY_CONDITION ? BOOK_BITMAP_CONDITIONS + (int)node->value
+                                                          : BOOK_BITMAP_RETRIEVED;
+            if (node->field == QUERY_METADATA && node->value == 0) {
+                keep = !keep;
+            }
+            ok = narrow_candidates(&candidates, &has_candidates, &library->bitmaps[bitmap], keep,
+                                   &library->bitmaps[BOOK_BITMAP_LIVE]);
+            node->type = QUERY_TRUE;
+        } else if (node->op == QUERY_EQ && ((node->field == QUERY_TITLE && library->titles_indexed) ||
+                                            (node->field == QUERY_ISBN && library->isbns_indexed))) {
+            ok = plan_lookup(query, library, node, &candidates, &has_candidates);
+        }
+    }
+    if (ok && library->ranges_indexed) {
+        ok = plan_range(query, library, QUERY_YEAR, conjuncts, conjunct_count, &candidates, &has_candidates) &&
+             plan_range(query, library, QUERY_WORDS, conjuncts, conjunct_count, &candidates, &has_candidates);
+    }
+
+    if (ok && has_candidates) {
+        query->candidate_words = (uint32_t)(library->count + 63) / 64;
+        query->candidates = (uint64_t*)calloc(query->candidate_words ? query->candidate_words : 1, sizeof(uint64_t));
+        if (query->candidates) {
+            bitmap_to_words(&candidates, query->candidates, query->candidate_words);
+        } else {
+            fprintf(stderr, "Memory allocation failed while planning a query\n");
+            ok = 0;
+        }
+    }
+    bitmap_free(&candidates);
+    return ok;
+}
+
+// Fold away constant operands: an AND with a false side is false, with a
+// true side it is the other side, and so on. Returns the folded node.
+static int fold_plan(QueryNode* plan, int index) {
+    QueryNode* node = &plan[index];
+    if (node->type == QUERY_NOT) {
+        node->left = fold_plan(plan, node->left);
+        QueryNodeType operand = plan[node->left].type;
+        if (operand == QUERY_TRUE || operand == QUERY_FALSE) {
+            node->type = operand == QUERY_TRUE ? QUERY_FALSE : QUERY_TRUE;
+        }
+    } else if (node->type == QUERY_AND || node->type == QUERY_OR) {
+        node->left = fold_plan(plan, node->left);
+        node->right = fold_plan(plan, node->right);
+        QueryNodeType absorbing = node->type == QUERY_AND ? QUERY_FALSE : QUERY_TRUE;
+        QueryNodeType neutral = node->type == QUERY_AND ? QUERY_TRUE : QUERY_FALSE;
+        if (plan[node->left].type == absorbing || plan[node->right].type == absorbing) {
+            node->type = absorbing;
+        } else if (plan[node->left].type == neutral) {
+            return node->right;
+        } else if (plan[node->right].type == neutral) {
+            return node->left;
+        }
+    }
+    return index;
+}
+
+// Resolve a parsed query against a library: author and genre names become
+// dictionary IDs (a name no book has makes its comparison constant), then the
+// plan takes what it can from the indexes. The library must keep a column
+// store (see library_enable_columns). Returns 0 if memory runs out.
+int query_compile(Query* query, Library* library) {
+    for (int i = 0; i < query->node_count; i++) {
+        QueryNode* node = &query->nodes[i];
+        if (node->type != QUERY_COMPARE || (node->field != QUERY_AUTHOR && node->field != QUERY_GENRE)) {
+            continue;
+        }
+        const InternTable* table = node->field == QUERY_AUTHOR ? &library->authors : &library->genres;
+        uint32_t id = intern_find(table, &library->strings, query->text + node->text, node->length);
+        node->value = id;
+        if (id == INTERN_NOT_FOUND) {
+            node->type = node->op == QUERY_EQ ? QUERY_FALSE : QUERY_TRUE;
+        }
+    }
+
+    memcpy(query->plan, query->nodes, sizeof(QueryNode) * (size_t)query->node_count);
+    query->plan_root = fold_plan(query->plan, query->root);
+    if (!plan_indexes(query, library)) {
+        return 0;
+    }
+    query->plan_root = fold_plan(query->plan, query->plan_root);
+    return 1;
+}
+
+// The rows of one block, and the columns they come from
+typedef struct {
+    const BookColumns* columns;
+    const StringArena* strings;
+    int first_row;
+    int words;            // 64-row words in the block
+} QueryBlock;
+
+// Compare 64 values of an int32 column with a constant, a bit per row. The
+// operator is chosen once per word, so each loop is a straight run of
+// comparisons the compiler can vectorize.
+static uint64_t compare_int32(const int32_t* values, QueryOp op, int32_t constant) {
+    uint64_t bits = 0;
+    switch (op) {
+        case QUERY_EQ:
+            for (int i = 0; i < 64; i++) {
+                bits |= (uint64_t)(values[i] == constant) << i;
+            }
+            break;
+        case QUERY_NE:
+            for (int i = 0; i < 64; i++) {
+                bits |= (uint64_t)(values[i] != constant) << i;
+            }
+            break;
+        case QUERY_LT:
+            for (int i = 0; i < 64; i++) {
+                bits |= (uint64_t)(values[i] < constant) << i;
+            }
+            break;
+        case QUERY_LE:
+            for (int i = 0; i < 64; i++) {
+                bits |= (uint64_t)(values[i] <= constant) << i;
+            }
+            break;
+        case QUERY_GT:
+            for (int i = 0; i < 64; i++) {
+                bits |= (uint64_t)(values[i] > constant) << i;
+            }
+            break;
+        case QUERY_GE:
+            for (int i = 0; i < 64; i++) {
+                bits |= (uint64_t)(values[i] >= constant) << i;
+            }
+            break;
+    }
+    return bits;
+}
+
+// Rows of 64 holding a dictionary ID (author or genre)
+static uint64_t match_id(const uint32_t* ids, uint32_t id) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 64; i++) {
+        bits |= (uint64_t)(ids[i] == id) << i;
+    }
+    return bits;
+}
+
+// Rows of 64 holding a one-byte value (cover type, condition, metadata flag)
+static uint64_t match_byte(const uint8_t* bytes, uint8_t value) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 64; i++) {
+        bits |= (uint64_t)(bytes[i] == value) << i;
+    }
+    return bits;
+}
+
+// Rows among `rows` whose title or ISBN is the comparison's value. Strings
+// are compared row by row, so only the rows still in play are visited.
+static uint64_t match_string(const Query* query, const QueryNode* node, const QueryBlock* block, int row,
+                             uint64_t rows) {
+    const char* value = query->text + node->text;
+    uint64_t bits = 0;
+    for (; rows; rows &= rows - 1) {
+        int bit = __builtin_ctzll(rows);
+        int match;
+        if (node->field == QUERY_TITLE) {
+            StrRef title = block->columns->titles[row + bit];
+            match = title.length == node->length && memcmp(arena_get(block->strings, title), value, node->length) == 0;
+        } else {
+            StrRef isbn = block->columns->isbns[row + bit];
+            match = isbn_key_unchecked(arena_get(block->strings, isbn), isbn.length) == (uint64_t)node->value;
+        }
+        bits |= (uint64_t)match << bit;
+    }
+    return bits;
+}
+
+// Evaluate one comparison over the words of a block where `live` has rows
+static void evaluate_compare(const Query* query, const QueryNode* node, const QueryBlock* block,
+                             const uint64_t* live, uint64_t* out) {
+    const BookColumns* columns = block->columns;
+    for (int w = 0; w < block->words; w++) {
+        if (!live[w]) {
+            out[w] = 0;
+            continue;
+        }
+        int row = block->first_row + w * 64;
+        uint64_t bits;
+        switch (node->field) {
+            case QUERY_YEAR:
+            case QUERY_WORDS: {
+                const int32_t* values = (node->field == QUERY_YEAR ? columns->years : columns->word_counts) + row;
+                bits = compare_int32(values, node->op, (int32_t)node->value);
+                if (skips_empty(node)) {
+                    bits &= compare_int32(values, QUERY_NE, 0);
+                }
+                break;
+            }
+            case QUERY_AUTHOR:
+                bits = match_id(columns->author_ids + row, (uint32_t)node->value);
+                break;
+            case QUERY_GENRE:
+                bits = match_id(columns->genre_ids + row, (uint32_t)node->value);
+                break;
+            case QUERY_COVER:
+                bits = match_byte(columns->cover_types + row, (uint8_t)node->value);
+                break;
+            case QUERY_CONDITION:
+                bits = match_byte(columns->conditions + row, (uint8_t)node->value);
+                break;
+            case QUERY_METADATA:
+                bits = match_byte(columns->retrieved + row, (uint8_t)node->value);
+                break;
+            default:
+                bits = match_string(query, node, block, row, live[w]);
+                break;
+        }
+        // Fields without an order only test equality; != is every other live row
+        if (node->op == QUERY_NE && node->field != QUERY_YEAR && node->field != QUERY_WORDS) {
+            bits = ~bits;
+        }
+        out[w] = bits & live[w];
+    }
+}
+
+// Evaluate a plan node over a block into `out`, considering only the rows
+// set in `live`. The right side of an AND only runs on the rows the left
+// side kept, and that of an OR on the rows it did not.
+static void evaluate_block(const Query* query, int index, const QueryBlock* block, const uint64_t* live,
+                           uint64_t* out) {
+    const QueryNode* node = &query->plan[index];
+    uint64_t other[QUERY_BLOCK_WORDS];
+    switch (node->type) {
+        case QUERY_COMPARE:
+            evaluate_compare(query, node, block, live, out);
+            break;
+        case QUERY_TRUE:
+            memcpy(out, live, sizeof(uint64_t) * (size_t)block->words);
+            break;
+        case QUERY_FALSE:
+            memset(out, 0, sizeof(uint64_t) * (size_t)block->words);
+            break;
+        case QUERY_NOT:
+            evaluate_block(query, node->left, block, live, other);
+            for (int w = 0; w < block->words; w++) {
+                out[w] = live[w] & ~other[w];
+            }
+            break;
+        case QUERY_AND:
+            evaluate_block(query, node->left, block, live, other);
+            evaluate_block(query, node->right, block, other, out);
+            break;
+        case QUERY_OR: {
+            uint64_t rest[QUERY_BLOCK_WORDS];
+            evaluate_block(query, node->left, block, live, other);
+            for (int w = 0; w < block->words; w++) {
+                rest[w] = live[w] & ~other[w];
+            }
+            evaluate_block(query, node->right, block, rest, out);
+            for (int w = 0; w < block->words; w++) {
+                out[w] |= other[w];
+            }
+            break;
+        }
+    }
+}
+
+// Run a compiled query over the column store, QUERY_BLOCK_ROWS rows at a
+// time: each block starts from the rows that hold a book and that the
+// indexes allow, and blocks with none are skipped without evaluating
+// anything. `emit` (if not NULL) is called for each match in library order.
+// Returns the number of matches.
+int query_run(const Query* query, const Library* library, QueryEmit emit, void* context) {
+    const BookColumns* columns = &library->columns;
+    if (query->plan_root < 0 || query->plan[query->plan_root].type == QUERY_FALSE) {
+        return 0;
+    }
+
+    QueryBlock block;
+    block.columns = columns;
+    block.strings = &library->strings;
+    int matches = 0;
+    int number = 0; // Books before this block, for numbering matches as in the full listing
+    for (int row = 0; row < columns->count; row += QUERY_BLOCK_ROWS) {
+        block.first_row = row;
+        block.words = (columns->count - row + 63) / 64;
+        if (block.words > QUERY_BLOCK_WORDS) {
+            block.words = QUERY_BLOCK_WORDS;
+        }
+
+        uint64_t live[QUERY_BLOCK_WORDS];
+        uint64_t found[QUERY_BLOCK_WORDS];
+        uint64_t any = 0;
+        for (int w = 0; w < block.words; w++) {
+            uint32_t word = (uint32_t)(row / 64 + w);
+            live[w] = columns->valid[word];
+            if (query->candidates) {
+                live[w] &= word < query->candidate_words ? query->candidates[word] : 0;
+            }
+            any |= live[w];
+        }
+        if (any) {
+            evaluate_block(query, query->plan_root, &block, live, found);
+        }
+
+        for (int w = 0; w < block.words; w++) {
+            uint64_t valid = columns->valid[row / 64 + w];
+            uint64_t bits = any ? found[w] : 0;
+            matches += __builtin_popcountll(bits);
+            for (; emit && bits; bits &= bits - 1) {
+                int bit = __builtin_ctzll(bits);
+                uint64_t below = ((uint64_t)1 << bit) - 1;
+                emit(context, row + w * 64 + bit, number + __builtin_popcountll(valid & below) + 1);
+            }
+            number += __builtin_popcountll(valid);
+        }
+    }
+    return matches;
+}
+
+// Whether one book matches a parsed node, interpreting the tree row by row
+static int book_matches(const Query* query, const Library* library, const Book* book, int index) {
+    const QueryNode* node = &query->nodes[index];
+    switch (node->type) {
+        case QUERY_TRUE:
+            return 1;
+        case QUERY_FALSE:
+            return 0;
+        case QUERY_NOT:
+            return !book_matches(query, library, book, node->left);
+        case QUERY_AND:
+            return book_matches(query, library, book, node->left) && book_matches(query, library, book, node->right);
+        case QUERY_OR:
+            return book_matches(query, library, book, node->left) || book_matches(query, library, book, node->right);
+        case QUERY_COMPARE:
+            break;
+    }
+
+    int64_t value;
+    switch (node->field) {
+        case QUERY_YEAR:
+            value = book->year_published;
+            break;
+        case QUERY_WORDS:
+            value = book->word_count;
+            break;
+        case QUERY_AUTHOR:
+            value = book->author_id;
+            break;
+        case QUERY_GENRE:
+            value = book->genre_id;
+            break;
+        case QUERY_COVER:
+            value = book->cover_type;
+            break;
+        case QUERY_CONDITION:
+            value = book->condition;
+            break;
+        case QUERY_METADATA:
+            value = book->metadata_retrieved != 0;
+            break;
+        case QUERY_TITLE:
+            value = book->title.length == node->length &&
+                    memcmp(book_title(library, book), query->text + node->text, node->length) == 0;
+            return node->op == QUERY_EQ ? (int)value : !value;
+        default:
+            value = (int64_t)isbn_key_unchecked(book_isbn(library, book), book->isbn.length);
+            break;
+    }
+    if (value == 0 && skips_empty(node)) {
+        return 0;
+    }
+    switch (node->op) {
+        case QUERY_EQ:
+            return value == node->value;
+        case QUERY_NE:
+            return value != node->value;
+        case QUERY_LT:
+            return value < node->value;
+        case QUERY_LE:
+            return value <= node->value;
+        case QUERY_GT:
+            return value > node->value;
+        case QUERY_GE:
+            return value >= node->value;
+    }
+    return 0;
+}
+
+// Count the books matching a compiled query by walking the parsed tree for
+// every book, without the column store, blocks or indexes. The answer
+// matches query_run; it is kept to check and time the pipeline against.
+int query_run_rows(const Query* query, const Library* library) {
+    int matches = 0;
+    for (int slot = 0; slot < library->count; slot++) {
+        if (library_is_live(library, slot) && book_matches(query, library, library_book(library, slot), query->root)) {
+            matches++;
+        }
+    }
+    return matches;
+}
+
+// Print one match of a query
+static void print_query_book(void* context, int slot, int number) {
+    const Library* library = (const Library*)context;
+    const Book* book = library_book(library, slot);
+    BookStrings strings;
+    get_book_strings(library, book, &strings);
+    printf("Book %d:\n", number);
+    print_book(book, &strings);
+    printf("\n");
+}
+
+// Parse, compile and run a query, printing the books it matches (or, with
+// count_only, just how many). With timing set, the pipeline is also timed
+// against the row-at-a-time interpreter.
+void print_query_results(Library* library, const char* text, int count_only, int timing) {
+    Query query;
+    query_init(&query);
+    if (!query_parse(&query, text)) {
+        printf("Bad query: %s\n", query.error);
+        return;
+    }
+    if (!library->columnar && !library_enable_columns(library)) {
+        printf("Not enough memory to run the query.\n");
+        return;
+    }
+    if (!query_compile(&query, library)) {
+        printf("Not enough memory to run the query.\n");
+        query_free(&query);
+        return;
+    }
+
+    if (timing) {
+        double started = fetch_now_seconds();
+        int matches = query_run(&query, library, NULL, NULL);
+        double pipeline = fetch_now_seconds() - started;
+        started = fetch_now_seconds();
+        int row_matches = query_run_rows(&query, library);
+        double rows = fetch_now_seconds() - started;
+        printf("Pipeline: %d matches in %.3f ms%s\n", matches, pipeline * 1000.0,
+               query.candidates ? " (using indexes)" : "");
+        printf("Row at a time: %d matches in %.3f ms (%.1fx slower)\n", row_matches, rows * 1000.0,
+               pipeline > 0 ? rows / pipeline : 0.0);
+    }
+
+    int matches = query_run(&query, library, count_only ? NULL : print_query_book, library);
+    printf("%d of %d books match.\n", matches, library_book_count(library));
+    query_free(&query);
+}
+
+// Free the candidate bitmap of a compiled query
+void query_free(Query* query) {
+    free(query->candidates);
+    query->candidates = NULL;
+    query->candidate_words = 0;
+}
@@ -0,0 +1,84 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <stdint.h>
+#include "library.h"
+
+#define QUERY_MAX_NODES 64        // Comparisons and operators in one query
+#define QUERY_MAX_TEXT 1024       // Bytes of string constants in one query
+#define QUERY_BLOCK_ROWS 1024     // Rows each comparison runs over at a time
+#define QUERY_BLOCK_WORDS (QUERY_BLOCK_ROWS / 64)
+
+// Book fields a query can test
+typedef enum {
+    QUERY_YEAR,
+    QUERY_WORDS,
+    QUERY_TITLE,
+    QUERY_AUTHOR,
+    QUERY_GENRE,
+    QUERY_ISBN,
+    QUERY_COVER,
+    QUERY_CONDITION,
+    QUERY_METADATA
+} QueryField;
+
+typedef enum {
+    QUERY_EQ,
+    QUERY_NE,
+    QUERY_LT,
+    QUERY_LE,
+    QUERY_GT,
+    QUERY_GE
+} QueryOp;
+
+typedef enum {
+    QUERY_COMPARE,
+    QUERY_AND,
+    QUERY_OR,
+    QUERY_NOT,
+    QUERY_TRUE,       // Answered by an index, or a name no book has
+    QUERY_FALSE
+} QueryNodeType;
+
+// One node of a parsed query
+typedef struct {
+    QueryNodeType type;
+    QueryField field;       // Comparisons
+    QueryOp op;
+    int64_t value;          // Number, enum value, dictionary ID or ISBN key
+    uint32_t text;          // String constant: offset in the query's text
+    uint32_t length;
+    int left;               // Operands of AND and OR; NOT uses left
+    int right;
+} QueryNode;
+
+// A query parsed from text and compiled against one library. Compiling
+// keeps the parsed tree for the row-at-a-time interpreter and writes a plan:
+// a copy in which comparisons answered by an index, or by a name no book
+// has, are folded away and the rest run over blocks of column rows.
+typedef struct {
+    QueryNode nodes[QUERY_MAX_NODES];
+    int node_count;
+    int root;
+    QueryNode plan[QUERY_MAX_NODES];
+    int plan_root;
+    char text[QUERY_MAX_TEXT];  // String constants, each NUL-terminated
+    uint32_t text_size;
+    uint64_t* candidates;       // Bit per slot the indexes allow (NULL = every slot)
+    uint32_t candidate_words;
+    char error[160];            // Why parsing failed
+} Query;
+
+// Called for each book a query matches: its slot and its number in the full listing
+typedef void (*QueryEmit)(void* context, int slot, int number);
+
+// Function declarations
+void query_init(Query* query);
+int query_parse(Query* query, const char* text);
+int query_compile(Query* query, Library* library);
+int query_run(const Query* query, const Library* library, QueryEmit emit, void* context);
+int query_run_rows(const Query* query, const Library* library);
+void print_query_results(Library* library, const char* text, int count_only, int timing);
+void query_free(Query* query);
+
+#endif // QUERY_H
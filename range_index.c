@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "range_index.h"
+
+#define RANGE_INDEX_INITIAL_ENTRIES 64
+
+// Initialize an empty index
+void range_index_init(RangeIndex* index) {
+    memset(index, 0, sizeof(RangeIndex));
+}
+
+// Whether entry a sorts before entry b (by key, then slot)
+static int range_entry_less(const RangeEntry* a, const RangeEntry* b) {
+    return a->key < b->key || (a->key == b->key && (a->slot & ~RANGE_REMOVED) < (b->slot & ~RANGE_REMOVED));
+}
+
+// Position of the first entry not sorting before (key, slot)
+static uint32_t range_lower_bound(const RangeEntry* entries, uint32_t count, int32_t key, uint32_t slot) {
+    RangeEntry target;
+    target.key = key;
+    target.slot = slot;
+    uint32_t low = 0;
+    uint32_t high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (range_entry_less(&entries[middle], &target)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Make room for `count` sorted entries in total
+int range_index_reserve(RangeIndex* index, uint32_t count) {
+    if (count <= index->capacity) {
+        return 1;
+    }
+    uint32_t capacity = index->capacity ? index->capacity : RANGE_INDEX_INITIAL_ENTRIES;
+    while (capacity < count) {
+        capacity *= 2;
+    }
+
+    RangeEntry* entries = (RangeEntry*)realloc(index->entries, sizeof(RangeEntry) * capacity);
+    if (!entries) {
+        fprintf(stderr, "Memory allocation failed while growing range index\n");
+        return 0;
+    }
+    index->entries = entries;
+    index->capacity = capacity;
+    return 1;
+}
+
+// Add an entry to the end of the sorted array, for a bulk build. Entries are
+// appended in slot order and put in key order by range_index_sort.
+int range_index_append(RangeIndex* index, int32_t key, uint32_t slot) {
+    if (!range_index_reserve(index, index->count + 1)) {
+        return 0;
+    }
+    index->entries[index->count].key = key;
+    index->entries[index->count].slot = slot;
+    index->count++;
+    return 1;
+}
+
+// Byte of a key for one radix pass, with the sign bit flipped so negative
+// keys sort first
+static uint32_t range_digit(int32_t key, int shift) {
+    return (((uint32_t)key ^ 0x80000000u) >> shift) & 0xFF;
+}
+
+// Sort the entries appended since the index was cleared. The radix sort is
+// stable, so books with equal keys keep the slot order they were appended
+// in; passes over a byte every key shares (the high bytes of years, say)
+// are skipped.
+int range_index_sort(RangeIndex* index) {
+    if (index->count < 2) {
+        return 1;
+    }
+    RangeEntry* buffer = (RangeEntry*)malloc(sizeof(RangeEntry) * index->count);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation failed while sorting range index\n");
+        return 0;
+    }
+
+    RangeEntry* from = index->entries;
+    RangeEntry* to = buffer;
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t counts[256] = {0};
+        for (uint32_t i = 0; i < index->count; i++) {
+            counts[range_digit(from[i].key, shift)]++;
+        }
+        if (counts[range_digit(from[0].key, shift)] == index->count) {
+            continue;
+        }
+
+        uint32_t total = 0;
+        for (int digit = 0; digit < 256; digit++) {
+            uint32_t count = counts[digit];
+            counts[digit] = total;
+            total += count;
+        }
+        for (uint32_t i = 0; i < index->count; i++) {
+            to[counts[range_digit(from[i].key, shift)]++] = from[i];
+        }
+        RangeEntry* swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != index->entries) {
+        memcpy(index->entries, from, sizeof(RangeEntry) * index->count);
+    }
+    free(buffer);
+    return 1;
+}
+
+// Move the pending entries into the sorted array and drop removed entries.
+// The merge runs from the back, so it needs no second array.
+static int range_index_merge(RangeIndex* index) {
+    if (!range_index_reserve(index, index->count + index->pending_count)) {
+        return 0;
+    }
+
+    RangeEntry* entries = index->entries;
+    uint32_t total = index->count + index->pending_count;
+    uint32_t i = index->count;
+    uint32_t j = index->pending_count;
+    uint32_t write = total;
+    while (j > 0) {
+        if (i > 0 && (entries[i - 1].slot & RANGE_REMOVED)) {
+            i--;
+        } else if (i > 0 && range_entry_less(&index->pending[j - 1], &entries[i - 1])) {
+            entries[--write] = entries[--i];
+        } else {
+            entries[--write] = index->pending[--j];
+        }
+    }
+
+    // Entries below i never moved; close up any removed ones among them and
+    // the gap left by those skipped during the merge
+    uint32_t kept = 0;
+    for (uint32_t k = 0; k < i; k++) {
+        if (!(entries[k].slot & RANGE_REMOVED)) {
+            entries[kept++] = entries[k];
+        }
+    }
+    memmove(entries + kept, entries + write, sizeof(RangeEntry) * (total - write));
+    index->count = kept + (total - write);
+    index->removed = 0;
+    index->pending_count = 0;
+    return 1;
+}
+
+// Index the book in `slot` under `key`
+int range_index_add(RangeIndex* index, int32_t key, uint32_t slot) {
+    if (index->pending_count == RANGE_PENDING_MAX && !range_index_merge(index)) {
+        return 0;
+    }
+    if (index->pending_count == index->pending_capacity) {
+        uint32_t capacity = index->pending_capacity ? index->pending_capacity * 2 : RANGE_INDEX_INITIAL_ENTRIES;
+        RangeEntry* pending = (RangeEntry*)realloc(index->pending, sizeof(RangeEntry) * capacity);
+        if (!pending) {
+            fprintf(stderr, "Memory allocation failed while growing range index\n");
+            return 0;
+        }
+        index->pending = pending;
+        index->pending_capacity = capacity;
+    }
+
+    uint32_t position = range_lower_bound(index->pending, index->pending_count, key, slot);
+    memmove(index->pending + position + 1, index->pending + position,
+            sizeof(RangeEntry) * (index->pending_count - position));
+    index->pending[position].key = key;
+    index->pending[position].slot = slot;
+    index->pending_count++;
+    return 1;
+}
+
+// Drop the entry of the book in `slot`. Sorted entries are only marked; once
+// a quarter of them are, the next merge is brought forward to drop them.
+void range_index_remove(RangeIndex* index, int32_t key, uint32_t slot) {
+    uint32_t position = range_lower_bound(index->pending, index->pending_count, key, slot);
+    if (position < index->pending_count && index->pending[position].key == key &&
+        index->pending[position].slot == slot) {
+        memmove(index->pending + position, index->pending + position + 1,
+                sizeof(RangeEntry) * (index->pending_count - position - 1));
+        index->pending_count--;
+        return;
+    }
+
+    position = range_lower_bound(index->entries, index->count, key, slot);
+    if (position < index->count && index->entries[position].key == key && index->entries[position].slot == slot) {
+        index->entries[position].slot |= RANGE_REMOVED;
+        index->removed++;
+        if (index->removed >= RANGE_PENDING_MAX && index->removed > index->count / 4) {
+            range_index_merge(index);
+        }
+    }
+}
+
+// Start a walk over the books with keys from `low` to `high`, inclusive
+void range_index_find(const RangeIndex* index, int32_t low, int32_t high, RangeCursor* cursor) {
+    cursor->index = index;
+    cursor->entry = range_lower_bound(index->entries, index->count, low, 0);
+    cursor->pending = range_lower_bound(index->pending, index->pending_count, low, 0);
+    cursor->high = high;
+}
+
+// Step to the next book of a walk, in key order and then library order.
+// Returns 0 once the range is exhausted.
+int range_cursor_next(RangeCursor* cursor, uint32_t* slot) {
+    const RangeIndex* index = cursor->index;
+    while (cursor->entry < index->count && (index->entries[cursor->entry].slot & RANGE_REMOVED)) {
+        cursor->entry++;
+    }
+
+    const RangeEntry* entry = NULL;
+    const RangeEntry* pending = NULL;
+    if (cursor->entry < index->count && index->entries[cursor->entry].key <= cursor->high) {
+        entry = &index->entries[cursor->entry];
+    }
+    if (cursor->pending < index->pending_count && index->pending[cursor->pending].key <= cursor->high) {
+        pending = &index->pending[cursor->pending];
+    }
+
+    if (entry && (!pending || range_entry_less(entry, pending))) {
+        *slot = entry->slot;
+        cursor->entry++;
+        return 1;
+    }
+    if (pending) {
+        *slot = pending->slot;
+        cursor->pending++;
+        return 1;
+    }
+    return 0;
+}
+
+// Drop every entry, keeping the arrays
+void range_index_clear(RangeIndex* index) {
+    index->count = 0;
+    index->removed = 0;
+    index->pending_count = 0;
+}
+
+// Bytes allocated for the arrays
+size_t range_index_memory(const RangeIndex* index) {
+    return sizeof(RangeEntry) * ((size_t)index->capacity + index->pending_capacity);
+}
+
+// Free the arrays
+void range_index_free(RangeIndex* index) {
+    free(index->entries);
+    free(index->pending);
+    range_index_init(index);
+}
@@ -0,0 +1,52 @@
+#ifndef RANGE_INDEX_H
+#define RANGE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RANGE_PENDING_MAX 4096          // Inserts held back before a merge
+#define RANGE_REMOVED 0x80000000u       // Slot bit marking a removed entry
+
+// One indexed book: the value of its field and its library slot
+typedef struct {
+    int32_t key;
+    uint32_t slot;        // Library slot, with RANGE_REMOVED set once removed
+} RangeEntry;
+
+// Ordered index from one integer field to library slots: a sorted array of
+// (key, slot) pairs, so books with equal keys stay in library order. New
+// entries wait in a small sorted array and are merged in batches; removed
+// entries are marked in place and dropped by the next merge.
+typedef struct {
+    RangeEntry* entries;      // Sorted by key, then slot
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t removed;         // Entries marked RANGE_REMOVED
+    RangeEntry* pending;      // Sorted like entries, at most RANGE_PENDING_MAX
+    uint32_t pending_count;
+    uint32_t pending_capacity;
+} RangeIndex;
+
+// Position in a walk over the entries with keys in [low, high]. Any change
+// to the index invalidates it.
+typedef struct {
+    const RangeIndex* index;
+    uint32_t entry;
+    uint32_t pending;
+    int32_t high;
+} RangeCursor;
+
+// Function declarations
+void range_index_init(RangeIndex* index);
+int range_index_reserve(RangeIndex* index, uint32_t count);
+int range_index_append(RangeIndex* index, int32_t key, uint32_t slot);
+int range_index_sort(RangeIndex* index);
+int range_index_add(RangeIndex* index, int32_t key, uint32_t slot);
+void range_index_remove(RangeIndex* index, int32_t key, uint32_t slot);
+void range_index_find(const RangeIndex* index, int32_t low, int32_t high, RangeCursor* cursor);
+int range_cursor_next(RangeCursor* cursor, uint32_t* slot);
+void range_index_clear(RangeIndex* index);
+size_t range_index_memory(const RangeIndex* index);
+void range_index_free(RangeIndex* index);
+
+#endif // RANGE_INDEX_H
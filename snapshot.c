@@ -0,0 +1,444 @@
+#define _POSIX_C_SOURCE 200809L  // mmap and fsync under -std=c99
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "crc32.h"
+
+// Little-endian encoding helpers
+static void put_u32(unsigned char* p, uint32_t value) {
+    p[0] = (unsigned char)value;
+    p[1] = (unsigned char)(value >> 8);
+    p[2] = (unsigned char)(value >> 16);
+    p[3] = (unsigned char)(value >> 24);
+}
+
+static uint32_t get_u32(const unsigned char* p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void put_u64(unsigned char* p, uint64_t value) {
+    put_u32(p, (uint32_t)value);
+    put_u32(p + 4, (uint32_t)(value >> 32));
+}
+
+static uint64_t get_u64(const unsigned char* p) {
+    return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+// Bytes of numeric columns and offset table for `count` books
+static uint64_t snapshot_column_bytes(uint64_t count) {
+    uint64_t numeric = count * 4 * 2 + count * 3;
+    uint64_t padded = (numeric + 3) & ~(uint64_t)3;
+    return padded + (count * 4 + 1) * 4;
+}
+
+// The string columns of a book, in file order
+static void book_string_refs(const Library* library, const Book* book, StrRef refs[4]) {
+    refs[0] = book->title;
+    refs[1] = intern_ref(&library->authors, book->author_id);
+    refs[2] = book->isbn;
+    refs[3] = intern_ref(&library->genres, book->genre_id);
+}
+
+// Bytes a string takes in the string area
+static uint64_t snapshot_string_size(StrRef ref) {
+    return ref.length ? (uint64_t)ref.length + 1 : 0;
+}
+
+// Bytes of the totals section (0 if the library's totals went stale)
+static uint64_t snapshot_totals_bytes(const Library* library) {
+    const LibraryTotals* totals = &library->totals;
+    if (totals->stale) {
+        return 0;
+    }
+    uint64_t bytes = SNAPSHOT_TOTALS_SIZE;
+    for (uint32_t id = 0; id < totals->genre_count; id++) {
+        if (totals->genres[id] != 0) {
+            bytes += 8 + intern_ref(&library->genres, id).length;
+        }
+    }
+    return bytes;
+}
+
+// Write the totals section. Genres are written by name, as their IDs are
+// given out afresh on every load.
+static void snapshot_write_totals(const Library* library, unsigned char* p) {
+    const LibraryTotals* totals = &library->totals;
+    put_u32(p, totals->books);
+    put_u32(p + 4, totals->missing_metadata);
+    put_u64(p + 8, (uint64_t)totals->words);
+    for (int i = 0; i < COVER_TYPE_COUNT; i++) {
+        put_u32(p + 16 + i * 4, totals->covers[i]);
+    }
+    for (int i = 0; i < CONDITION_COUNT; i++) {
+        put_u32(p + 28 + i * 4, totals->conditions[i]);
+    }
+
+    unsigned char* entry = p + SNAPSHOT_TOTALS_SIZE;
+    uint32_t genres = 0;
+    for (uint32_t id = 0; id < totals->genre_count; id++) {
+        if (totals->genres[id] == 0) {
+            continue;
+        }
+        StrRef name = intern_ref(&library->genres, id);
+        put_u32(entry, totals->genres[id]);
+        put_u32(entry + 4, name.length);
+        memcpy(entry + 8, arena_get(&library->strings, name), name.length);
+        entry += 8 + name.length;
+        genres++;
+    }
+    put_u32(p + 44, genres);
+}
+
+// Read a totals section, resolving genre names against the library's
+// genres. Returns 0 if it is malformed or does not add up to `count` books.
+static int snapshot_read_totals(Library* library, const unsigned char* p, uint64_t size, uint64_t count,
+                                LibraryTotals* totals) {
+    if (size < SNAPSHOT_TOTALS_SIZE) {
+        return 0;
+    }
+    totals->books = get_u32(p);
+    totals->missing_metadata = get_u32(p + 4);
+    totals->words = (int64_t)get_u64(p + 8);
+    for (int i = 0; i < COVER_TYPE_COUNT; i++) {
+        totals->covers[i] = get_u32(p + 16 + i * 4);
+    }
+    for (int i = 0; i < CONDITION_COUNT; i++) {
+        totals->conditions[i] = get_u32(p + 28 + i * 4);
+    }
+
+    uint32_t genres = get_u32(p + 44);
+    uint64_t position = SNAPSHOT_TOTALS_SIZE;
+    uint64_t genre_books = 0;
+    for (uint32_t i = 0; i < genres; i++) {
+        if (size - position < 8) {
+            return 0;
+        }
+        uint32_t books = get_u32(p + position);
+        uint32_t length = get_u32(p + position + 4);
+        position += 8;
+        if (size - position < length) {
+            return 0;
+        }
+        uint32_t id = intern_find(&library->genres, &library->strings, (const char*)p + position, length);
+        if (id == INTERN_NOT_FOUND || !totals_add_genre(totals, id, books)) {
+            return 0;
+        }
+        genre_books += books;
+        position += length;
+    }
+    return position == size && totals->books == count && genre_books == count;
+}
+
+// Write the library as a snapshot, via a temporary file and rename. Deleted
+// slots must have been compacted away first (see compact_library).
+int save_library_to_snapshot(const Library* library, const char* filename) {
+    if (library->free_count > 0) {
+        printf("Library must be compacted before it is written to %s\n", filename);
+        return 0;
+    }
+
+    uint64_t count = (uint64_t)library->count;
+    uint64_t string_bytes = 0;
+    for (int i = 0; i < library->count; i++) {
+        StrRef refs[4];
+        book_string_refs(library, library_book(library, i), refs);
+        string_bytes += snapshot_string_size(refs[0]) + snapshot_string_size(refs[1]) +
+                        snapshot_string_size(refs[2]) + snapshot_string_size(refs[3]);
+    }
+    if (string_bytes > UINT32_MAX) {
+        printf("Library is too large for snapshot format %d\n", SNAPSHOT_VERSION);
+        return 0;
+    }
+
+    uint64_t column_bytes = snapshot_column_bytes(count);
+    uint64_t totals_bytes = snapshot_totals_bytes(library);
+    size_t total = (size_t)(SNAPSHOT_HEADER_SIZE + column_bytes + string_bytes + totals_bytes);
+    unsigned char* data = (unsigned char*)calloc(1, total);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed while writing snapshot\n");
+        return 0;
+    }
+
+    // Numeric columns
+    unsigned char* word_counts = data + SNAPSHOT_HEADER_SIZE;
+    unsigned char* years = word_counts + count * 4;
+    unsigned char* covers = years + count * 4;
+    unsigned char* conditions = covers + count;
+    unsigned char* retrieved = conditions + count;
+    for (uint64_t i = 0; i < count; i++) {
+        const Book* book = library_book(library, i);
+        put_u32(word_counts + i * 4, (uint32_t)book->word_count);
+        put_u32(years + i * 4, (uint32_t)book->year_published);
+        covers[i] = (unsigned char)book->cover_type;
+        conditions[i] = (unsigned char)book->condition;
+        retrieved[i] = (unsigned char)book->metadata_retrieved;
+    }
+
+    // String offsets and bytes, one column at a time
+    unsigned char* offsets = data + SNAPSHOT_HEADER_SIZE + column_bytes - (count * 4 + 1) * 4;
+    unsigned char* strings = data + SNAPSHOT_HEADER_SIZE + column_bytes;
+    uint32_t position = 0;
+    for (int column = 0; column < 4; column++) {
+        for (uint64_t i = 0; i < count; i++) {
+            StrRef refs[4];
+            book_string_refs(library, library_book(library, i), refs);
+            uint32_t size = (uint32_t)snapshot_string_size(refs[column]);
+            put_u32(offsets + ((uint64_t)column * count + i) * 4, position);
+            memcpy(strings + position, arena_get(&library->strings, refs[column]), size);
+            position += size;
+        }
+    }
+    put_u32(offsets + count * 4 * 4, position);
+
+    unsigned char* totals = strings + string_bytes;
+    if (totals_bytes > 0) {
+        snapshot_write_totals(library, totals);
+    }
+
+    // Header
+    memcpy(data, SNAPSHOT_MAGIC, 8);
+    put_u32(data + 8, SNAPSHOT_VERSION);
+    put_u32(data + 12, (uint32_t)totals_bytes);
+    put_u64(data + 16, count);
+    put_u64(data + 24, string_bytes);
+    put_u32(data + 32, crc32_update(0, data + SNAPSHOT_HEADER_SIZE, (size_t)column_bytes));
+    put_u32(data + 36, crc32_update(0, strings, (size_t)string_bytes));
+    put_u32(data + 40, crc32_update(0, data, 40));
+    put_u32(data + 44, crc32_update(0, totals, (size_t)totals_bytes));
+
+    // Tell the journal which snapshot it is folded into before this one takes
+    // over, in case the program stops before the journal is emptied
+    if (library->journal && !journal_mark_folding(library->journal, get_u64(data + 40))) {
+        free(data);
+        return 0;
+    }
+
+    char temp_name[512];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+    FILE* file = fopen(temp_name, "wb");
+    if (!file) {
+        perror("Error opening snapshot for writing");
+        free(data);
+        return 0;
+    }
+
+    int ok = fwrite(data, 1, total, file) == total;
+    ok = fflush(file) == 0 && ok;
+    ok = fsync(fileno(file)) == 0 && ok;
+    ok = fclose(file) == 0 && ok;
+    free(data);
+
+    if (!ok || rename(temp_name, filename) != 0) {
+        perror("Error writing snapshot");
+        remove(temp_name);
+        return 0;
+    }
+    printf("Library saved to %s\n", filename);
+    return 1;
+}
+
+// Check the header and checksums. Returns NULL if the snapshot is usable, or the reason it is not.
+static const char* snapshot_validate(const unsigned char* data, size_t size, SnapshotHeader* header) {
+    if (size < SNAPSHOT_HEADER_SIZE || memcmp(data, SNAPSHOT_MAGIC, 8) != 0) {
+        return "not a bookshelf snapshot";
+    }
+    if (get_u32(data + 40) != crc32_update(0, data, 40)) {
+        return "header checksum mismatch";
+    }
+
+    header->version = get_u32(data + 8);
+    header->count = get_u64(data + 16);
+    header->string_bytes = get_u64(data + 24);
+    header->column_crc = get_u32(data + 32);
+    header->string_crc = get_u32(data + 36);
+    header->totals_bytes = header->version >= 3 ? get_u32(data + 12) : 0;
+    header->totals_crc = get_u32(data + 44);
+
+    if (header->version < 1 || header->version > SNAPSHOT_VERSION) {
+        return "unsupported snapshot version";
+    }
+    if (header->count > (uint64_t)INT32_MAX || header->string_bytes > UINT32_MAX ||
+        SNAPSHOT_HEADER_SIZE + snapshot_column_bytes(header->count) + header->string_bytes +
+        header->totals_bytes != size) {
+        return "sizes do not match the file";
+    }
+
+    uint64_t column_bytes = snapshot_column_bytes(header->count);
+    if (crc32_update(0, data + SNAPSHOT_HEADER_SIZE, (size_t)column_bytes) != header->column_crc) {
+        return "column checksum mismatch";
+    }
+    if (crc32_update(0, data + SNAPSHOT_HEADER_SIZE + column_bytes, (size_t)header->string_bytes) != header->string_crc) {
+        return "string checksum mismatch";
+    }
+    const unsigned char* totals = data + SNAPSHOT_HEADER_SIZE + column_bytes + header->string_bytes;
+    if (header->totals_bytes > 0 && crc32_update(0, totals, header->totals_bytes) != header->totals_crc) {
+        return "totals checksum mismatch";
+    }
+    return NULL;
+}
+
+// Checksum identifying a snapshot, taken from its header: the header CRC
+// together with the checksum word after it. Returns 0 if the file is missing
+// or is not a snapshot.
+uint64_t snapshot_checksum(const char* filename) {
+    unsigned char header[SNAPSHOT_HEADER_SIZE];
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        return 0;
+    }
+    size_t got = fread(header, 1, sizeof(header), file);
+    fclose(file);
+    if (got != sizeof(header) || memcmp(header, SNAPSHOT_MAGIC, 8) != 0 ||
+        get_u32(header + 40) != crc32_update(0, header, 40)) {
+        return 0;
+    }
+    return get_u64(header + 40);
+}
+
+// Intern the string whose offset is at `slot`
+static uint32_t snapshot_intern(Library* library, InternTable* table, const unsigned char* strings,
+                                const unsigned char* slot, uint32_t version) {
+    uint32_t start = get_u32(slot);
+    uint32_t end = get_u32(slot + 4);
+    uint32_t length = version >= 2 && end > start ? end - start - 1 : end - start;
+    return intern_add(table, &library->strings, (const char*)strings + start, length);
+}
+
+// Load a snapshot with a single mmap. Books are appended to the library with
+// one allocation, and their titles and ISBNs with one copy per column; their
+// totals are taken from the file rather than counted when it has them.
+// Returns 0 if the file is missing or damaged.
+int load_library_from_snapshot(Library* library, const char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        printf("Error: %s is empty or unreadable\n", filename);
+        return 0;
+    }
+
+    size_t size = (size_t)st.st_size;
+    unsigned char* data = (unsigned char*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("Error mapping snapshot");
+        return 0;
+    }
+
+    SnapshotHeader header;
+    const char* problem = snapshot_validate(data, size, &header);
+    if (problem) {
+        printf("Error: %s is damaged (%s)\n", filename, problem);
+        munmap(data, size);
+        return 0;
+    }
+
+    int count = (int)header.count;
+    if (!library_reserve(library, library->count + count)) {
+        munmap(data, size);
+        return 0;
+    }
+
+    const unsigned char* word_counts = data + SNAPSHOT_HEADER_SIZE;
+    const unsigned char* years = word_counts + header.count * 4;
+    const unsigned char* covers = years + header.count * 4;
+    const unsigned char* conditions = covers + header.count;
+    const unsigned char* retrieved = conditions + header.count;
+    uint64_t column_bytes = snapshot_column_bytes(header.count);
+    const unsigned char* offsets = data + SNAPSHOT_HEADER_SIZE + column_bytes - (header.count * 4 + 1) * 4;
+    const unsigned char* strings = data + SNAPSHOT_HEADER_SIZE + column_bytes;
+
+    // Offsets must be non-decreasing and inside the string area, and (from
+    // version 2) every non-empty string must end with its terminator
+    uint32_t previous = 0;
+    for (uint64_t i = 0; i <= header.count * 4; i++) {
+        uint32_t offset = get_u32(offsets + i * 4);
+        if (offset < previous || offset > header.string_bytes ||
+            (header.version >= 2 && offset > previous && strings[offset - 1] != '\0')) {
+            printf("Error: %s is damaged (bad string offset)\n", filename);
+            munmap(data, size);
+            return 0;
+        }
+        previous = offset;
+    }
+
+    // Authors and genres go through the library's dictionaries
+    for (int i = 0; i < count; i++) {
+        Book* book = library_book(library, library->count + i);
+        const unsigned char* author = offsets + (header.count + (uint64_t)i) * 4;
+        const unsigned char* genre = offsets + (3 * header.count + (uint64_t)i) * 4;
+        book->author_id = snapshot_intern(library, &library->authors, strings, author, header.version);
+        book->genre_id = snapshot_intern(library, &library->genres, strings, genre, header.version);
+    }
+
+    // Version 3 carries the books' totals, which saves counting them book by book
+    LibraryTotals totals;
+    totals_init(&totals);
+    int has_totals = header.totals_bytes > 0 &&
+                     snapshot_read_totals(library, strings + header.string_bytes, header.totals_bytes, header.count,
+                                          &totals);
+    if (header.totals_bytes > 0 && !has_totals) {
+        printf("Warning: Totals in %s do not match its books; counting them instead\n", filename);
+    }
+
+    // Version 2 title and ISBN columns are already in arena form and are copied
+    // whole; version 1 strings are added one at a time
+    uint32_t column_bases[3] = {0, 0, 0};
+    for (int column = 0; column <= 2 && header.version >= 2; column += 2) {
+        uint32_t first = get_u32(offsets + (uint64_t)column * header.count * 4);
+        uint32_t last = get_u32(offsets + (uint64_t)(column + 1) * header.count * 4);
+        if (!arena_reserve(&library->strings, last - first)) {
+            totals_free(&totals);
+            munmap(data, size);
+            return 0;
+        }
+        column_bases[column] = (uint32_t)library->strings.size - first;
+        memcpy(library->strings.data + library->strings.size, strings + first, last - first);
+        library->strings.size += last - first;
+    }
+
+    for (int i = 0; i < count; i++) {
+        Book* book = library_book(library, library->count + i);
+        StrRef* fields[3] = {&book->title, NULL, &book->isbn};
+
+        for (int column = 0; column <= 2; column += 2) {
+            const unsigned char* slot = offsets + ((uint64_t)column * header.count + (uint64_t)i) * 4;
+            uint32_t start = get_u32(slot);
+            uint32_t end = get_u32(slot + 4);
+            StrRef ref = {0, 0};
+            if (header.version >= 2) {
+                if (end > start) {
+                    ref.offset = column_bases[column] + start;
+                    ref.length = end - start - 1;
+                }
+            } else {
+                ref = arena_add(&library->strings, (const char*)strings + start, end - start);
+            }
+            *fields[column] = ref;
+        }
+
+        book->word_count = (int)get_u32(word_counts + (size_t)i * 4);
+        book->year_published = (int)get_u32(years + (size_t)i * 4);
+        book->cover_type = (CoverType)covers[i];
+        book->condition = (Condition)conditions[i];
+        book->metadata_retrieved = retrieved[i];
+    }
+    library_commit_appended(library, count, has_totals ? &totals : NULL);
+    totals_free(&totals);
+    library_refresh_columns(library);
+
+    munmap(data, size);
+    printf("Loaded %d books from %s\n", count, filename);
+    return 1;
+}
@@ -0,0 +1,47 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+#include "library.h"
+
+#define SNAPSHOT_MAGIC "BKSNAP\r\n"   // The CR LF catches text-mode transfers
+#define SNAPSHOT_VERSION 3   // Versions 1 (strings without terminators) and 2 (no totals) are still read
+#define SNAPSHOT_HEADER_SIZE 48
+#define SNAPSHOT_TOTALS_SIZE 48   // Fixed part of the totals section
+
+// On-disk layout (all integers little-endian):
+//
+//   header        SNAPSHOT_HEADER_SIZE bytes, fields below
+//   word_count    int32[count]
+//   year          int32[count]
+//   cover_type    uint8[count]
+//   condition     uint8[count]
+//   retrieved     uint8[count]
+//   (padding to a multiple of 4)
+//   offsets       uint32[4 * count + 1]: start of each string in the string
+//                 area, one column at a time (titles, authors, ISBNs, genres);
+//                 a string ends where the next one starts
+//   strings       string_bytes bytes; each non-empty string ends with a NUL
+//                 so the area can be copied into the library's string arena
+//                 as it is (empty strings take no bytes)
+//   totals        totals_bytes bytes (0 if they were not known): books,
+//                 missing metadata as uint32; words as int64; books per
+//                 cover type and per condition as uint32; the number of
+//                 genres with books, then per genre its books and name
+//                 length as uint32 and the name (no NUL)
+typedef struct {
+    uint32_t version;
+    uint32_t totals_bytes;   // Size of the totals section (version 3)
+    uint64_t count;          // Books in the snapshot
+    uint64_t string_bytes;   // Size of the string area
+    uint32_t column_crc;     // CRC-32 of the numeric columns and offset table
+    uint32_t string_crc;     // CRC-32 of the string area
+    uint32_t totals_crc;     // CRC-32 of the totals section
+} SnapshotHeader;
+
+// Function declarations
+int save_library_to_snapshot(const Library* library, const char* filename);
+int load_library_from_snapshot(Library* library, const char* filename);
+uint64_t snapshot_checksum(const char* filename);
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,434 @@
+#define _POSIX_C_SOURCE 200809L  // sysconf and pthreads under -std=c99
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "stats.h"
+
+#define STATS_INITIAL_ENTRIES 16
+#define STATS_NAME_WIDTH 30   // Group column of the printed table
+
+// Names accepted for group-by keys and measures, in enum order
+static const char* const group_by_names[] = {"genre", "author", "cover", "condition", "decade"};
+static const char* const group_by_headings[] = {"Genre", "Author", "Cover", "Condition", "Decade"};
+static const char* const measure_names[] = {"", "words", "year"};
+
+// One thread's share of the rows and the groups it found in them
+typedef struct {
+    const BookColumns* columns;
+    StatsGroupBy group_by;
+    StatsMeasure measure;
+    int begin;            // First row (a multiple of 64)
+    int end;
+    StatsTable table;
+} StatsPartial;
+
+// Initialize an empty table
+void stats_table_init(StatsTable* table) {
+    memset(table, 0, sizeof(StatsTable));
+}
+
+// Free a table's entries
+void stats_table_free(StatsTable* table) {
+    free(table->entries);
+    stats_table_init(table);
+}
+
+// Spread a key over the table (Fibonacci hashing; keys are small and dense)
+static uint32_t stats_hash(uint32_t key) {
+    return key * 0x9e3779b1u;
+}
+
+// Double the table (or make the first one), reinserting every group
+static int grow_table(StatsTable* table) {
+    uint32_t entry_count = table->entry_count ? table->entry_count * 2 : STATS_INITIAL_ENTRIES;
+    StatsEntry* entries = (StatsEntry*)calloc(entry_count, sizeof(StatsEntry));
+    if (!entries) {
+        table->failed = 1;
+        return 0;
+    }
+
+    uint32_t mask = entry_count - 1;
+    for (uint32_t i = 0; i < table->entry_count; i++) {
+        if (table->entries[i].count == 0) {
+            continue;
+        }
+        uint32_t position = stats_hash(table->entries[i].key) & mask;
+        while (entries[position].count != 0) {
+            position = (position + 1) & mask;
+        }
+        entries[position] = table->entries[i];
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->entry_count = entry_count;
+    return 1;
+}
+
+// Find a group's entry, adding an empty one (count 0) if it is new.
+// Returns NULL if the table could not grow.
+static StatsEntry* find_group(StatsTable* table, uint32_t key) {
+    if (table->entry_count) {
+        uint32_t mask = table->entry_count - 1;
+        for (uint32_t position = stats_hash(key) & mask; table->entries[position].count != 0;
+             position = (position + 1) & mask) {
+            if (table->entries[position].key == key) {
+                return &table->entries[position];
+            }
+        }
+    }
+
+    // New group: keep the table at most half full
+    if ((table->count + 1) * 2 > table->entry_count && !grow_table(table)) {
+        return NULL;
+    }
+    uint32_t mask = table->entry_count - 1;
+    uint32_t position = stats_hash(key) & mask;
+    while (table->entries[position].count != 0) {
+        position = (position + 1) & mask;
+    }
+    StatsEntry* entry = &table->entries[position];
+    entry->key = key;
+    entry->min = INT32_MAX;
+    entry->max = INT32_MIN;
+    table->count++;
+    return entry;
+}
+
+// Group key of one row
+static uint32_t row_key(const BookColumns* columns, StatsGroupBy group_by, int row) {
+    switch (group_by) {
+        case STATS_BY_GENRE:
+            return columns->genre_ids[row];
+        case STATS_BY_AUTHOR:
+            return columns->author_ids[row];
+        case STATS_BY_COVER:
+            return columns->cover_types[row];
+        case STATS_BY_CONDITION:
+            return columns->conditions[row];
+        case STATS_BY_DECADE:
+            break;
+    }
+    return columns->years[row] > 0 ? (uint32_t)(columns->years[row] / 10) : STATS_KEY_UNKNOWN;
+}
+
+// Aggregate one thread's rows into its own table. The previous row's group
+// is remembered, so runs of books in the same group skip the hash lookup.
+static void* aggregate_rows(void* arg) {
+    StatsPartial* partial = (StatsPartial*)arg;
+    const BookColumns* columns = partial->columns;
+    const int32_t* values = partial->measure == STATS_WORD_COUNT ? columns->word_counts
+                            : partial->measure == STATS_YEAR     ? columns->years
+                                                                 : NULL;
+    StatsEntry* entry = NULL;
+
+    for (int base = partial->begin; base < partial->end; base += 64) {
+        for (uint64_t live = columns->valid[base / 64]; live; live &= live - 1) {
+            int row = base + __builtin_ctzll(live);
+            uint32_t key = row_key(columns, partial->group_by, row);
+            if (!entry || entry->key != key) {
+                entry = find_group(&partial->table, key);
+                if (!entry) {
+                    return NULL;
+                }
+            }
+
+            entry->count++;
+            int32_t value = values ? values[row] : 0;
+            if (value > 0) {
+                entry->valued++;
+                entry->sum += value;
+                entry->min = value < entry->min ? value : entry->min;
+                entry->max = value > entry->max ? value : entry->max;
+            }
+        }
+    }
+    return NULL;
+}
+
+// Fold the groups of one table into another
+static int merge_table(StatsTable* into, const StatsTable* from) {
+    for (uint32_t i = 0; i < from->entry_count; i++) {
+        const StatsEntry* source = &from->entries[i];
+        if (source->count == 0) {
+            continue;
+        }
+        StatsEntry* entry = find_group(into, source->key);
+        if (!entry) {
+            return 0;
+        }
+        entry->count += source->count;
+        entry->valued += source->valued;
+        entry->sum += source->sum;
+        entry->min = source->min < entry->min ? source->min : entry->min;
+        entry->max = source->max > entry->max ? source->max : entry->max;
+    }
+    return 1;
+}
+
+// Count the library's books per group and, for a measure, sum, range and
+// average that field per group. The column store is split into one range of
+// rows per thread (0 = one per CPU core, fewer for small libraries); each
+// thread aggregates into its own table and the tables are merged at the end.
+// The library must keep a column store (see library_enable_columns). Returns
+// 0 if memory runs out.
+int stats_aggregate(const Library* library, StatsGroupBy group_by, StatsMeasure measure, int threads,
+                    StatsTable* result) {
+    const BookColumns* columns = &library->columns;
+    if (threads <= 0) {
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (threads > columns->count / STATS_MIN_THREAD_ROWS) {
+        threads = columns->count / STATS_MIN_THREAD_ROWS;
+    }
+    if (threads > STATS_MAX_THREADS) {
+        threads = STATS_MAX_THREADS;
+    }
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    // Split at multiples of 64 rows, so each thread reads whole validity words
+    StatsPartial partials[STATS_MAX_THREADS];
+    int words = (columns->count + 63) / 64;
+    for (int i = 0; i < threads; i++) {
+        StatsPartial* partial = &partials[i];
+        partial->columns = columns;
+        partial->group_by = group_by;
+        partial->measure = measure;
+        partial->begin = (int)((int64_t)words * i / threads) * 64;
+        partial->end = (int)((int64_t)words * (i + 1) / threads) * 64;
+        stats_table_init(&partial->table);
+    }
+
+    pthread_t handles[STATS_MAX_THREADS];
+    int started = 1;
+    for (; started < threads; started++) {
+        if (pthread_create(&handles[started], NULL, aggregate_rows, &partials[started]) != 0) {
+            break;
+        }
+    }
+    aggregate_rows(&partials[0]);
+    for (int i = 1; i < threads; i++) {
+        if (i < started) {
+            pthread_join(handles[i], NULL);
+        } else {
+            aggregate_rows(&partials[i]); // Thread could not be started: do its share here
+        }
+    }
+
+    int ok = 1;
+    for (int i = 0; i < threads; i++) {
+        ok = ok && !partials[i].table.failed && (i == 0 || merge_table(&partials[0].table, &partials[i].table));
+        if (i > 0) {
+            stats_table_free(&partials[i].table);
+        }
+    }
+    if (!ok) {
+        fprintf(stderr, "Memory allocation failed while aggregating statistics\n");
+        stats_table_free(&partials[0].table);
+        return 0;
+    }
+    stats_table_free(result);
+    *result = partials[0].table;
+    return 1;
+}
+
+// Fill a table with the books per genre, cover type or condition from the
+// library's running totals, without visiting any book. Returns 0 if the
+// totals cannot answer: other keys, or totals that could not be recounted.
+int stats_from_totals(Library* library, StatsGroupBy group_by, StatsTable* result) {
+    if (group_by != STATS_BY_GENRE && group_by != STATS_BY_COVER && group_by != STATS_BY_CONDITION) {
+        return 0;
+    }
+    const LibraryTotals* totals = library_totals(library);
+    if (totals->stale) {
+        return 0;
+    }
+
+    const uint32_t* counts = group_by == STATS_BY_GENRE ? totals->genres
+                             : group_by == STATS_BY_COVER ? totals->covers
+                                                          : totals->conditions;
+    uint32_t key_count = group_by == STATS_BY_GENRE ? totals->genre_count
+                         : group_by == STATS_BY_COVER ? COVER_TYPE_COUNT
+                                                      : CONDITION_COUNT;
+    stats_table_free(result);
+    for (uint32_t key = 0; key < key_count; key++) {
+        if (counts[key] == 0) {
+            continue;
+        }
+        StatsEntry* entry = find_group(result, key);
+        if (!entry) {
+            stats_table_free(result);
+            return 0;
+        }
+        entry->count = counts[key];
+    }
+    return 1;
+}
+
+// Print the library-wide totals, read from the running totals
+void print_library_totals(Library* library) {
+    const LibraryTotals* totals = library_totals(library);
+    if (totals->stale) {
+        printf("Not enough memory to count the library.\n");
+        return;
+    }
+
+    uint32_t genres = 0; // Named genres with books (ID 0 is the empty genre)
+    for (uint32_t id = INTERN_EMPTY + 1; id < totals->genre_count; id++) {
+        genres += totals->genres[id] != 0;
+    }
+    printf("\nLibrary totals:\n");
+    printf("  Books: %u\n", totals->books);
+    printf("  Words: %lld\n", (long long)totals->words);
+    printf("  Books missing metadata: %u\n", totals->missing_metadata);
+    printf("  Genres: %u\n", genres);
+}
+
+// Group-by key named on the command line, or -1
+int parse_stats_group_by(const char* name) {
+    for (int i = 0; i < (int)(sizeof(group_by_names) / sizeof(group_by_names[0])); i++) {
+        if (strcmp(name, group_by_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Measured field named on the command line (words or year), or -1
+int parse_stats_measure(const char* name) {
+    for (int i = STATS_WORD_COUNT; i <= STATS_YEAR; i++) {
+        if (strcmp(name, measure_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Ordering state for sorting groups, which qsort cannot pass along
+static const Library* sort_library;
+static StatsGroupBy sort_group_by;
+static int sort_largest;
+static int sort_by_sum;
+
+// Write a group's name: the genre or author, cover type, condition or decade
+static void format_group(const Library* library, StatsGroupBy group_by, uint32_t key, char* name, size_t size) {
+    if (group_by == STATS_BY_GENRE || group_by == STATS_BY_AUTHOR) {
+        const InternTable* table = group_by == STATS_BY_GENRE ? &library->genres : &library->authors;
+        const char* value = arena_get(&library->strings, intern_ref(table, key));
+        snprintf(name, size, "%s", value[0] != '\0' ? value : "<empty>");
+    } else if (group_by == STATS_BY_COVER) {
+        snprintf(name, size, "%s", get_cover_type_string((CoverType)key));
+    } else if (group_by == STATS_BY_CONDITION) {
+        snprintf(name, size, "%s", get_condition_string((Condition)key));
+    } else if (key == STATS_KEY_UNKNOWN) {
+        snprintf(name, size, "<empty>");
+    } else {
+        snprintf(name, size, "%us", key * 10);
+    }
+}
+
+// qsort order for groups: largest first (by sum with a measure, otherwise
+// by count) when sort_largest is set, then by name for genres and authors,
+// or in enum and decade order for the other keys; <empty> decades go last
+static int compare_groups(const void* a, const void* b) {
+    const StatsEntry* x = (const StatsEntry*)a;
+    const StatsEntry* y = (const StatsEntry*)b;
+    if (sort_largest) {
+        int64_t size_x = sort_by_sum ? x->sum : x->count;
+        int64_t size_y = sort_by_sum ? y->sum : y->count;
+        if (size_x != size_y) {
+            return size_x > size_y ? -1 : 1;
+        }
+    }
+    if (sort_group_by == STATS_BY_GENRE || sort_group_by == STATS_BY_AUTHOR) {
+        const InternTable* table = sort_group_by == STATS_BY_GENRE ? &sort_library->genres : &sort_library->authors;
+        int order = strcmp(arena_get(&sort_library->strings, intern_ref(table, x->key)),
+                           arena_get(&sort_library->strings, intern_ref(table, y->key)));
+        if (order != 0) {
+            return order;
+        }
+    }
+    return x->key < y->key ? -1 : x->key > y->key;
+}
+
+// Print a table of the library's books per group, with the sum, minimum,
+// maximum and average of the measured field if there is one. With top set,
+// only the top largest groups are shown, largest first. Book counts per
+// genre, cover type and condition come from the running totals; the rest
+// is aggregated from the column store.
+void print_library_stats(Library* library, StatsGroupBy group_by, StatsMeasure measure, int top, int threads,
+                         int timing) {
+    StatsTable table;
+    stats_table_init(&table);
+    double started = fetch_now_seconds();
+    int from_totals = measure == STATS_COUNT_ONLY && stats_from_totals(library, group_by, &table);
+    if (!from_totals) {
+        if (!library->columnar && !library_enable_columns(library)) {
+            printf("Not enough memory to aggregate the library.\n");
+            return;
+        }
+        started = fetch_now_seconds();
+        if (!stats_aggregate(library, group_by, measure, threads, &table)) {
+            printf("Not enough memory to aggregate the library.\n");
+            return;
+        }
+    }
+    double elapsed = fetch_now_seconds() - started;
+
+    // Gather the groups out of the table to sort them
+    StatsEntry* groups = (StatsEntry*)malloc(sizeof(StatsEntry) * (table.count ? table.count : 1));
+    if (!groups) {
+        fprintf(stderr, "Memory allocation failed while sorting statistics\n");
+        stats_table_free(&table);
+        return;
+    }
+    uint32_t group_count = 0;
+    for (uint32_t i = 0; i < table.entry_count; i++) {
+        if (table.entries[i].count != 0) {
+            groups[group_count++] = table.entries[i];
+        }
+    }
+    sort_library = library;
+    sort_group_by = group_by;
+    sort_largest = top > 0;
+    sort_by_sum = measure != STATS_COUNT_ONLY;
+    qsort(groups, group_count, sizeof(StatsEntry), compare_groups);
+    uint32_t shown = top > 0 && (uint32_t)top < group_count ? (uint32_t)top : group_count;
+
+    printf("\nBooks by %s (%d books, %u group%s):\n", group_by_names[group_by], library_book_count(library),
+           group_count, group_count == 1 ? "" : "s");
+    printf("%-*s %9s", STATS_NAME_WIDTH, group_by_headings[group_by], "Books");
+    if (measure != STATS_COUNT_ONLY) {
+        const char* field = measure == STATS_WORD_COUNT ? "words" : "year";
+        printf(" %9s %15s %9s %9s %11s", "With", "Total", "Min", "Max", "Average");
+        printf("\n%-*s %9s %9s %15s %9s %9s %11s", STATS_NAME_WIDTH, "", "", field, field, field, field, field);
+    }
+    printf("\n");
+
+    for (uint32_t i = 0; i < shown; i++) {
+        const StatsEntry* group = &groups[i];
+        char name[256];
+        format_group(library, group_by, group->key, name, sizeof(name));
+        printf("%-*s %9u", STATS_NAME_WIDTH, name, group->count);
+        if (measure != STATS_COUNT_ONLY && group->valued) {
+            printf(" %9u %15lld %9d %9d %11.1f", group->valued, (long long)group->sum, group->min, group->max,
+                   (double)group->sum / group->valued);
+        } else if (measure != STATS_COUNT_ONLY) {
+            printf(" %9u %15s %9s %9s %11s", 0u, "-", "-", "-", "-");
+        }
+        printf("\n");
+    }
+    if (shown < group_count) {
+        printf("... and %u more groups\n", group_count - shown);
+    }
+    if (timing) {
+        printf("%s in %.3f ms\n", from_totals ? "Read from the running totals" : "Aggregated", elapsed * 1000.0);
+    }
+
+    free(groups);
+    stats_table_free(&table);
+}
@@ -0,0 +1,58 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include "library.h"
+
+#define STATS_MAX_THREADS 64
+#define STATS_MIN_THREAD_ROWS 65536   // Smallest share of the rows worth a thread
+#define STATS_KEY_UNKNOWN UINT32_MAX  // Decade of books without a year
+
+// What books are grouped by
+typedef enum {
+    STATS_BY_GENRE,
+    STATS_BY_AUTHOR,
+    STATS_BY_COVER,
+    STATS_BY_CONDITION,
+    STATS_BY_DECADE
+} StatsGroupBy;
+
+// The field summed, averaged and ranged over each group, if any
+typedef enum {
+    STATS_COUNT_ONLY,
+    STATS_WORD_COUNT,
+    STATS_YEAR
+} StatsMeasure;
+
+// Aggregates of one group. Books whose measured field is empty (0) count
+// towards count but not towards the others.
+typedef struct {
+    uint32_t key;         // Genre or author ID, cover type, condition, or year / 10
+    uint32_t count;       // Books in the group (0 = free table entry)
+    uint32_t valued;      // Books with the measured field set
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+} StatsEntry;
+
+// Open-addressing (linear probing) hash table from group key to aggregates
+typedef struct {
+    StatsEntry* entries;
+    uint32_t entry_count; // Size of the table (power of two, or 0)
+    uint32_t count;       // Groups in use
+    int failed;           // Ran out of memory while growing
+} StatsTable;
+
+// Function declarations
+void stats_table_init(StatsTable* table);
+void stats_table_free(StatsTable* table);
+int stats_aggregate(const Library* library, StatsGroupBy group_by, StatsMeasure measure, int threads,
+                    StatsTable* result);
+int stats_from_totals(Library* library, StatsGroupBy group_by, StatsTable* result);
+int parse_stats_group_by(const char* name);
+int parse_stats_measure(const char* name);
+void print_library_totals(Library* library);
+void print_library_stats(Library* library, StatsGroupBy group_by, StatsMeasure measure, int top, int threads,
+                         int timing);
+
+#endif // STATS_H
@@ -0,0 +1,430 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "text_index.h"
+
+// SSE2 is part of the x86-64 baseline, so the block merge needs no CPU check
+#if defined(__x86_64__) && defined(__GNUC__)
+#define TEXT_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define TEXT_INDEX_INITIAL_ENTRIES 64
+#define TEXT_GALLOP_RATIO 32   // Gallop through a list this many times longer than the result
+
+// Base letters of U+00C0..U+017F (UTF-8 C3 80 to C5 BF), so accented Latin
+// letters index as their plain form. A space marks a symbol (multiplication
+// and division signs), which separates words.
+static const char text_folded[] =
+    "aaaaaaaceeeeiiiidnooooo ouuuuyts" "aaaaaaaceeeeiiiidnooooo ouuuuyty"
+    "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiiiiijjkkklllllll"
+    "lllnnnnnnnnnoooooooorrrrrrssssssssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+
+// The character at `p` as it is indexed (lower-cased, accents dropped) and
+// its size in bytes. Returns 0 for anything that separates words. Non-Latin
+// UTF-8 characters are kept byte for byte.
+static unsigned char term_char(const unsigned char* p, int* size) {
+    unsigned char c = *p;
+    *size = 1;
+    if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) {
+        return c;
+    }
+    if (c >= 'A' && c <= 'Z') {
+        return (unsigned char)(c + ('a' - 'A'));
+    }
+    if (c < 0x80) {
+        return 0;
+    }
+    if (c >= 0xC3 && c <= 0xC5 && p[1] >= 0x80 && p[1] <= 0xBF) {
+        *size = 2;
+        char folded = text_folded[(c - 0xC3) * 64 + (p[1] - 0x80)];
+        return folded == ' ' ? 0 : (unsigned char)folded;
+    }
+    return c;
+}
+
+// Copy the next word at *cursor into `term` (TEXT_MAX_TERM_LENGTH + 1 bytes)
+// in indexed form, and move the cursor past it. Returns the length of the
+// word, or 0 when there are no more.
+size_t text_next_term(const char** cursor, char* term) {
+    const unsigned char* p = (const unsigned char*)*cursor;
+    int size;
+    while (*p && !term_char(p, &size)) {
+        p += size;
+    }
+
+    size_t length = 0;
+    unsigned char c;
+    while ((c = term_char(p, &size)) != 0) {
+        if (length < TEXT_MAX_TERM_LENGTH) {
+            term[length++] = (char)c;
+        }
+        p += size;
+    }
+    term[length] = '\0';
+    *cursor = (const char*)p;
+    return length;
+}
+
+// Initialize an empty index
+void text_index_init(TextIndex* index) {
+    memset(index, 0, sizeof(TextIndex));
+    arena_init(&index->terms);
+}
+
+// Position of a term's dictionary entry, or of the free entry where it would go
+static uint32_t text_index_position(const TextIndex* index, const char* term, size_t length, uint32_t hash) {
+    uint32_t mask = index->entry_count - 1;
+    uint32_t position = hash & mask;
+    for (;;) {
+        const TermEntry* entry = &index->entries[position];
+        if (entry->list == TEXT_INDEX_EMPTY ||
+            (entry->hash == hash && entry->term.length == length &&
+             memcmp(arena_get(&index->terms, entry->term), term, length) == 0)) {
+            return position;
+        }
+        position = (position + 1) & mask;
+    }
+}
+
+// Make room for one more term, keeping the dictionary at most 70% full
+static int text_index_reserve(TextIndex* index) {
+    uint32_t entry_count = index->entry_count ? index->entry_count : TEXT_INDEX_INITIAL_ENTRIES;
+    while ((uint64_t)(index->list_count + 1) * 10 > (uint64_t)entry_count * 7) {
+        entry_count *= 2;
+    }
+    if (entry_count == index->entry_count) {
+        return 1;
+    }
+
+    TermEntry* entries = (TermEntry*)malloc(sizeof(TermEntry) * entry_count);
+    if (!entries) {
+        fprintf(stderr, "Memory allocation failed while growing word index\n");
+        return 0;
+    }
+    for (uint32_t i = 0; i < entry_count; i++) {
+        entries[i].list = TEXT_INDEX_EMPTY;
+    }
+
+    TermEntry* old_entries = index->entries;
+    uint32_t old_count = index->entry_count;
+    uint32_t mask = entry_count - 1;
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (old_entries[i].list != TEXT_INDEX_EMPTY) {
+            uint32_t position = old_entries[i].hash & mask;
+            while (entries[position].list != TEXT_INDEX_EMPTY) {
+                position = (position + 1) & mask;
+            }
+            entries[position] = old_entries[i];
+        }
+    }
+    free(old_entries);
+    index->entries = entries;
+    index->entry_count = entry_count;
+    return 1;
+}
+
+// The posting list of a term, or NULL if the term was never indexed
+static PostingList* text_index_find_list(const TextIndex* index, const char* term, size_t length) {
+    if (index->list_count == 0) {
+        return NULL;
+    }
+    uint32_t position = text_index_position(index, term, length, arena_hash(term, length));
+    uint32_t list = index->entries[position].list;
+    return list == TEXT_INDEX_EMPTY ? NULL : &index->lists[list];
+}
+
+// The posting list of a term, added to the dictionary if it is new. Returns
+// NULL if memory runs out.
+static PostingList* text_index_term_list(TextIndex* index, const char* term, size_t length) {
+    if (!text_index_reserve(index)) {
+        return NULL;
+    }
+
+    uint32_t hash = arena_hash(term, length);
+    uint32_t position = text_index_position(index, term, length, hash);
+    TermEntry* entry = &index->entries[position];
+    if (entry->list != TEXT_INDEX_EMPTY) {
+        return &index->lists[entry->list];
+    }
+
+    if (index->list_count == index->list_capacity) {
+        uint32_t capacity = index->list_capacity ? index->list_capacity * 2 : TEXT_INDEX_INITIAL_ENTRIES;
+        PostingList* lists = (PostingList*)realloc(index->lists, sizeof(PostingList) * capacity);
+        if (!lists) {
+            fprintf(stderr, "Memory allocation failed while growing word index\n");
+            return NULL;
+        }
+        index->lists = lists;
+        index->list_capacity = capacity;
+    }
+
+    entry->term = arena_add(&index->terms, term, length);
+    entry->hash = hash;
+    entry->list = index->list_count;
+    PostingList* list = &index->lists[index->list_count++];
+    list->term = entry->term;
+    list->slots = NULL;
+    list->count = 0;
+    list->capacity = 0;
+    return list;
+}
+
+// First position in slots[low, high) holding a value >= `slot`
+static uint32_t posting_lower_bound(const uint32_t* slots, uint32_t low, uint32_t high, uint32_t slot) {
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (slots[middle] < slot) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+// Add a slot to a posting list, keeping it sorted. Books are mostly indexed
+// in slot order, so the usual case is an append.
+static int posting_insert(TextIndex* index, PostingList* list, uint32_t slot) {
+    uint32_t position = list->count;
+    if (position > 0 && list->slots[position - 1] >= slot) {
+        position = posting_lower_bound(list->slots, 0, list->count, slot);
+        if (list->slots[position] == slot) {
+            return 1; // The word appears twice in the book
+        }
+    }
+
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 1;
+        uint32_t* slots = (uint32_t*)realloc(list->slots, sizeof(uint32_t) * capacity);
+        if (!slots) {
+            fprintf(stderr, "Memory allocation failed while growing word index\n");
+            return 0;
+        }
+        list->slots = slots;
+        list->capacity = capacity;
+    }
+
+    memmove(&list->slots[position + 1], &list->slots[position], sizeof(uint32_t) * (list->count - position));
+    list->slots[position] = slot;
+    list->count++;
+    index->posting_count++;
+    return 1;
+}
+
+// Add `slot` to the posting list of one term, taken as it is
+int text_index_add_term(TextIndex* index, const char* term, size_t length, uint32_t slot) {
+    PostingList* list = text_index_term_list(index, term, length);
+    return list && posting_insert(index, list, slot);
+}
+
+// Index every word of `text` (a title or author) for the book in `slot`
+int text_index_add(TextIndex* index, const char* text, uint32_t slot) {
+    char term[TEXT_MAX_TERM_LENGTH + 1];
+    size_t length;
+    while ((length = text_next_term(&text, term)) > 0) {
+        if (!text_index_add_term(index, term, length, slot)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// The posting list of a term taken as it is, or NULL if it was never indexed
+const PostingList* text_index_list(const TextIndex* index, const char* term, size_t length) {
+    return text_index_find_list(index, term, length);
+}
+
+// The term of a posting list, by its index in `lists`
+const char* text_index_term(const TextIndex* index, uint32_t list) {
+    return arena_get(&index->terms, index->lists[list].term);
+}
+
+// Drop the book in `slot` from the lists of every word of `text`
+void text_index_remove(TextIndex* index, const char* text, uint32_t slot) {
+    char term[TEXT_MAX_TERM_LENGTH + 1];
+    size_t length;
+    while ((length = text_next_term(&text, term)) > 0) {
+        PostingList* list = text_index_find_list(index, term, length);
+        if (!list) {
+            continue;
+        }
+        uint32_t position = posting_lower_bound(list->slots, 0, list->count, slot);
+        if (position < list->count && list->slots[position] == slot) {
+            memmove(&list->slots[position], &list->slots[position + 1],
+                    sizeof(uint32_t) * (list->count - position - 1));
+            list->count--;
+            index->posting_count--;
+        }
+    }
+}
+
+// Write the slots of `short_list` that are also in a much longer list to
+// `out`. Each lookup gallops forward from
+// the previous match (1, 2, 4... places) and then binary searches, so the
+// cost grows with the short list, not the long one.
+static uint32_t intersect_gallop(const uint32_t* short_list, uint32_t short_count,
+                                 const uint32_t* list, uint32_t list_count, uint32_t* out) {
+    uint32_t kept = 0;
+    uint32_t low = 0;
+    for (uint32_t i = 0; i < short_count && low < list_count; i++) {
+        uint32_t slot = short_list[i];
+        uint32_t high = low;
+        uint32_t step = 1;
+        while (high < list_count && list[high] < slot) {
+            low = high + 1;
+            high += step;
+            step *= 2;
+        }
+        if (high > list_count) {
+            high = list_count;
+        }
+        low = posting_lower_bound(list, low, high, slot);
+        if (low < list_count && list[low] == slot) {
+            out[kept++] = slot;
+        }
+    }
+    return kept;
+}
+
+// Write the slots two lists of similar length have in common to `out`.
+// With SSE2, four slots of each list are compared against each other at once
+// (the second block rotated three times), and whichever block ends lower is
+// stepped past; the rest is a branch-free merge. Matches are too random to
+// predict, so every candidate is stored and only the matches move `kept` on,
+// which means `out` must not overlap the first list.
+static uint32_t intersect_merge(const uint32_t* first, uint32_t first_count,
+                                const uint32_t* second, uint32_t second_count, uint32_t* out) {
+    uint32_t kept = 0;
+    uint32_t i = 0;
+    uint32_t j = 0;
+#ifdef TEXT_HAVE_SSE2
+    while (i + 4 <= first_count && j + 4 <= second_count) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(first + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(second + j));
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(a, b), _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 3, 2, 1)))),
+            _mm_or_si128(_mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(1, 0, 3, 2))),
+                         _mm_cmpeq_epi32(a, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 1, 0, 3)))));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(hits));
+        uint32_t first_last = first[i + 3];
+        uint32_t second_last = second[j + 3];
+        for (int lane = 0; lane < 4; lane++) {
+            out[kept] = first[i + lane];
+            kept += (mask >> lane) & 1;
+        }
+        i += first_last <= second_last ? 4 : 0;
+        j += second_last <= first_last ? 4 : 0;
+    }
+#endif
+    while (i < first_count && j < second_count) {
+        uint32_t a = first[i];
+        uint32_t b = second[j];
+        out[kept] = a;
+        kept += a == b;
+        i += a <= b;
+        j += a >= b;
+    }
+    return kept;
+}
+
+// Write the slots two posting lists have in common to `out`
+static uint32_t intersect_lists(const uint32_t* first, uint32_t first_count,
+                                const uint32_t* second, uint32_t second_count, uint32_t* out) {
+    if ((uint64_t)first_count * TEXT_GALLOP_RATIO < second_count) {
+        return intersect_gallop(first, first_count, second, second_count, out);
+    }
+    return intersect_merge(first, first_count, second, second_count, out);
+}
+
+// Find the books containing every word of `query`. Up to `max_slots` of
+// their slots are written to `slots` in ascending order; the return value is
+// the total number of matches (-1 if memory runs out).
+int text_index_search(const TextIndex* index, const char* query, uint32_t* slots, int max_slots) {
+    const PostingList* lists[TEXT_MAX_QUERY_TERMS];
+    int list_count = 0;
+    char term[TEXT_MAX_TERM_LENGTH + 1];
+    size_t length;
+    while (list_count < TEXT_MAX_QUERY_TERMS && (length = text_next_term(&query, term)) > 0) {
+        const PostingList* list = text_index_find_list(index, term, length);
+        if (!list || list->count == 0) {
+            return 0;
+        }
+        int repeated = 0;
+        for (int i = 0; i < list_count; i++) {
+            repeated |= lists[i] == list;
+        }
+        if (!repeated) {
+            lists[list_count++] = list;
+        }
+    }
+    if (list_count == 0) {
+        return 0;
+    }
+
+    // Shortest list first: the result can only shrink from there
+    for (int i = 1; i < list_count; i++) {
+        const PostingList* list = lists[i];
+        int j = i;
+        for (; j > 0 && lists[j - 1]->count > list->count; j--) {
+            lists[j] = lists[j - 1];
+        }
+        lists[j] = list;
+    }
+
+    uint32_t count = lists[0]->count;
+    if (list_count == 1) {
+        memcpy(slots, lists[0]->slots, sizeof(uint32_t) * (count < (uint32_t)max_slots ? count : (uint32_t)max_slots));
+        return (int)count;
+    }
+
+    // Each intersection narrows the result into the other half of the buffer
+    uint32_t* buffer = (uint32_t*)malloc(sizeof(uint32_t) * count * 2);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation failed while searching\n");
+        return -1;
+    }
+    uint32_t* result = buffer;
+    uint32_t* spare = buffer + count;
+    count = intersect_lists(lists[0]->slots, count, lists[1]->slots, lists[1]->count, result);
+    for (int i = 2; i < list_count && count > 0; i++) {
+        count = intersect_lists(result, count, lists[i]->slots, lists[i]->count, spare);
+        uint32_t* swap = result;
+        result = spare;
+        spare = swap;
+    }
+    memcpy(slots, result, sizeof(uint32_t) * (count < (uint32_t)max_slots ? count : (uint32_t)max_slots));
+    free(buffer);
+    return (int)count;
+}
+
+// Drop every term and posting list
+void text_index_clear(TextIndex* index) {
+    for (uint32_t i = 0; i < index->list_count; i++) {
+        free(index->lists[i].slots);
+    }
+    for (uint32_t i = 0; i < index->entry_count; i++) {
+        index->entries[i].list = TEXT_INDEX_EMPTY;
+    }
+    index->list_count = 0;
+    index->posting_count = 0;
+    arena_free(&index->terms);
+}
+
+// Bytes allocated for the dictionary, terms and posting lists
+size_t text_index_memory(const TextIndex* index) {
+    size_t bytes = sizeof(TermEntry) * (size_t)index->entry_count + index->terms.capacity +
+                   sizeof(PostingList) * (size_t)index->list_capacity;
+    for (uint32_t i = 0; i < index->list_count; i++) {
+        bytes += sizeof(uint32_t) * (size_t)index->lists[i].capacity;
+    }
+    return bytes;
+}
+
+// Free the index
+void text_index_free(TextIndex* index) {
+    text_index_clear(index);
+    free(index->entries);
+    free(index->lists);
+    text_index_init(index);
+}
@@ -0,0 +1,53 @@
+#ifndef TEXT_INDEX_H
+#define TEXT_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define TEXT_MAX_TERM_LENGTH 64     // Longer words are cut to this many bytes
+#define TEXT_MAX_QUERY_TERMS 16     // Words of a query past this are ignored
+#define TEXT_INDEX_EMPTY UINT32_MAX // List value of a free dictionary entry
+
+// Sorted library slots of every book containing one term
+typedef struct {
+    StrRef term;          // The term, in the index's arena
+    uint32_t* slots;
+    uint32_t count;
+    uint32_t capacity;
+} PostingList;
+
+// Dictionary entry: a term (in the index's own arena) and its posting list
+typedef struct {
+    StrRef term;
+    uint32_t hash;        // Hash of the term, kept for rehashing
+    uint32_t list;        // Index into lists, or TEXT_INDEX_EMPTY
+} TermEntry;
+
+// Inverted index from lower-cased words to the books containing them. The
+// dictionary is an open-addressing hash table; terms stay in it after their
+// last book goes, with an empty posting list, until the index is cleared.
+typedef struct {
+    StringArena terms;      // Each distinct term once
+    TermEntry* entries;
+    uint32_t entry_count;   // Size of the table (power of two, or 0)
+    PostingList* lists;     // One per term, in order of first appearance
+    uint32_t list_count;
+    uint32_t list_capacity;
+    size_t posting_count;   // Slots across all lists
+} TextIndex;
+
+// Function declarations
+size_t text_next_term(const char** cursor, char* term);
+void text_index_init(TextIndex* index);
+int text_index_add(TextIndex* index, const char* text, uint32_t slot);
+int text_index_add_term(TextIndex* index, const char* term, size_t length, uint32_t slot);
+const PostingList* text_index_list(const TextIndex* index, const char* term, size_t length);
+const char* text_index_term(const TextIndex* index, uint32_t list);
+void text_index_remove(TextIndex* index, const char* text, uint32_t slot);
+int text_index_search(const TextIndex* index, const char* query, uint32_t* slots, int max_slots);
+void text_index_clear(TextIndex* index);
+size_t text_index_memory(const TextIndex* index);
+void text_index_free(TextIndex* index);
+
+#endif // TEXT_INDEX_H
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "title_index.h"
+
+#define TITLE_INDEX_INITIAL_ENTRIES 64
+
+// Initialize an empty index
+void title_index_init(TitleIndex* index) {
+    memset(index, 0, sizeof(TitleIndex));
+}
+
+// Whether an entry holds this title
+static int title_entry_matches(const TitleEntry* entry, const StringArena* arena,
+                               const char* title, size_t length, uint32_t hash) {
+    return entry->hash == hash && entry->title.length == length &&
+           memcmp(arena_get(arena, entry->title), title, length) == 0;
+}
+
+// Put an entry in the first free place of its probe sequence
+static void title_index_place(TitleIndex* index, const TitleEntry* entry) {
+    uint32_t mask = index->entry_count - 1;
+    uint32_t position = entry->hash & mask;
+    while (index->entries[position].slot != TITLE_INDEX_EMPTY) {
+        position = (position + 1) & mask;
+    }
+    index->entries[position] = *entry;
+}
+
+// Make room for `count` entries in total, keeping the table at most 70% full
+int title_index_reserve(TitleIndex* index, uint32_t count) {
+    uint32_t entry_count = index->entry_count ? index->entry_count : TITLE_INDEX_INITIAL_ENTRIES;
+    while ((uint64_t)count * 10 > (uint64_t)entry_count * 7) {
+        entry_count *= 2;
+    }
+    if (entry_count == index->entry_count) {
+        return 1;
+    }
+
+    TitleEntry* entries = (TitleEntry*)malloc(sizeof(TitleEntry) * entry_count);
+    if (!entries) {
+        fprintf(stderr, "Memory allocation failed while growing title index\n");
+        return 0;
+    }
+    for (uint32_t i = 0; i < entry_count; i++) {
+        entries[i].slot = TITLE_INDEX_EMPTY;
+    }
+
+    TitleEntry* old_entries = index->entries;
+    uint32_t old_count = index->entry_count;
+    index->entries = entries;
+    index->entry_count = entry_count;
+    for (uint32_t i = 0; i < old_count; i++) {
+        if (old_entries[i].slot != TITLE_INDEX_EMPTY) {
+            title_index_place(index, &old_entries[i]);
+        }
+    }
+    free(old_entries);
+    return 1;
+}
+
+// Index the book in `slot` under its title
+int title_index_add(TitleIndex* index, const StringArena* arena, StrRef title, int slot) {
+    if (!title_index_reserve(index, index->count + 1)) {
+        return 0;
+    }
+
+    TitleEntry entry;
+    entry.title = title;
+    entry.hash = arena_hash(arena_get(arena, title), title.length);
+    entry.slot = slot;
+    title_index_place(index, &entry);
+    index->count++;
+    return 1;
+}
+
+// Drop the entry of the book in `slot`. Later entries of the same probe run
+// are shifted back so lookups never stop early at the hole.
+void title_index_remove(TitleIndex* index, const StringArena* arena, StrRef title, int slot) {
+    if (index->count == 0) {
+        return;
+    }
+
+    uint32_t mask = index->entry_count - 1;
+    uint32_t position = arena_hash(arena_get(arena, title), title.length) & mask;
+    while (index->entries[position].slot != slot) {
+        if (index->entries[position].slot == TITLE_INDEX_EMPTY) {
+            return;
+        }
+        position = (position + 1) & mask;
+    }
+
+    uint32_t hole = position;
+    for (;;) {
+        position = (position + 1) & mask;
+        const TitleEntry* entry = &index->entries[position];
+        if (entry->slot == TITLE_INDEX_EMPTY) {
+            break;
+        }
+        // An entry may fill the hole only if the hole lies between its home
+        // position and where it sits now
+        uint32_t home = entry->hash & mask;
+        if (((position - home) & mask) >= ((position - hole) & mask)) {
+            index->entries[hole] = *entry;
+            hole = position;
+        }
+    }
+    index->entries[hole].slot = TITLE_INDEX_EMPTY;
+    index->count--;
+}
+
+// Find every book with this title. Up to `max_slots` of their slots are
+// written to `slots`, in no particular order; the return value is the total
+// number of matches, which may be larger.
+int title_index_find(const TitleIndex* index, const StringArena* arena, const char* title, size_t length,
+                     int* slots, int max_slots) {
+    if (index->count == 0) {
+        return 0;
+    }
+
+    uint32_t hash = arena_hash(title, length);
+    uint32_t mask = index->entry_count - 1;
+    int matches = 0;
+    for (uint32_t position = hash & mask; index->entries[position].slot != TITLE_INDEX_EMPTY;
+         position = (position + 1) & mask) {
+        const TitleEntry* entry = &index->entries[position];
+        if (title_entry_matches(entry, arena, title, length, hash)) {
+            if (matches < max_slots) {
+                slots[matches] = entry->slot;
+            }
+            matches++;
+        }
+    }
+    return matches;
+}
+
+// Drop every entry, keeping the table
+void title_index_clear(TitleIndex* index) {
+    for (uint32_t i = 0; i < index->entry_count; i++) {
+        index->entries[i].slot = TITLE_INDEX_EMPTY;
+    }
+    index->count = 0;
+}
+
+// Bytes allocated for the table
+size_t title_index_memory(const TitleIndex* index) {
+    return sizeof(TitleEntry) * (size_t)index->entry_count;
+}
+
+// Free the table (the titles stay in their arena)
+void title_index_free(TitleIndex* index) {
+    free(index->entries);
+    title_index_init(index);
+}
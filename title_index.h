@@ -0,0 +1,37 @@
+#ifndef TITLE_INDEX_H
+#define TITLE_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arena.h"
+
+#define TITLE_INDEX_EMPTY -1   // Slot value of a free table entry
+
+// One indexed book: its title (in the library's arena) and library slot
+typedef struct {
+    StrRef title;
+    uint32_t hash;        // Hash of the title, kept for rehashing
+    int32_t slot;         // Library slot, or TITLE_INDEX_EMPTY
+} TitleEntry;
+
+// Open-addressing (linear probing) hash index from title to library slots.
+// Books sharing a title each get their own entry, so a lookup returns all of
+// them. Removal shifts later entries back instead of leaving tombstones.
+typedef struct {
+    TitleEntry* entries;
+    uint32_t entry_count;   // Size of the table (power of two, or 0)
+    uint32_t count;         // Entries in use
+} TitleIndex;
+
+// Function declarations
+void title_index_init(TitleIndex* index);
+int title_index_reserve(TitleIndex* index, uint32_t count);
+int title_index_add(TitleIndex* index, const StringArena* arena, StrRef title, int slot);
+void title_index_remove(TitleIndex* index, const StringArena* arena, StrRef title, int slot);
+int title_index_find(const TitleIndex* index, const StringArena* arena, const char* title, size_t length,
+                     int* slots, int max_slots);
+void title_index_clear(TitleIndex* index);
+size_t title_index_memory(const TitleIndex* index);
+void title_index_free(TitleIndex* index);
+
+#endif // TITLE_INDEX_H
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "totals.h"
+
+#define TOTALS_INITIAL_GENRES 16
+
+// Initialize totals for an empty library
+void totals_init(LibraryTotals* totals) {
+    memset(totals, 0, sizeof(LibraryTotals));
+}
+
+// Make room for a genre ID, doubling the per-genre counts as needed
+static int reserve_genre(LibraryTotals* totals, uint32_t genre_id) {
+    if (genre_id < totals->genre_count) {
+        return 1;
+    }
+
+    uint32_t new_count = totals->genre_count ? totals->genre_count : TOTALS_INITIAL_GENRES;
+    while (new_count <= genre_id) {
+        new_count *= 2;
+    }
+    uint32_t* new_genres = (uint32_t*)realloc(totals->genres, sizeof(uint32_t) * new_count);
+    if (!new_genres) {
+        fprintf(stderr, "Memory allocation failed while counting genres\n");
+        totals->stale = 1;
+        return 0;
+    }
+    memset(new_genres + totals->genre_count, 0, sizeof(uint32_t) * (new_count - totals->genre_count));
+    totals->genres = new_genres;
+    totals->genre_count = new_count;
+    return 1;
+}
+
+// Count a book in (sign 1) or out of (sign -1) the totals
+static void totals_apply(LibraryTotals* totals, const Book* book, int sign) {
+    totals->books += (uint32_t)sign;
+    if (!book->metadata_retrieved) {
+        totals->missing_metadata += (uint32_t)sign;
+    }
+    if (book->word_count > 0) {
+        totals->words += sign * (int64_t)book->word_count;
+    }
+    if ((unsigned)book->cover_type < COVER_TYPE_COUNT) {
+        totals->covers[book->cover_type] += (uint32_t)sign;
+    }
+    if ((unsigned)book->condition < CONDITION_COUNT) {
+        totals->conditions[book->condition] += (uint32_t)sign;
+    }
+    if (reserve_genre(totals, book->genre_id)) {
+        totals->genres[book->genre_id] += (uint32_t)sign;
+    }
+}
+
+// Count a book that joined the library
+void totals_add(LibraryTotals* totals, const Book* book) {
+    totals_apply(totals, book, 1);
+}
+
+// Take out a book that is about to change or go
+void totals_remove(LibraryTotals* totals, const Book* book) {
+    totals_apply(totals, book, -1);
+}
+
+// Add books to one genre's count (used when totals are loaded rather than
+// counted). Returns 0 if memory runs out.
+int totals_add_genre(LibraryTotals* totals, uint32_t genre_id, uint32_t books) {
+    if (!reserve_genre(totals, genre_id)) {
+        return 0;
+    }
+    totals->genres[genre_id] += books;
+    return 1;
+}
+
+// Add the totals of other books (with genre IDs from the same library)
+void totals_merge(LibraryTotals* into, const LibraryTotals* from) {
+    into->books += from->books;
+    into->missing_metadata += from->missing_metadata;
+    into->words += from->words;
+    for (int i = 0; i < COVER_TYPE_COUNT; i++) {
+        into->covers[i] += from->covers[i];
+    }
+    for (int i = 0; i < CONDITION_COUNT; i++) {
+        into->conditions[i] += from->conditions[i];
+    }
+    for (uint32_t id = 0; id < from->genre_count; id++) {
+        if (from->genres[id] != 0) {
+            totals_add_genre(into, id, from->genres[id]);
+        }
+    }
+    into->stale |= from->stale;
+}
+
+// Reset to the totals of an empty library, keeping the genre array
+void totals_clear(LibraryTotals* totals) {
+    uint32_t* genres = totals->genres;
+    uint32_t genre_count = totals->genre_count;
+    totals_init(totals);
+    if (genres) {
+        memset(genres, 0, sizeof(uint32_t) * genre_count);
+    }
+    totals->genres = genres;
+    totals->genre_count = genre_count;
+}
+
+// Free the per-genre counts
+void totals_free(LibraryTotals* totals) {
+    free(totals->genres);
+    totals_init(totals);
+}
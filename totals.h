@@ -0,0 +1,30 @@
+#ifndef TOTALS_H
+#define TOTALS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "book.h"
+
+// Running totals over a library's books, moved by each book added, changed
+// or deleted, so summary counts never need a pass over the books
+typedef struct {
+    uint32_t books;
+    uint32_t missing_metadata;          // Books whose metadata has not been fetched
+    int64_t words;                      // Sum of the word counts that are set
+    uint32_t covers[COVER_TYPE_COUNT];  // Books per cover type
+    uint32_t conditions[CONDITION_COUNT];
+    uint32_t* genres;                   // Books per genre ID
+    uint32_t genre_count;               // Genre IDs with room in genres
+    int stale;                          // A genre count could not be stored; recount before use
+} LibraryTotals;
+
+// Function declarations
+void totals_init(LibraryTotals* totals);
+void totals_add(LibraryTotals* totals, const Book* book);
+void totals_remove(LibraryTotals* totals, const Book* book);
+int totals_add_genre(LibraryTotals* totals, uint32_t genre_id, uint32_t books);
+void totals_merge(LibraryTotals* into, const LibraryTotals* from);
+void totals_clear(LibraryTotals* totals);
+void totals_free(LibraryTotals* totals);
+
+#endif // TOTALS_H